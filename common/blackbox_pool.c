@@ -0,0 +1,319 @@
+/**
+ * @file    blackbox_pool.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Pool of pre-spawned blackbox processes that are already executed and waiting on their STDIN.
+ *
+ *  Every registered executable has an entry holding its warm processes. When a request takes a process and the entry drops below
+ *  the refill limit, the entry is marked and the refill thread spawns new processes until the entry is full again. Spawning is done
+ *  without holding the pool lock, so requests are never blocked behind a process creation.
+ *
+ *  Processes are created with launcher.c. Warm processes are bound to the file that was executed. If the executable is replaced
+ *  (its inode or modification time changes), its warm processes are killed instead of being used.
+ */
+
+#define _GNU_SOURCE
+
+#include "blackbox_pool.h"
+#include "options.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Warm processes and statistics of one executable
+struct pool_entry
+{
+    char *executable_path;
+    dev_t device;
+    ino_t inode;
+    struct timespec modification_time;
+
+    struct blackbox_process *processes; // Stack of warm processes, has room for pool_size processes
+    int count;
+    int refilling;                      // Set when the entry fell below the refill limit, cleared when it is full again
+
+    unsigned long hits, misses;
+    struct pool_entry *next;
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refill_needed = PTHREAD_COND_INITIALIZER;
+static sem_t report_requested;
+
+static struct pool_entry *entries;
+static int pool_size, refill_below, background_refill;
+
+// Kills and reaps a warm process which won't be used anymore
+static void discard_process(struct blackbox_process *process)
+{
+    close(process->input_fd);
+    close(process->output_fd);
+    kill(process->pid, SIGKILL);
+    reap_blackbox(process, NULL, 0);
+}
+
+// Checks whether the file of the entry is still the same executable that the warm processes were started from
+static int entry_is_current(struct pool_entry *entry, struct stat *file_status)
+{
+    return entry->device == file_status->st_dev && entry->inode == file_status->st_ino &&
+           entry->modification_time.tv_sec == file_status->st_mtim.tv_sec &&
+           entry->modification_time.tv_nsec == file_status->st_mtim.tv_nsec;
+}
+
+// Marks the entry for refilling if it is under the limit and wakes the refill thread. Should be called with pool_lock held.
+static void schedule_refill(struct pool_entry *entry)
+{
+    if (background_refill && !entry->refilling && entry->count < refill_below)
+    {
+        entry->refilling = 1;
+        pthread_cond_signal(&refill_needed);
+    }
+}
+
+// Finds the entry of executable_path or registers a new one. Should be called with pool_lock held.
+static struct pool_entry *find_entry(const char *executable_path, struct stat *file_status)
+{
+    struct pool_entry *entry;
+
+    for (entry = entries; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->executable_path, executable_path) == 0)
+        {
+            break;
+        }
+    }
+
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(struct pool_entry));
+        if (entry == NULL || (entry->processes = calloc(pool_size, sizeof(struct blackbox_process))) == NULL ||
+            (entry->executable_path = strdup(executable_path)) == NULL)
+        {
+            perror("[ERROR] Memory allocation error.");
+            exit(-1);
+        }
+        entry->next = entries;
+        entries = entry;
+    }
+    else if (entry_is_current(entry, file_status))
+    {
+        return entry;
+    }
+
+    // The entry is new or its executable has been replaced, so its warm processes belong to an old file
+    while (entry->count > 0)
+    {
+        discard_process(&entry->processes[--entry->count]);
+    }
+    entry->device = file_status->st_dev;
+    entry->inode = file_status->st_ino;
+    entry->modification_time = file_status->st_mtim;
+    entry->refilling = 0;
+
+    return entry;
+}
+
+// Keeps spawning processes for the entries marked for refilling
+static void *refill_thread(void *unused)
+{
+    struct pool_entry *entry;
+    struct blackbox_process process;
+    struct stat file_status;
+
+    pthread_mutex_lock(&pool_lock);
+    while (1)
+    {
+        for (entry = entries; entry != NULL; entry = entry->next)
+        {
+            if (entry->refilling)
+            {
+                break;
+            }
+        }
+        if (entry == NULL)
+        {
+            pthread_cond_wait(&refill_needed, &pool_lock);
+            continue;
+        }
+
+        // Entries are never removed, so the entry can be used after the lock is released
+        pthread_mutex_unlock(&pool_lock);
+        int spawned = stat(entry->executable_path, &file_status) == 0 && launch_blackbox(entry->executable_path, &process) == 0;
+        pthread_mutex_lock(&pool_lock);
+
+        if (!spawned)
+        {
+            // Executable is missing or the system is out of processes, requests will spawn their own until the next miss
+            entry->refilling = 0;
+            continue;
+        }
+
+        // The process is only kept if the executable wasn't replaced in the meantime and there is still room for it
+        if (entry->refilling && entry_is_current(entry, &file_status) && entry->count < pool_size)
+        {
+            entry->processes[entry->count++] = process;
+            if (entry->count == pool_size)
+            {
+                entry->refilling = 0;
+            }
+        }
+        else
+        {
+            pthread_mutex_unlock(&pool_lock);
+            discard_process(&process);
+            pthread_mutex_lock(&pool_lock);
+        }
+    }
+
+    return NULL;
+}
+
+// Waits for SIGUSR1 notifications and prints the pool statistics
+static void *report_thread(void *unused)
+{
+    while (1)
+    {
+        if (sem_wait(&report_requested) == 0)
+        {
+            blackbox_pool_report(stderr);
+        }
+    }
+
+    return NULL;
+}
+
+// SIGUSR1 handler, only wakes the report thread since printing isn't async-signal-safe
+static void request_report(int signal_number)
+{
+    sem_post(&report_requested);
+}
+
+// Reads the configuration, registers preloaded executables and starts the helper threads
+static void pool_init(void)
+{
+    pthread_t thread;
+    struct sigaction action;
+    struct stat file_status;
+
+    pool_size = option_int("BLACKBOX_POOL_SIZE", 0);
+    if (pool_size <= 0)
+    {
+        pool_size = 0;
+        return;
+    }
+
+    refill_below = option_int("BLACKBOX_POOL_REFILL_BELOW", pool_size);
+    if (refill_below < 1 || refill_below > pool_size)
+    {
+        refill_below = pool_size;
+    }
+    background_refill = strcmp(option_string("BLACKBOX_POOL_REFILL", "background"), "none") != 0;
+
+    // A warm process may die before it is used, writing to its pipe shouldn't kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    if (sem_init(&report_requested, 0, 0) == -1)
+    {
+        perror("[ERROR] Couldn't create semaphore.");
+        exit(-1);
+    }
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_report;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    if (pthread_create(&thread, NULL, report_thread, NULL) != 0)
+    {
+        fprintf(stderr, "[ERROR] Couldn't create pool report thread.\n");
+        exit(-1);
+    }
+
+    // Preloaded executables are filled by the refill thread, or directly if background refilling is disabled
+    char *preload = strdup(option_string("BLACKBOX_POOL_PRELOAD", ""));
+    char *save_pointer;
+    for (char *path = strtok_r(preload, ":", &save_pointer); path != NULL; path = strtok_r(NULL, ":", &save_pointer))
+    {
+        if (stat(path, &file_status) == -1)
+        {
+            fprintf(stderr, "[WARNING] Preloaded blackbox %s couldn't be found.\n", path);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool_lock);
+        struct pool_entry *entry = find_entry(path, &file_status);
+        if (background_refill)
+        {
+            schedule_refill(entry);
+        }
+        else
+        {
+            while (entry->count < pool_size && launch_blackbox(path, &entry->processes[entry->count]) == 0)
+            {
+                entry->count++;
+            }
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    free(preload);
+
+    if (background_refill && pthread_create(&thread, NULL, refill_thread, NULL) != 0)
+    {
+        fprintf(stderr, "[ERROR] Couldn't create pool refill thread.\n");
+        exit(-1);
+    }
+}
+
+int blackbox_pool_acquire(const char *executable_path, struct blackbox_process *process)
+{
+    struct stat file_status;
+    struct pool_entry *entry;
+
+    pthread_once(&pool_once, pool_init);
+
+    // Without a pool, or for paths that can't be checked, the process is spawned as before
+    if (pool_size == 0 || stat(executable_path, &file_status) == -1)
+    {
+        return launch_blackbox(executable_path, process);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    entry = find_entry(executable_path, &file_status);
+    if (entry->count > 0)
+    {
+        *process = entry->processes[--entry->count];
+        entry->hits++;
+        schedule_refill(entry);
+        pthread_mutex_unlock(&pool_lock);
+        return 0;
+    }
+    entry->misses++;
+    schedule_refill(entry);
+    pthread_mutex_unlock(&pool_lock);
+
+    return launch_blackbox(executable_path, process);
+}
+
+void blackbox_pool_report(FILE *stream)
+{
+    struct pool_entry *entry;
+    unsigned long hits = 0, misses = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    for (entry = entries; entry != NULL; entry = entry->next)
+    {
+        fprintf(stream, "[POOL] %s: %lu hits, %lu misses, %d/%d warm\n", entry->executable_path, entry->hits, entry->misses, entry->count, pool_size);
+        hits += entry->hits;
+        misses += entry->misses;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    fprintf(stream, "[POOL] total: %lu hits, %lu misses\n", hits, misses);
+    fflush(stream);
+}
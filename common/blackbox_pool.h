@@ -0,0 +1,34 @@
+/**
+ * @file    blackbox_pool.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Pool of pre-spawned blackbox processes that are already executed and waiting on their STDIN.
+ *
+ *  Creating the pipes, forking and executing the blackbox takes most of the time of a request, so the servers can keep a number of
+ *  blackbox processes for each executable ready beforehand. A request then takes one of these processes, writes the input numbers
+ *  and reads the result. The taken process is replaced in the background by a refill thread.
+ *
+ *  The pool is configured with environment variables:
+ *      BLACKBOX_POOL_SIZE          Number of warm processes kept for each executable, 0 disables the pool (default 0)
+ *      BLACKBOX_POOL_REFILL_BELOW  Refilling starts when an executable has less warm processes than this (default BLACKBOX_POOL_SIZE)
+ *      BLACKBOX_POOL_REFILL        "background" refills the pool with a separate thread, "none" only fills preloaded executables once (default background)
+ *      BLACKBOX_POOL_PRELOAD       Colon separated executable paths which are registered when the pool is initialized
+ *
+ *  Executables are registered on their first request. Hit and miss counts are printed to STDERR when the process receives SIGUSR1.
+ */
+
+#ifndef BLACKBOX_POOL_H
+#define BLACKBOX_POOL_H
+
+#include "launcher.h"
+
+#include <stdio.h>
+
+// Gives a process for executable_path, either from the warm pool or by spawning a new one. Returns 0 on success, -1 on error.
+// The caller owns the returned process: it should close both file descriptors and reap the process with waitpid().
+int blackbox_pool_acquire(const char *executable_path, struct blackbox_process *process);
+
+// Prints hit and miss counts of every registered executable to the given stream
+void blackbox_pool_report(FILE *stream);
+
+#endif /* BLACKBOX_POOL_H */
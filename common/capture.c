@@ -0,0 +1,395 @@
+/**
+ * @file    capture.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Reads the whole output of a blackbox process while it runs, and reaps it.
+ *
+ *  The pipe and the pidfd of the process are watched together with poll(), so the exit is seen as soon as it happens; this covers a
+ *  blackbox that exits while a process it started still holds the pipe open. Without a pidfd, the process is checked with
+ *  reap_blackbox(WNOHANG) at growing intervals while nothing arrives instead. Reading continues until end of file, or until the process
+ *  has exited and the pipe has nothing more to read.
+ *
+ *  With limits, the wall clock time is checked on every wake up and the CPU time of the process through its CPU clock, so the waits
+ *  are also bounded by the time left, including the wait for the exit after the output is closed. When a limit is passed, the whole
+ *  process group of the blackbox is killed and the loop goes on as usual until the output is closed and the process is reaped.
+ *
+ *  The same loop either collects the output in memory (capture_blackbox) or moves it into a file (stream_blackbox). Streaming uses
+ *  splice(), so the data goes from the pipe to the file inside the kernel; if the file system doesn't support it, a fixed size buffer
+ *  is used instead, so memory use doesn't depend on the size of the output in either case.
+ */
+
+#define _GNU_SOURCE
+
+#include "capture.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INITIAL_CAPACITY 4096
+#define DISCARD_BUFFER_SIZE 65536
+#define SPLICE_SIZE (1 << 20)
+#define MAX_EXIT_CHECK_MS 100
+
+// Reads or moves the data that is ready in the pipe. Returns the byte count, 0 at end of file, or -1 with errno set
+typedef ssize_t (*pipe_consumer)(int pipe_fd, void *context);
+
+struct capture_context
+{
+    struct captured_output *output;
+    size_t capacity, limit;
+};
+
+struct stream_context
+{
+    struct streamed_output *output;
+    int fd;
+    const char *header;
+    int copy;           // Set when splice() isn't supported by the file, data is copied through a buffer instead
+};
+
+// Returns the time of the clock in milliseconds, or -1 if it can't be read
+static long long clock_ms(clockid_t clock)
+{
+    struct timespec time;
+
+    if (clock_gettime(clock, &time) == -1)
+    {
+        return -1;
+    }
+    return time.tv_sec * 1000LL + time.tv_nsec / 1000000;
+}
+
+void limit_watch_start(struct limit_watch *watch, const struct blackbox_process *process, const struct capture_limits *limits)
+{
+    watch->limits.wall_ms = limits != NULL ? limits->wall_ms : 0;
+    watch->limits.cpu_ms = limits != NULL ? limits->cpu_ms : 0;
+    watch->active = watch->limits.wall_ms > 0 || watch->limits.cpu_ms > 0;
+    watch->started_at = clock_ms(CLOCK_MONOTONIC);
+    if (watch->limits.cpu_ms > 0 && clock_getcpuclockid(process->pid, &watch->cpu_clock) != 0)
+    {
+        watch->cpu_clock = CLOCK_MONOTONIC; // Can't happen for a child on Linux, counting wall clock time is the closest to it
+    }
+}
+
+int limit_watch_check(const struct limit_watch *watch, const struct blackbox_process *process, int *wait_ms)
+{
+    const struct capture_limits *limits = &watch->limits;
+    int passed = 0;
+
+    if (!watch->active)
+    {
+        return 0;
+    }
+
+    if (limits->wall_ms > 0)
+    {
+        long long remaining = watch->started_at + limits->wall_ms - clock_ms(CLOCK_MONOTONIC);
+        if (remaining <= 0)
+        {
+            passed = CAPTURE_WALL_TIMEOUT;
+        }
+        else if (*wait_ms < 0 || remaining < *wait_ms)
+        {
+            *wait_ms = remaining;
+        }
+    }
+
+    // A process that already exited has no CPU clock anymore, it can't pass the limit then
+    long long cpu_used = limits->cpu_ms > 0 ? clock_ms(watch->cpu_clock) : -1;
+    if (!passed && cpu_used != -1)
+    {
+        long long remaining = limits->cpu_ms - cpu_used;
+        if (remaining <= 0)
+        {
+            passed = CAPTURE_CPU_TIMEOUT;
+        }
+        else if (*wait_ms < 0 || remaining < *wait_ms)
+        {
+            *wait_ms = remaining;
+        }
+    }
+
+    // The group is killed for the processes the blackbox started, the process itself in case it left the group
+    if (passed)
+    {
+        kill(-process->pid, SIGKILL);
+        kill(process->pid, SIGKILL);
+    }
+    return passed;
+}
+
+// Calls consume whenever the pipe is readable, until end of file or until the process exited and the pipe is empty. Then reaps the
+// process. Kills it when it passes one of the limits, if limits are given. Returns 0 on success, -1 if consume failed
+static int watch_blackbox(struct blackbox_process *process, const struct capture_limits *limits, int *status, int *timed_out,
+                          pipe_consumer consume, void *context)
+{
+    struct pollfd polls[2] = {{process->output_fd, POLLIN, 0}, {process->pidfd, POLLIN, 0}};
+    int exited = 0, wait_ms = 1, result = 0;
+    struct limit_watch watch;
+
+    *status = 0;
+    *timed_out = 0;
+    limit_watch_start(&watch, process, limits);
+
+    while (1)
+    {
+        // Limits are checked until one is passed, and the next wait ends before a limit could be passed. With a pidfd, nothing else
+        // limits the wait
+        int timeout_ms = process->pidfd != -1 ? -1 : wait_ms;
+        if (!exited && !*timed_out)
+        {
+            *timed_out = limit_watch_check(&watch, process, &timeout_ms);
+        }
+
+        // After the exit, only the data that is already in the pipe is read
+        int watch_exit = !exited && process->pidfd != -1;
+        int ready = poll(polls, watch_exit ? 2 : 1, exited ? 0 : timeout_ms);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (watch_exit && polls[1].revents != 0)
+        {
+            pid_t pid = reap_blackbox(process, status, 0);
+            exited = pid == process->pid || (pid == -1 && errno != EINTR);
+            continue;
+        }
+
+        if (polls[0].revents == 0)
+        {
+            if (exited)
+            {
+                break;
+            }
+
+            if (process->pidfd == -1)
+            {
+                pid_t pid = reap_blackbox(process, status, WNOHANG);
+                if (pid == process->pid || (pid == -1 && errno == ECHILD))
+                {
+                    exited = 1;
+                }
+                wait_ms = wait_ms * 2 > MAX_EXIT_CHECK_MS ? MAX_EXIT_CHECK_MS : wait_ms * 2;
+            }
+            continue;
+        }
+
+        ssize_t consumed = consume(process->output_fd, context);
+        if (consumed == 0)
+        {
+            break;
+        }
+        if (consumed == -1 && errno != EINTR && errno != EAGAIN)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    // The pipe is closed or broken, waiting for the exit if it wasn't seen yet. A blackbox can close its output and keep running, so the
+    // limits are still checked and bound the waits. The error of consume is kept for the caller
+    int consume_errno = errno;
+    while (!exited)
+    {
+        int timeout_ms = process->pidfd != -1 ? -1 : wait_ms;
+        if (!*timed_out)
+        {
+            *timed_out = limit_watch_check(&watch, process, &timeout_ms);
+        }
+
+        int options = WNOHANG;
+        if (process->pidfd != -1)
+        {
+            struct pollfd exit_poll = {process->pidfd, POLLIN, 0};
+            int ready = poll(&exit_poll, 1, timeout_ms);
+            if (ready == 0 || (ready == -1 && errno == EINTR))
+            {
+                continue;
+            }
+            options = 0;
+        }
+
+        pid_t pid = reap_blackbox(process, status, options);
+        if (pid == process->pid || (pid == -1 && errno != EINTR))
+        {
+            exited = 1;
+        }
+        else if (pid == 0)
+        {
+            poll(NULL, 0, timeout_ms);
+            wait_ms = wait_ms * 2 > MAX_EXIT_CHECK_MS ? MAX_EXIT_CHECK_MS : wait_ms * 2;
+        }
+    }
+    errno = consume_errno;
+
+    return result;
+}
+
+// Reads into the buffer, which doubles up to room for limit bytes. Data after the limit is read and thrown away
+static ssize_t capture_consumer(int pipe_fd, void *data)
+{
+    static char discarded[DISCARD_BUFFER_SIZE]; // Only written, never read, so threads can share it
+    struct capture_context *context = data;
+    struct captured_output *output = context->output;
+    ssize_t read_size;
+
+    if (output->length + 1 == context->capacity && output->length < context->limit)
+    {
+        size_t new_capacity = context->capacity * 2 > context->limit + 1 ? context->limit + 1 : context->capacity * 2;
+        char *new_data = realloc(output->data, new_capacity);
+        if (new_data == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        output->data = new_data;
+        context->capacity = new_capacity;
+    }
+
+    if (output->length < context->limit)
+    {
+        read_size = read(pipe_fd, output->data + output->length, context->capacity - 1 - output->length);
+        if (read_size > 0)
+        {
+            output->length += read_size;
+        }
+        return read_size;
+    }
+
+    read_size = read(pipe_fd, discarded, sizeof(discarded));
+    if (read_size > 0 && !output->truncated)
+    {
+        output->truncated = 1;
+        fprintf(stderr, "[WARNING] Blackbox output is longer than %zu bytes, the rest is discarded.\n", context->limit);
+    }
+    return read_size;
+}
+
+// Writes the whole buffer, retrying partial writes
+static int write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// Fills the prefix first. Once more data arrives, writes the header and the prefix, then moves the rest of the output to the file
+static ssize_t stream_consumer(int pipe_fd, void *data)
+{
+    struct stream_context *context = data;
+    struct streamed_output *output = context->output;
+    char buffer[DISCARD_BUFFER_SIZE];
+
+    if (output->prefix_length < STREAM_PREFIX_SIZE)
+    {
+        ssize_t read_size = read(pipe_fd, output->prefix + output->prefix_length, STREAM_PREFIX_SIZE - output->prefix_length);
+        if (read_size > 0)
+        {
+            output->prefix_length += read_size;
+        }
+        return read_size;
+    }
+
+    if (!output->streamed)
+    {
+        output->start = lseek(context->fd, 0, SEEK_END);
+        if (output->start == -1 || write_all(context->fd, context->header, strlen(context->header)) == -1 ||
+            write_all(context->fd, output->prefix, output->prefix_length) == -1)
+        {
+            return -1;
+        }
+        output->streamed = 1;
+    }
+
+    if (!context->copy)
+    {
+        ssize_t moved = splice(pipe_fd, NULL, context->fd, NULL, SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved != -1 || errno != EINVAL)
+        {
+            return moved;
+        }
+        context->copy = 1;
+    }
+
+    ssize_t read_size = read(pipe_fd, buffer, sizeof(buffer));
+    if (read_size > 0 && write_all(context->fd, buffer, read_size) == -1)
+    {
+        return -1;
+    }
+    return read_size;
+}
+
+int capture_blackbox(struct blackbox_process *process, struct captured_output *output)
+{
+    return capture_blackbox_limited(process, NULL, output);
+}
+
+int capture_blackbox_limited(struct blackbox_process *process, const struct capture_limits *limits, struct captured_output *output)
+{
+    struct capture_context context;
+    long limit = option_int("BLACKBOX_OUTPUT_LIMIT", 16777216);
+
+    context.output = output;
+    context.limit = limit < 0 ? 0 : limit;
+    context.capacity = INITIAL_CAPACITY > context.limit + 1 ? context.limit + 1 : INITIAL_CAPACITY;
+
+    output->length = 0;
+    output->truncated = 0;
+    output->data = malloc(context.capacity);
+    if (output->data == NULL)
+    {
+        return -1;
+    }
+
+    // A read error only ends the output early, what was read is still returned
+    if (watch_blackbox(process, limits, &output->status, &output->timed_out, capture_consumer, &context) == -1 && errno == ENOMEM)
+    {
+        free(output->data);
+        output->data = NULL;
+        return -1;
+    }
+    output->data[output->length] = '\0';
+
+    return 0;
+}
+
+int stream_blackbox(struct blackbox_process *process, int fd, const char *header, struct streamed_output *output)
+{
+    struct stream_context context = {output, fd, header, 0};
+    int timed_out;
+
+    output->prefix_length = 0;
+    output->streamed = 0;
+    output->start = -1;
+
+    int result = watch_blackbox(process, NULL, &output->status, &timed_out, stream_consumer, &context);
+    output->prefix[output->prefix_length] = '\0';
+
+    return result;
+}
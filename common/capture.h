@@ -0,0 +1,87 @@
+/**
+ * @file    capture.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Reads the whole output of a blackbox process while it runs, and reaps it.
+ *
+ *  Waiting for the blackbox before reading its output blocks forever when the output doesn't fit in the pipe buffer, since the
+ *  blackbox can't exit before its output is read. The capture reads the pipe and watches for the exit of the process together, and
+ *  keeps the output in a buffer that doubles as it fills, so the cost stays linear in the size of the output.
+ *
+ *  Output longer than BLACKBOX_OUTPUT_LIMIT bytes (default 16777216) is read and discarded, so the blackbox can still finish.
+ *
+ *  capture_blackbox_limited() also enforces wall clock and CPU time limits. A blackbox that passes one is killed with its whole process
+ *  group (see launcher.h), and the output read until then is returned with timed_out set.
+ *
+ *  stream_blackbox() is for outputs that go to a file. It keeps only the first STREAM_PREFIX_SIZE bytes in memory; a longer output is
+ *  moved to the file with splice() as it arrives, after a header given by the caller. There is no limit on a streamed output.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "launcher.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define STREAM_PREFIX_SIZE 4096
+
+// Values of captured_output.timed_out
+#define CAPTURE_WALL_TIMEOUT 1
+#define CAPTURE_CPU_TIMEOUT 2
+
+// Time limits of one blackbox run, 0 for no limit
+struct capture_limits
+{
+    long wall_ms;
+    long cpu_ms;
+};
+
+// Time limits being enforced on a running blackbox
+struct limit_watch
+{
+    struct capture_limits limits;
+    long long started_at;   // Monotonic clock time when the watch started, in milliseconds
+    clockid_t cpu_clock;    // CPU clock of the process
+    int active;             // Set when there is a limit to enforce
+};
+
+struct captured_output
+{
+    char *data;     // Output of the process, NUL terminated. The caller frees it
+    size_t length;
+    int status;     // Exit status as returned by waitpid()
+    int truncated;  // Set when output after the limit was discarded
+    int timed_out;  // CAPTURE_WALL_TIMEOUT or CAPTURE_CPU_TIMEOUT when the process was killed for passing a limit, 0 otherwise
+};
+
+// Reads everything the process writes to its output_fd until it exits, then reaps it. Returns 0 on success, -1 on error.
+// The file descriptors of the process are left open
+int capture_blackbox(struct blackbox_process *process, struct captured_output *output);
+
+// Same as capture_blackbox(), killing the process group of the process when it passes one of the limits. limits may be NULL
+int capture_blackbox_limited(struct blackbox_process *process, const struct capture_limits *limits, struct captured_output *output);
+
+// Starts watching the limits of the process from now on. limits may be NULL
+void limit_watch_start(struct limit_watch *watch, const struct blackbox_process *process, const struct capture_limits *limits);
+
+// Kills the process group when the process has passed one of its limits and returns which one, 0 otherwise. Shortens wait_ms to the
+// time left before a limit could be passed, a negative wait_ms being no limit
+int limit_watch_check(const struct limit_watch *watch, const struct blackbox_process *process, int *wait_ms);
+
+struct streamed_output
+{
+    char prefix[STREAM_PREFIX_SIZE + 1];    // First bytes of the output, NUL terminated
+    size_t prefix_length;
+    int streamed;   // Set when the output was longer than the prefix, and header, prefix and the rest were written to the file
+    off_t start;    // Position in the file where the header was written
+    int status;     // Exit status as returned by waitpid()
+};
+
+// Reads the output of the process into the prefix, and moves it to fd after the header if it doesn't fit, then reaps the process.
+// fd must not be opened with O_APPEND, since splice() doesn't write to such files. Returns 0 on success, -1 on error
+int stream_blackbox(struct blackbox_process *process, int fd, const char *header, struct streamed_output *output);
+
+#endif /* CAPTURE_H */
@@ -0,0 +1,739 @@
+/**
+ * @file    executor.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Event loop running many blackboxes at once from a single thread.
+ *
+ *  Every execution has a slot, and the events of its operations carry the slot index and the operation in their user data. The
+ *  io_uring backend uses the system calls and the rings mapped from the io_uring file descriptor directly, so there is no library to
+ *  depend on. An execution has at most a write, a read, an exit wait and a cancel submitted at once, so the submission queue is sized
+ *  for 4 entries per slot.
+ *
+ *  One read per execution is submitted at a time, into the free space of its buffer. When the process exits while the read is still
+ *  waiting, which happens when a process it started holds the pipe open, the read is cancelled and what is already in the pipe is read
+ *  without waiting, like capture.c does. A slot is reused only after the completions of all of its operations arrived.
+ */
+
+#define _GNU_SOURCE
+
+#include "executor.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define INITIAL_CAPACITY 4096
+#define DISCARD_BUFFER_SIZE 65536
+#define OPERATIONS_PER_SLOT 4
+#define EPOLL_EVENTS 64
+#define MAX_EXIT_CHECK_MS 100
+
+// Operations of an execution, kept in the low bits of the user data of their events under the slot index
+enum operation
+{
+    OPERATION_WRITE = 1,
+    OPERATION_READ,
+    OPERATION_EXIT,
+    OPERATION_CANCEL
+};
+#define OPERATION_BITS 3
+
+struct execution
+{
+    struct blackbox_process process;
+    char *input;
+    struct captured_output output;
+    size_t capacity, limit;
+    struct limit_watch watch;
+    int reading;            // Set while a read is submitted, io_uring only
+    int discarding;         // Set when the last read went to the discard buffer
+    int output_ended, exited, finished;
+    int operations;         // Submitted operations whose completion didn't arrive yet, io_uring only
+    execution_done done;    // NULL while the slot is free
+    void *context;
+    struct execution *next_free;
+    struct execution *next_reaping;
+};
+
+// Submission and completion rings shared with the kernel
+struct ring
+{
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+};
+
+struct executor
+{
+    int use_ring;
+    struct ring ring;
+    int epoll_fd;
+    struct execution *executions;
+    struct execution *free_slots;
+    int capacity, running;
+    int watched;                // Running executions with time limits
+    struct execution *reaping;  // Executions without a pidfd whose output ended before their process exited
+    int reap_wait_ms;           // Next interval of checking them, growing while none of them exits
+    size_t output_limit;
+    int finished, released;     // Counted during one executor_wait() call
+};
+
+static char discarded[DISCARD_BUFFER_SIZE]; // Only written, never read, so executions and threads can share it
+
+static void ring_teardown(struct ring *ring)
+{
+    if (ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+    {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != MAP_FAILED)
+    {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    close(ring->fd);
+}
+
+// Creates the io_uring instance and maps its rings. Returns -1 when the kernel doesn't support io_uring or the features used here
+static int ring_setup(struct ring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd == -1)
+    {
+        return -1;
+    }
+
+    // Waits with a timeout need IORING_ENTER_EXT_ARG, added in Linux 5.11
+    ring->sq_map = ring->cq_map = ring->sqes = MAP_FAILED;
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        ring_teardown(ring);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        // Both rings are in one mapping then
+        ring->sq_map_size = ring->cq_map_size = ring->sq_map_size > ring->cq_map_size ? ring->sq_map_size : ring->cq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map != MAP_FAILED)
+    {
+        ring->cq_map = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_map
+                       : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    if (ring->cq_map != MAP_FAILED)
+    {
+        ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    }
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring_teardown(ring);
+        return -1;
+    }
+
+    ring->sq_head = (unsigned *)((char *)ring->sq_map + params.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_map + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_map + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_map + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_map + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_map + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_map + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_map + params.cq_off.cqes);
+
+    return 0;
+}
+
+// Number of entries queued and not submitted yet
+static unsigned ring_queued(struct ring *ring)
+{
+    return *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+// Queues a submission entry. The queue is only submitted by the next wait, unless it is full
+static int ring_push(struct ring *ring, const struct io_uring_sqe *entry)
+{
+    unsigned tail = *ring->sq_tail;
+
+    if (ring_queued(ring) == ring->entries && syscall(__NR_io_uring_enter, ring->fd, ring->entries, 0, 0, NULL, 0) == -1)
+    {
+        return -1;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    ring->sqes[index] = *entry;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+// Queues an operation of the execution
+static int submit_operation(struct executor *executor, struct execution *execution, enum operation operation, struct io_uring_sqe *entry)
+{
+    entry->user_data = ((uint64_t)(execution - executor->executions) << OPERATION_BITS) | operation;
+    if (ring_push(&executor->ring, entry) == -1)
+    {
+        return -1;
+    }
+    execution->operations++;
+    return 0;
+}
+
+// Makes room in the buffer, which doubles up to room for limit bytes, and returns where the next read goes. Data after the limit goes
+// to the discard buffer
+static void read_target(struct execution *execution, char **buffer, size_t *length)
+{
+    struct captured_output *output = &execution->output;
+
+    if (output->length + 1 == execution->capacity && output->length < execution->limit)
+    {
+        size_t new_capacity = execution->capacity * 2 > execution->limit + 1 ? execution->limit + 1 : execution->capacity * 2;
+        char *new_data = realloc(output->data, new_capacity);
+        if (new_data == NULL)
+        {
+            // What was read is kept, the rest is discarded like after the limit
+            execution->limit = output->length;
+        }
+        else
+        {
+            output->data = new_data;
+            execution->capacity = new_capacity;
+        }
+    }
+
+    execution->discarding = output->length >= execution->limit;
+    if (execution->discarding)
+    {
+        *buffer = discarded;
+        *length = sizeof(discarded);
+    }
+    else
+    {
+        *buffer = output->data + output->length;
+        *length = execution->capacity - 1 - output->length;
+    }
+}
+
+// Accounts for the result of a read into the target given by read_target(), a byte count or a negative errno
+static void add_output(struct execution *execution, ssize_t size)
+{
+    if (size <= 0)
+    {
+        if (size != -EINTR && size != -EAGAIN)
+        {
+            execution->output_ended = 1;
+        }
+        return;
+    }
+
+    if (!execution->discarding)
+    {
+        execution->output.length += size;
+    }
+    else if (!execution->output.truncated)
+    {
+        execution->output.truncated = 1;
+        fprintf(stderr, "[WARNING] Blackbox output is longer than %zu bytes, the rest is discarded.\n", execution->limit);
+    }
+}
+
+static int submit_read(struct executor *executor, struct execution *execution)
+{
+    struct io_uring_sqe entry;
+    char *buffer;
+    size_t length;
+
+    read_target(execution, &buffer, &length);
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_READ;
+    entry.fd = execution->process.output_fd;
+    entry.addr = (uintptr_t)buffer;
+    entry.len = length;
+    entry.off = (uint64_t)-1; // Pipes have no position, -1 reads from the current one
+    if (submit_operation(executor, execution, OPERATION_READ, &entry) == -1)
+    {
+        return -1;
+    }
+    execution->reading = 1;
+    return 0;
+}
+
+// Reads what is ready in the pipe once, without waiting in epoll mode where the pipe is non blocking
+static void read_once(struct execution *execution)
+{
+    char *buffer;
+    size_t length;
+
+    read_target(execution, &buffer, &length);
+    ssize_t size = read(execution->process.output_fd, buffer, length);
+    add_output(execution, size == -1 ? -errno : size);
+}
+
+// Reads what is left in the pipe after the process exited, without waiting for more
+static void drain_output(struct execution *execution)
+{
+    struct pollfd pipe_poll = {execution->process.output_fd, POLLIN, 0};
+
+    while (!execution->output_ended && poll(&pipe_poll, 1, 0) == 1)
+    {
+        read_once(execution);
+    }
+}
+
+// Reaps the process once its pidfd is readable, so it already exited
+static void reap(struct execution *execution)
+{
+    while (reap_blackbox(&execution->process, &execution->output.status, 0) == -1 && errno == EINTR)
+    {
+    }
+    execution->exited = 1;
+}
+
+// Reaps a process without a pidfd after its output ended. A process can close its output and keep running, so it isn't waited for,
+// it is checked again by executor_wait() at growing intervals until it exits or is killed by its limits
+static void reap_or_watch(struct executor *executor, struct execution *execution)
+{
+    pid_t pid = reap_blackbox(&execution->process, &execution->output.status, WNOHANG);
+
+    if (pid == execution->process.pid || (pid == -1 && errno != EINTR))
+    {
+        execution->exited = 1;
+        return;
+    }
+    execution->next_reaping = executor->reaping;
+    executor->reaping = execution;
+    executor->reap_wait_ms = 1;
+}
+
+// Frees the slot once the execution finished and no operation of it is left in the kernel
+static void release_if_idle(struct executor *executor, struct execution *execution)
+{
+    if (!execution->finished || execution->operations > 0)
+    {
+        return;
+    }
+
+    if (!executor->use_ring)
+    {
+        epoll_ctl(executor->epoll_fd, EPOLL_CTL_DEL, execution->process.output_fd, NULL);
+    }
+    // The pidfd was closed when the process was reaped
+    close(execution->process.input_fd);
+    close(execution->process.output_fd);
+    if (execution->watch.active)
+    {
+        executor->watched--;
+    }
+    free(execution->input);
+
+    execution->done = NULL;
+    execution->next_free = executor->free_slots;
+    executor->free_slots = execution;
+    executor->running--;
+    executor->released++;
+}
+
+// Hands the output to the callback. The slot is freed when its last operation completes
+static void finish(struct executor *executor, struct execution *execution)
+{
+    if (execution->finished)
+    {
+        return;
+    }
+    execution->finished = 1;
+    execution->output.data[execution->output.length] = '\0';
+    executor->finished++;
+
+    execution->done(&execution->output, execution->context);
+    execution->output.data = NULL;
+}
+
+static void ring_complete(struct executor *executor, uint64_t user_data, int result)
+{
+    struct execution *execution = &executor->executions[user_data >> OPERATION_BITS];
+    struct io_uring_sqe entry;
+
+    execution->operations--;
+    switch (user_data & ((1 << OPERATION_BITS) - 1))
+    {
+    case OPERATION_READ:
+        execution->reading = 0;
+        if (result != -ECANCELED)
+        {
+            add_output(execution, result);
+        }
+        if (execution->output_ended && !execution->exited && execution->process.pidfd == -1)
+        {
+            reap_or_watch(executor, execution);
+        }
+
+        if (execution->exited)
+        {
+            drain_output(execution);
+            finish(executor, execution);
+        }
+        else if (!execution->output_ended && submit_read(executor, execution) == -1)
+        {
+            execution->output_ended = 1;
+        }
+        break;
+
+    case OPERATION_EXIT:
+        reap(execution);
+        if (execution->reading)
+        {
+            // The read finishes the execution when it comes back, cancelled or with data
+            memset(&entry, 0, sizeof(entry));
+            entry.opcode = IORING_OP_ASYNC_CANCEL;
+            entry.addr = ((uint64_t)(execution - executor->executions) << OPERATION_BITS) | OPERATION_READ;
+            submit_operation(executor, execution, OPERATION_CANCEL, &entry);
+        }
+        else
+        {
+            drain_output(execution);
+            finish(executor, execution);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    release_if_idle(executor, execution);
+}
+
+// Submits the queued entries and waits up to timeout_ms for a completion, -1 for no limit. Handles every completion that arrived
+static int ring_wait(struct executor *executor, int timeout_ms)
+{
+    struct ring *ring = &executor->ring;
+    struct __kernel_timespec timeout = {timeout_ms / 1000, timeout_ms % 1000 * 1000000LL};
+    struct io_uring_getevents_arg argument;
+
+    memset(&argument, 0, sizeof(argument));
+    argument.ts = timeout_ms >= 0 ? (uint64_t)(uintptr_t)&timeout : 0;
+    if (syscall(__NR_io_uring_enter, ring->fd, ring_queued(ring), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument,
+                sizeof(argument)) == -1 &&
+        errno != ETIME && errno != EINTR && errno != EBUSY)
+    {
+        return -1;
+    }
+
+    // The completion is released before it is handled, since handling it can queue and submit more entries
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe *completion = &ring->cqes[head & *ring->cq_mask];
+        uint64_t user_data = completion->user_data;
+        int result = completion->res;
+
+        __atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+        ring_complete(executor, user_data, result);
+    }
+
+    return 0;
+}
+
+static void epoll_complete(struct executor *executor, uint64_t user_data)
+{
+    struct execution *execution = &executor->executions[user_data >> OPERATION_BITS];
+
+    // An event fetched together with the one that finished the execution
+    if (execution->done == NULL || execution->finished)
+    {
+        return;
+    }
+
+    if ((user_data & ((1 << OPERATION_BITS) - 1)) == OPERATION_READ)
+    {
+        read_once(execution);
+        if (!execution->output_ended)
+        {
+            return;
+        }
+        epoll_ctl(executor->epoll_fd, EPOLL_CTL_DEL, execution->process.output_fd, NULL);
+        if (execution->process.pidfd == -1)
+        {
+            reap_or_watch(executor, execution);
+        }
+    }
+    else
+    {
+        // Removed before the pidfd is closed by the reap, its number could be reused by the next execution
+        epoll_ctl(executor->epoll_fd, EPOLL_CTL_DEL, execution->process.pidfd, NULL);
+        reap(execution);
+        drain_output(execution);
+    }
+
+    if (execution->exited)
+    {
+        finish(executor, execution);
+        release_if_idle(executor, execution);
+    }
+}
+
+// Waits up to timeout_ms for a readable pipe or pidfd, -1 for no limit, and handles the ready ones
+static int epoll_wait_events(struct executor *executor, int timeout_ms)
+{
+    struct epoll_event events[EPOLL_EVENTS];
+
+    int count = epoll_wait(executor->epoll_fd, events, EPOLL_EVENTS, timeout_ms);
+    if (count == -1)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        epoll_complete(executor, events[i].data.u64);
+    }
+
+    return 0;
+}
+
+struct executor *executor_create(int capacity)
+{
+    struct executor *executor = (struct executor *)calloc(1, sizeof(struct executor));
+    long limit = option_int("BLACKBOX_OUTPUT_LIMIT", 16777216);
+
+    if (executor == NULL || capacity < 1)
+    {
+        free(executor);
+        return NULL;
+    }
+    executor->executions = (struct execution *)calloc(capacity, sizeof(struct execution));
+    if (executor->executions == NULL)
+    {
+        free(executor);
+        return NULL;
+    }
+    executor->capacity = capacity;
+    executor->output_limit = limit < 0 ? 0 : limit;
+    for (int i = capacity - 1; i >= 0; i--)
+    {
+        executor->executions[i].next_free = executor->free_slots;
+        executor->free_slots = &executor->executions[i];
+    }
+
+    // io_uring is used when it is asked for and the kernel supports it, epoll otherwise
+    executor->epoll_fd = -1;
+    if (strcmp(option_string("BLACKBOX_EVENT_LOOP", "io_uring"), "io_uring") == 0 &&
+        ring_setup(&executor->ring, capacity * OPERATIONS_PER_SLOT) == 0)
+    {
+        executor->use_ring = 1;
+        return executor;
+    }
+
+    executor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (executor->epoll_fd == -1)
+    {
+        free(executor->executions);
+        free(executor);
+        return NULL;
+    }
+    return executor;
+}
+
+const char *executor_backend(const struct executor *executor)
+{
+    return executor->use_ring ? "io_uring" : "epoll";
+}
+
+int executor_running(const struct executor *executor)
+{
+    return executor->running;
+}
+
+int executor_submit(struct executor *executor, struct blackbox_process *process, const char *input, const struct capture_limits *limits,
+                    execution_done done, void *context)
+{
+    struct execution *execution = executor->free_slots;
+    struct io_uring_sqe entry;
+
+    if (execution == NULL)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    struct execution *next_free = execution->next_free;
+    memset(execution, 0, sizeof(struct execution));
+    execution->next_free = next_free;
+    execution->process = *process;
+    execution->input = strdup(input);
+    execution->capacity = INITIAL_CAPACITY > executor->output_limit + 1 ? executor->output_limit + 1 : INITIAL_CAPACITY;
+    execution->limit = executor->output_limit;
+    execution->output.data = malloc(execution->capacity);
+    if (execution->input == NULL || execution->output.data == NULL)
+    {
+        free(execution->input);
+        free(execution->output.data);
+        errno = ENOMEM;
+        return -1;
+    }
+    limit_watch_start(&execution->watch, process, limits);
+    execution->done = done;
+    execution->context = context;
+    executor->free_slots = next_free;
+    executor->running++;
+    if (execution->watch.active)
+    {
+        executor->watched++;
+    }
+
+    uint64_t slot = (uint64_t)(execution - executor->executions) << OPERATION_BITS;
+    if (executor->use_ring)
+    {
+        // The write, the exit wait and the first read go to the kernel with the next wait, together with the entries of the others
+        memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_WRITE;
+        entry.fd = process->input_fd;
+        entry.addr = (uintptr_t)execution->input;
+        entry.len = strlen(execution->input);
+        entry.off = (uint64_t)-1;
+        submit_operation(executor, execution, OPERATION_WRITE, &entry);
+
+        if (execution->process.pidfd != -1)
+        {
+            memset(&entry, 0, sizeof(entry));
+            entry.opcode = IORING_OP_POLL_ADD;
+            entry.fd = execution->process.pidfd;
+            entry.poll32_events = POLLIN;
+            submit_operation(executor, execution, OPERATION_EXIT, &entry);
+        }
+
+        if (submit_read(executor, execution) == -1)
+        {
+            execution->output_ended = 1;
+        }
+        return 0;
+    }
+
+    // The input is a line, the empty pipe takes it without blocking. The output is read without blocking, so an event that is out
+    // of date can't stop the loop
+    write(process->input_fd, execution->input, strlen(execution->input));
+    fcntl(process->output_fd, F_SETFL, fcntl(process->output_fd, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event event = {EPOLLIN, {.u64 = slot | OPERATION_READ}};
+    epoll_ctl(executor->epoll_fd, EPOLL_CTL_ADD, process->output_fd, &event);
+    if (execution->process.pidfd != -1)
+    {
+        event.data.u64 = slot | OPERATION_EXIT;
+        epoll_ctl(executor->epoll_fd, EPOLL_CTL_ADD, execution->process.pidfd, &event);
+    }
+    return 0;
+}
+
+// Checks the processes whose output ended before they exited, and finishes the executions of the ones that exited
+static void reap_watched(struct executor *executor)
+{
+    struct execution **link = &executor->reaping;
+
+    while (*link != NULL)
+    {
+        struct execution *execution = *link;
+        pid_t pid = reap_blackbox(&execution->process, &execution->output.status, WNOHANG);
+        if (pid == 0 || (pid == -1 && errno == EINTR))
+        {
+            link = &execution->next_reaping;
+            continue;
+        }
+
+        execution->exited = 1;
+        *link = execution->next_reaping;
+        finish(executor, execution);
+        release_if_idle(executor, execution);
+    }
+    executor->reap_wait_ms = executor->reap_wait_ms * 2 > MAX_EXIT_CHECK_MS ? MAX_EXIT_CHECK_MS : executor->reap_wait_ms * 2;
+}
+
+int executor_wait(struct executor *executor)
+{
+    if (executor->running == 0)
+    {
+        return 0;
+    }
+
+    executor->finished = 0;
+    executor->released = 0;
+    while (executor->finished == 0 && executor->released == 0)
+    {
+        // Limits are checked until the process exits or passes one, and the wait ends before the next limit could be passed
+        int timeout_ms = executor->reaping != NULL ? executor->reap_wait_ms : -1;
+        for (int i = 0; executor->watched > 0 && i < executor->capacity; i++)
+        {
+            struct execution *execution = &executor->executions[i];
+            if (execution->done != NULL && !execution->exited && !execution->output.timed_out)
+            {
+                execution->output.timed_out = limit_watch_check(&execution->watch, &execution->process, &timeout_ms);
+            }
+        }
+        if ((executor->use_ring ? ring_wait(executor, timeout_ms) : epoll_wait_events(executor, timeout_ms)) == -1)
+        {
+            return -1;
+        }
+        reap_watched(executor);
+    }
+
+    return executor->finished;
+}
+
+void executor_destroy(struct executor *executor)
+{
+    if (executor->use_ring)
+    {
+        ring_teardown(&executor->ring);
+    }
+    else
+    {
+        close(executor->epoll_fd);
+    }
+
+    for (int i = 0; i < executor->capacity; i++)
+    {
+        struct execution *execution = &executor->executions[i];
+        if (execution->done != NULL)
+        {
+            close(execution->process.input_fd);
+            close(execution->process.output_fd);
+            if (execution->process.pidfd != -1)
+            {
+                close(execution->process.pidfd);
+            }
+            free(execution->input);
+            free(execution->output.data);
+        }
+    }
+
+    free(executor->executions);
+    free(executor);
+}
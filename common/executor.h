@@ -0,0 +1,52 @@
+/**
+ * @file    executor.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Event loop running many blackboxes at once from a single thread.
+ *
+ *  capture_blackbox() keeps a thread busy for every running blackbox. The executor watches the pipes and the exits of all of its
+ *  blackboxes together instead. With io_uring, the input writes, the output reads and the waits for the exits of every blackbox are
+ *  queued as submission entries, and one io_uring_enter() call submits all of them and waits for the next completions. Exits are
+ *  watched through a pidfd of every blackbox, so each execution finishes on the exit of its own process.
+ *
+ *  On kernels without io_uring, or without the features used here, the same loop runs on epoll, which watches the output pipes and
+ *  the pidfds. Without pidfds, a blackbox whose output is closed is checked for its exit at growing intervals, so one that keeps
+ *  running doesn't hold up the loop.
+ *
+ *  Outputs are read like in capture.h, limited to BLACKBOX_OUTPUT_LIMIT bytes, and an execution can have wall clock and CPU time limits.
+ *
+ *  The backend is selected with the environment variable BLACKBOX_EVENT_LOOP, which is "io_uring" (default) or "epoll".
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "capture.h"
+
+struct executor;
+
+// Called once an execution finished. The callback takes the output, and frees output->data
+typedef void (*execution_done)(struct captured_output *output, void *context);
+
+// Creates an executor running up to capacity blackboxes at once. Returns NULL on error
+struct executor *executor_create(int capacity);
+
+// Name of the backend the executor runs on, "io_uring" or "epoll"
+const char *executor_backend(const struct executor *executor);
+
+// Number of executions that still hold one of the capacity slots
+int executor_running(const struct executor *executor);
+
+// Writes input to the process and watches it until it exits, then calls done. The executor closes the file descriptors of the process
+// and reaps it. limits may be NULL. Returns 0 on success, -1 when all slots are in use or on error
+int executor_submit(struct executor *executor, struct blackbox_process *process, const char *input, const struct capture_limits *limits,
+                    execution_done done, void *context);
+
+// Waits until an execution finishes or frees its slot, and calls the callbacks of the finished ones. Returns the count of finished
+// executions, or -1 on error. Returns 0 right away when nothing is running
+int executor_wait(struct executor *executor);
+
+// Frees the executor. Executions still running are left to run, without their callbacks
+void executor_destroy(struct executor *executor);
+
+#endif /* EXECUTOR_H */
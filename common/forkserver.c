@@ -0,0 +1,484 @@
+/**
+ * @file    forkserver.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Launcher side of the fork servers, see forkserver.h.
+ *
+ *  Every fork server has an entry with the identity of the executable file it was started from. A file that changed gets a new fork
+ *  server, and the old one is retired: it is closed once the last of its blackboxes is reaped. An executable that couldn't be served
+ *  keeps an entry without a fork server, so it isn't tried again until it changes.
+ *
+ *  Requests of a fork server are sent one at a time, so its answer belongs to the last request. Any thread may read the socket, but only
+ *  one at a time: the messages it reads are stored in the entry and the other threads waiting for a message are woken up to look for
+ *  theirs. The exit of a blackbox is reported after its start, on the same socket.
+ */
+
+#define _GNU_SOURCE
+
+#include "forkserver.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+struct forkserver_exit
+{
+    pid_t pid;
+    int status;
+};
+
+struct forkserver
+{
+    char *path;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    pid_t pid; // -1 when the executable can't be served
+    int socket_fd;
+    int running; // Blackboxes that weren't reaped yet, protected by servers_lock like retired
+    int retired;
+
+    pthread_mutex_t request_lock; // Held from a request until its answer
+    pthread_mutex_t lock;         // Protects the fields below
+    pthread_cond_t received;
+    int reading;
+    int broken;
+    int answered;
+    pid_t started_pid;
+    int started_error;
+    struct forkserver_exit *exits;
+    size_t exit_count;
+    size_t exit_capacity;
+
+    struct forkserver *next;
+};
+
+static pthread_mutex_t servers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct forkserver *servers;
+
+static int entry_is_current(const struct forkserver *server, const struct stat *file_status)
+{
+    return server->device == file_status->st_dev && server->inode == file_status->st_ino && server->size == file_status->st_size &&
+           server->modified.tv_sec == file_status->st_mtim.tv_sec && server->modified.tv_nsec == file_status->st_mtim.tv_nsec;
+}
+
+static pthread_once_t environment_once = PTHREAD_ONCE_INIT;
+static char **environment; // Environment of the fork servers, with the shim in front of LD_PRELOAD. NULL when the shim can't be found
+
+static void build_environment(void)
+{
+    char shim[PATH_MAX];
+    const char *path = option_string("BLACKBOX_FORKSERVER_SHIM", "blackbox_forkserver.so");
+    const char *preload = getenv("LD_PRELOAD");
+    size_t count = 0, length;
+
+    // LD_PRELOAD searches the library directories for a name without a slash
+    if (realpath(path, shim) == NULL)
+    {
+        fprintf(stderr, "[WARNING] Fork server shim %s couldn't be found, blackboxes are spawned instead.\n", path);
+        return;
+    }
+
+    while (environ[count] != NULL)
+    {
+        count++;
+    }
+    environment = (char **)calloc(count + 2, sizeof(char *));
+    length = strlen("LD_PRELOAD=") + strlen(shim) + (preload != NULL ? strlen(preload) + 1 : 0) + 1;
+    if (environment == NULL || (environment[0] = (char *)malloc(length)) == NULL)
+    {
+        free(environment);
+        environment = NULL;
+        return;
+    }
+
+    sprintf(environment[0], "LD_PRELOAD=%s%s%s", shim, preload != NULL ? ":" : "", preload != NULL ? preload : "");
+    for (size_t i = 0, next = 1; i < count; i++)
+    {
+        if (strncmp(environ[i], "LD_PRELOAD=", strlen("LD_PRELOAD=")) != 0)
+        {
+            environment[next++] = environ[i];
+        }
+    }
+}
+
+// Starts the fork server of the executable and waits for its hello. Returns 0 on success, -1 if it isn't ready in time
+static int start_server(struct forkserver *server)
+{
+    static long timeout_ms = -1;
+    posix_spawn_file_actions_t actions;
+    struct forkserver_message hello;
+    char *arguments[] = {server->path, NULL};
+    int sockets[2], error;
+
+    server->pid = -1;
+    pthread_once(&environment_once, build_environment);
+    if (timeout_ms == -1)
+    {
+        timeout_ms = option_int("BLACKBOX_FORKSERVER_TIMEOUT_MS", 2000);
+    }
+    if (environment == NULL || socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        return -1;
+    }
+    if ((error = posix_spawn_file_actions_init(&actions)) != 0)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+
+    // The blackboxes get their own standard descriptors, the fork server itself only needs the socket
+    if ((error = posix_spawn_file_actions_adddup2(&actions, sockets[1], FORKSERVER_FD)) != 0 ||
+        (error = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0)) != 0 ||
+        (error = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0)) != 0 ||
+        (error = posix_spawn(&server->pid, server->path, &actions, NULL, arguments, environment)) != 0)
+    {
+        server->pid = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(sockets[1]);
+    if (server->pid == -1)
+    {
+        close(sockets[0]);
+        return -1;
+    }
+
+    // A static executable never loads the shim, it runs once with an empty input and closes the socket when it exits
+    struct pollfd socket_poll = {sockets[0], POLLIN, 0};
+    if (poll(&socket_poll, 1, timeout_ms) != 1 || recv(sockets[0], &hello, sizeof(hello), 0) != sizeof(hello) ||
+        hello.kind != FORKSERVER_HELLO)
+    {
+        fprintf(stderr, "[WARNING] Couldn't start a fork server for %s, it is spawned instead.\n", server->path);
+        kill(server->pid, SIGKILL);
+        waitpid(server->pid, NULL, 0);
+        close(sockets[0]);
+        server->pid = -1;
+        return -1;
+    }
+
+    server->socket_fd = sockets[0];
+    return 0;
+}
+
+// Stops a fork server that has no blackboxes left
+static void destroy_server(struct forkserver *server)
+{
+    if (server->pid != -1)
+    {
+        // The fork server exits when its socket is closed
+        close(server->socket_fd);
+        waitpid(server->pid, NULL, 0);
+    }
+    pthread_mutex_destroy(&server->request_lock);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->received);
+    free(server->exits);
+    free(server->path);
+    free(server);
+}
+
+// Removes the entry from the list, it is destroyed once it has no blackboxes. Called with servers_lock held, returns 1 if the caller
+// should destroy it
+static int retire_server(struct forkserver *server)
+{
+    struct forkserver **link = &servers;
+
+    while (*link != server)
+    {
+        link = &(*link)->next;
+    }
+    *link = server->next;
+    server->retired = 1;
+    return server->running == 0;
+}
+
+// Returns the fork server of the executable with a blackbox counted as running, NULL when it can't be served
+static struct forkserver *acquire_server(const char *executable_path)
+{
+    struct forkserver *server, *retired = NULL;
+    struct stat file_status;
+
+    if (stat(executable_path, &file_status) == -1)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&servers_lock);
+    for (server = servers; server != NULL && strcmp(server->path, executable_path) != 0; server = server->next)
+    {
+    }
+
+    if (server != NULL && (!entry_is_current(server, &file_status) || server->broken))
+    {
+        if (retire_server(server))
+        {
+            retired = server;
+        }
+        server = NULL;
+    }
+
+    // Started with the lock held, so a new version of an executable gets a single fork server
+    if (server == NULL && (server = (struct forkserver *)calloc(1, sizeof(struct forkserver))) != NULL)
+    {
+        if ((server->path = strdup(executable_path)) == NULL)
+        {
+            free(server);
+            server = NULL;
+        }
+        else
+        {
+            server->device = file_status.st_dev;
+            server->inode = file_status.st_ino;
+            server->size = file_status.st_size;
+            server->modified = file_status.st_mtim;
+            pthread_mutex_init(&server->request_lock, NULL);
+            pthread_mutex_init(&server->lock, NULL);
+            pthread_cond_init(&server->received, NULL);
+            start_server(server);
+            server->next = servers;
+            servers = server;
+        }
+    }
+
+    if (server != NULL && server->pid == -1)
+    {
+        server = NULL;
+    }
+    if (server != NULL)
+    {
+        server->running++;
+    }
+    pthread_mutex_unlock(&servers_lock);
+
+    if (retired != NULL)
+    {
+        destroy_server(retired);
+    }
+    return server;
+}
+
+// Ends the count of a blackbox of the fork server, and destroys a retired fork server after its last blackbox
+static void release_server(struct forkserver *server)
+{
+    pthread_mutex_lock(&servers_lock);
+    int destroy = --server->running == 0 && server->retired;
+    pthread_mutex_unlock(&servers_lock);
+
+    if (destroy)
+    {
+        destroy_server(server);
+    }
+}
+
+// Reads one message from the socket unless another thread is reading it, then waits for that thread's message instead. Called with
+// server->lock held. Returns 1 when a message was received, 0 when there wasn't one without waiting, -1 when the fork server is gone
+static int receive_message(struct forkserver *server, int wait)
+{
+    struct forkserver_message message;
+    ssize_t received;
+
+    if (server->broken)
+    {
+        return -1;
+    }
+    if (server->reading)
+    {
+        if (!wait)
+        {
+            return 0;
+        }
+        pthread_cond_wait(&server->received, &server->lock);
+        return 1;
+    }
+
+    server->reading = 1;
+    pthread_mutex_unlock(&server->lock);
+    while ((received = recv(server->socket_fd, &message, sizeof(message), wait ? 0 : MSG_DONTWAIT)) == -1 && errno == EINTR)
+    {
+    }
+    int error = errno;
+    pthread_mutex_lock(&server->lock);
+    server->reading = 0;
+    pthread_cond_broadcast(&server->received);
+
+    if (received == -1 && (error == EAGAIN || error == EWOULDBLOCK))
+    {
+        return 0;
+    }
+    if (received != sizeof(message))
+    {
+        server->broken = 1;
+        return -1;
+    }
+
+    if (message.kind == FORKSERVER_STARTED)
+    {
+        server->answered = 1;
+        server->started_pid = message.pid;
+        server->started_error = message.status;
+    }
+    else if (message.kind == FORKSERVER_EXITED)
+    {
+        if (server->exit_count == server->exit_capacity)
+        {
+            size_t capacity = server->exit_capacity == 0 ? 16 : server->exit_capacity * 2;
+            struct forkserver_exit *exits = (struct forkserver_exit *)realloc(server->exits, capacity * sizeof(struct forkserver_exit));
+            if (exits == NULL)
+            {
+                // The status is lost, the reap of that blackbox fails like the fork server was gone
+                server->broken = 1;
+                return -1;
+            }
+            server->exits = exits;
+            server->exit_capacity = capacity;
+        }
+        server->exits[server->exit_count].pid = message.pid;
+        server->exits[server->exit_count].status = message.status;
+        server->exit_count++;
+    }
+    return 1;
+}
+
+// Sends a request with the descriptors the blackbox gets. Returns 0 on success, -1 on error
+static int send_request(struct forkserver *server, const struct forkserver_request *request, int fds[2])
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec vector = {(void *)request, sizeof(struct forkserver_request)};
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    memcpy(CMSG_DATA(header), fds, 2 * sizeof(int));
+
+    ssize_t sent;
+    while ((sent = sendmsg(server->socket_fd, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    return sent == sizeof(struct forkserver_request) ? 0 : -1;
+}
+
+pid_t forkserver_child(const char *executable_path, int message2child[2], int message2parent[2], const struct forkserver_request *limits,
+                       struct forkserver **server_pointer)
+{
+    int fds[2] = {message2child[0], message2parent[1]};
+    pid_t pid = -1;
+
+    struct forkserver *server = acquire_server(executable_path);
+    if (server == NULL)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&server->request_lock);
+    pthread_mutex_lock(&server->lock);
+    server->answered = 0;
+    pthread_mutex_unlock(&server->lock);
+
+    int sent = send_request(server, limits, fds) == 0;
+
+    pthread_mutex_lock(&server->lock);
+    if (!sent)
+    {
+        server->broken = 1;
+    }
+    while (sent && !server->answered && receive_message(server, 1) != -1)
+    {
+    }
+    if (server->answered)
+    {
+        pid = server->started_pid;
+        errno = server->started_error;
+    }
+    pthread_mutex_unlock(&server->lock);
+    pthread_mutex_unlock(&server->request_lock);
+
+    if (pid == -1)
+    {
+        // The blackbox is spawned instead, a broken fork server is replaced on the next launch
+        release_server(server);
+        return -1;
+    }
+
+    *server_pointer = server;
+    return pid;
+}
+
+pid_t forkserver_reap(struct blackbox_process *process, int *status, int options)
+{
+    struct forkserver *server = process->forkserver;
+    int ignored, result = 0;
+
+    if (status == NULL)
+    {
+        status = &ignored;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    while (1)
+    {
+        size_t i = 0;
+        while (i < server->exit_count && server->exits[i].pid != process->pid)
+        {
+            i++;
+        }
+        if (i < server->exit_count)
+        {
+            *status = server->exits[i].status;
+            server->exits[i] = server->exits[--server->exit_count];
+            result = 1;
+            break;
+        }
+
+        // A status that was never sent can't be received later either
+        if ((result = receive_message(server, !(options & WNOHANG))) != 1)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    if (result == 0)
+    {
+        return 0; // Still running, only with WNOHANG
+    }
+
+    if (process->pidfd != -1)
+    {
+        close(process->pidfd);
+        process->pidfd = -1;
+    }
+    process->forkserver = NULL;
+    release_server(server);
+
+    if (result == -1)
+    {
+        errno = ECHILD;
+        return -1;
+    }
+    return process->pid;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file    forkserver.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Fork server launch method, which forks blackboxes from an already loaded and initialized copy of their executable.
+ *
+ *  Even posix_spawn() pays for the exec, the dynamic loader and the initialization of libc on every run. With BLACKBOX_LAUNCHER=
+ *  forkserver, every executable is started once with the shim of forkserver_shim.c in LD_PRELOAD and a control socket on
+ *  FORKSERVER_FD, in the style of AFL. The constructor of the shim runs after libc is initialized and before main(), and turns that
+ *  process into the fork server of the executable: for every request it receives the STDIN and output pipes of a new blackbox over
+ *  the socket, forks, and the child continues into main() with the pipes as its standard file descriptors. The blackbox executables
+ *  don't need any change, only dynamically linked ones can be served.
+ *
+ *  The fork server is the parent of the blackboxes, so it reaps them and sends their exit statuses back; reap_blackbox() takes them
+ *  from the socket. Blackboxes still get a pidfd to be polled for their exit, their own process group and their resource limits.
+ *
+ *  A fork server is started for every version of an executable file. An executable whose fork server can't be started, like a static
+ *  one, is launched with posix_spawn() instead. Options are read from environment variables:
+ *      BLACKBOX_FORKSERVER_SHIM        Path of the shim library built from forkserver_shim.c (default blackbox_forkserver.so)
+ *      BLACKBOX_FORKSERVER_TIMEOUT_MS  Time a new fork server has to report that it is ready (default 2000)
+ */
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include "launcher.h"
+
+#include <stdint.h>
+
+// Control socket of a fork server, chosen like AFL's so it doesn't collide with the descriptors of the blackbox
+#define FORKSERVER_FD 198
+
+enum forkserver_message_kind
+{
+    FORKSERVER_HELLO,   // The fork server is ready, pid is the fork server
+    FORKSERVER_STARTED, // Answer to a request, pid is the new blackbox or -1 with the errno in status
+    FORKSERVER_EXITED   // A blackbox exited, status is as returned by waitpid()
+};
+
+// Messages from the fork server to the launcher
+struct forkserver_message
+{
+    int32_t kind;
+    int32_t pid;
+    int32_t status;
+};
+
+// Request for a new blackbox, sent with its STDIN and output descriptors. Limits are 0 when there isn't one
+struct forkserver_request
+{
+    uint64_t address_space;
+    uint64_t open_files;
+};
+
+struct forkserver;
+
+// Starts the executable through its fork server with the child ends of the pipes as its standard file descriptors, starting the fork
+// server if it isn't running. Returns the pid of the blackbox and sets server, or -1 when the executable can't be served by a fork
+// server. The caller still owns all pipe ends
+pid_t forkserver_child(const char *executable_path, int message2child[2], int message2parent[2], const struct forkserver_request *limits,
+                       struct forkserver **server);
+
+// reap_blackbox() for a blackbox of a fork server, also closes its pidfd
+pid_t forkserver_reap(struct blackbox_process *process, int *status, int options);
+
+#endif /* FORKSERVER_H */
@@ -0,0 +1,179 @@
+/**
+ * @file    forkserver_shim.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   LD_PRELOAD shim that turns a blackbox process into its fork server, see forkserver.h.
+ *
+ *  The constructor runs after the dynamic loader and libc are initialized and before main(). It sends a hello message on
+ *  FORKSERVER_FD; when that fails the process wasn't started by a launcher, and the blackbox simply runs. Otherwise the process
+ *  serves requests until the launcher closes the socket. SIGCHLD is blocked and read from a signalfd, so exits are reported from
+ *  the same loop that answers the requests.
+ *
+ *  glibc's stdio reads STDIN through internal calls that LD_PRELOAD can't interpose, so the fork server can't wait for the first
+ *  read() of the blackbox. Stopping before main() keeps most of the saving, as the exec, loading and libc initialization are done.
+ *
+ *  How to build:
+ *  > gcc -shared -fPIC -O2 -I../common ../common/forkserver_shim.c -o blackbox_forkserver.so
+ */
+
+#define _GNU_SOURCE
+
+#include "forkserver.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void send_message(int kind, pid_t pid, int status)
+{
+    struct forkserver_message message = {kind, pid, status};
+    send(FORKSERVER_FD, &message, sizeof(message), MSG_NOSIGNAL);
+}
+
+// Receives a request with its two descriptors. Returns 0 on success, -1 when the launcher closed the socket
+static int receive_request(struct forkserver_request *request, int fds[2])
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec vector = {request, sizeof(struct forkserver_request)};
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    while ((received = recvmsg(FORKSERVER_FD, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+    {
+    }
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (received != sizeof(struct forkserver_request) || header == NULL || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+    {
+        return -1;
+    }
+
+    memcpy(fds, CMSG_DATA(header), 2 * sizeof(int));
+    return 0;
+}
+
+// Sets up a forked child as a blackbox with the pipes of its request
+static void become_blackbox(const struct forkserver_request *request, int fds[2], int signal_fd, const sigset_t *old_mask)
+{
+    struct rlimit limit;
+
+    close(signal_fd);
+    close(FORKSERVER_FD);
+    sigprocmask(SIG_SETMASK, old_mask, NULL);
+    setpgid(0, 0);
+
+    if (request->address_space > 0)
+    {
+        limit.rlim_cur = limit.rlim_max = request->address_space;
+        setrlimit(RLIMIT_AS, &limit);
+    }
+    if (request->open_files > 0)
+    {
+        limit.rlim_cur = limit.rlim_max = request->open_files;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // dup2 clears close-on-exec for the standard descriptors
+    if (dup2(fds[0], STDIN_FILENO) == -1 || dup2(fds[1], STDOUT_FILENO) == -1 || dup2(fds[1], STDERR_FILENO) == -1)
+    {
+        _exit(-1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Serves requests until the launcher goes away, only returns in the forked blackboxes
+static void serve(void)
+{
+    struct forkserver_request request;
+    struct signalfd_siginfo signal_info;
+    sigset_t mask, old_mask;
+    int fds[2], status;
+    pid_t pid;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signal_fd == -1)
+    {
+        _exit(-1);
+    }
+
+    struct pollfd watched[2] = {{FORKSERVER_FD, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+    while (1)
+    {
+        if (poll(watched, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            _exit(-1);
+        }
+
+        if (watched[1].revents & POLLIN)
+        {
+            // Signals of several exits may be merged into one, every exited child is reaped
+            read(signal_fd, &signal_info, sizeof(signal_info));
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                send_message(FORKSERVER_EXITED, pid, status);
+            }
+        }
+
+        if (watched[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            if (receive_request(&request, fds) == -1)
+            {
+                // The launcher is gone, running blackboxes go on without their fork server
+                _exit(0);
+            }
+
+            pid = fork();
+            if (pid == 0)
+            {
+                become_blackbox(&request, fds, signal_fd, &old_mask);
+                return;
+            }
+
+            // Also set here, so the group exists before the launcher gets the pid whichever process runs first
+            int error = errno;
+            if (pid > 0)
+            {
+                setpgid(pid, pid);
+            }
+            close(fds[0]);
+            close(fds[1]);
+            send_message(FORKSERVER_STARTED, pid, pid == -1 ? error : 0);
+        }
+    }
+}
+
+__attribute__((constructor)) static void forkserver_start(void)
+{
+    struct forkserver_message hello = {FORKSERVER_HELLO, getpid(), 0};
+
+    // Started without a launcher, the blackbox runs normally
+    if (send(FORKSERVER_FD, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello))
+    {
+        return;
+    }
+
+    // Processes the blackbox starts itself shouldn't load the shim
+    unsetenv("LD_PRELOAD");
+    serve();
+}
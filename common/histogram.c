@@ -0,0 +1,111 @@
+/**
+ * @file    histogram.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Latency histogram with a bounded relative error, in the style of HdrHistogram.
+ *
+ *  A value v of at least 2^7 with its highest bit at position 7 + s is in bucket (s + 1) * 128 + (v >> s) - 128, so the bucket keeps
+ *  the 7 bits after the highest one. Percentiles are reported as the middle of their bucket, clamped to the recorded minimum and
+ *  maximum.
+ */
+
+#include "histogram.h"
+
+#include <string.h>
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+static int bucket_of(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)(value >> shift) - SUB_BUCKETS;
+}
+
+// Middle of the range of values that fall into the bucket
+static uint64_t bucket_value(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t lowest = (uint64_t)((bucket & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+    return lowest + ((1ULL << shift) >> 1);
+}
+
+void histogram_init(struct histogram *histogram)
+{
+    memset(histogram, 0, sizeof(struct histogram));
+    histogram->min = UINT64_MAX;
+}
+
+void histogram_record(struct histogram *histogram, uint64_t value)
+{
+    histogram->counts[bucket_of(value)]++;
+    histogram->total++;
+    histogram->sum += value;
+    if (value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+void histogram_merge(struct histogram *histogram, const struct histogram *source)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        histogram->counts[i] += source->counts[i];
+    }
+    histogram->total += source->total;
+    histogram->sum += source->sum;
+    if (source->min < histogram->min)
+    {
+        histogram->min = source->min;
+    }
+    if (source->max > histogram->max)
+    {
+        histogram->max = source->max;
+    }
+}
+
+uint64_t histogram_percentile(const struct histogram *histogram, double percentile)
+{
+    if (histogram->total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, counted from 1, rounded up so that p100 is the largest value
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->total + 0.999999);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = bucket_value(i);
+            return value < histogram->min ? histogram->min : value > histogram->max ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
+
+double histogram_mean(const struct histogram *histogram)
+{
+    return histogram->total == 0 ? 0 : histogram->sum / histogram->total;
+}
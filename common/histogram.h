@@ -0,0 +1,40 @@
+/**
+ * @file    histogram.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Latency histogram with a bounded relative error, in the style of HdrHistogram.
+ *
+ *  Values below 128 have a bucket each. Above that, every power of 2 is split into 128 buckets of equal width, so a value is known to
+ *  within 1% whatever its size, from nanoseconds to hours, with a fixed array of counters. Recording is an index computation and an
+ *  increment, so every thread of a load generator can record into its own histogram and they are merged at the end.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min, max;
+    double sum;
+};
+
+void histogram_init(struct histogram *histogram);
+
+void histogram_record(struct histogram *histogram, uint64_t value);
+
+// Adds the counts of source to histogram
+void histogram_merge(struct histogram *histogram, const struct histogram *source);
+
+// Returns the value below which the given percentage of the recorded values are, 0 when nothing was recorded
+uint64_t histogram_percentile(const struct histogram *histogram, double percentile);
+
+double histogram_mean(const struct histogram *histogram);
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,301 @@
+/**
+ * @file    launcher.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Starts a blackbox in a child process with its STDIN, STDOUT and STDERR connected to pipes.
+ *
+ *  Pipes are created with close-on-exec, so only the duplicated standard file descriptors survive in the blackbox. This also keeps
+ *  blackboxes started at the same time by different threads from inheriting each other's pipes.
+ *
+ *  The pidfd of a blackbox is opened right after it is created, before anything can reap it, so it can't refer to another process
+ *  that got the same pid. pidfds are always close-on-exec.
+ *
+ *  Every blackbox is the leader of a new process group, so a blackbox that runs too long can be killed together with the processes
+ *  it started. Resource limits are set in the child before the exec, so nothing the blackbox maps or opens escapes them. posix_spawn()
+ *  can't set them, so a blackbox with limits is always started on the fork path.
+ */
+
+#define _GNU_SOURCE
+
+#include "launcher.h"
+#include "forkserver.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Closes both ends of the given pipes
+static void close_pipes(int message2child[2], int message2parent[2])
+{
+    close(message2child[0]);
+    close(message2child[1]);
+    close(message2parent[0]);
+    close(message2parent[1]);
+}
+
+// Resource limits of the blackboxes, RLIM_INFINITY when they aren't limited
+struct blackbox_limits
+{
+    rlim_t address_space;
+    rlim_t open_files;
+};
+
+static void read_limits(struct blackbox_limits *limits)
+{
+    long address_space = option_int("BLACKBOX_LIMIT_AS", 0);
+    long open_files = option_int("BLACKBOX_LIMIT_NOFILE", 0);
+
+    limits->address_space = address_space > 0 ? (rlim_t)address_space : RLIM_INFINITY;
+    limits->open_files = open_files > 0 ? (rlim_t)open_files : RLIM_INFINITY;
+}
+
+// Applies the limits to the calling process, which is the child before its exec
+static void apply_limits(const struct blackbox_limits *limits)
+{
+    struct rlimit limit;
+
+    if (limits->address_space != RLIM_INFINITY)
+    {
+        limit.rlim_cur = limit.rlim_max = limits->address_space;
+        setrlimit(RLIMIT_AS, &limit);
+    }
+    if (limits->open_files != RLIM_INFINITY)
+    {
+        limit.rlim_cur = limit.rlim_max = limits->open_files;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Creates the child process with fork() and execl(), the way the executors did before
+static pid_t fork_child(const char *executable_path, int message2child[2], int message2parent[2], const struct blackbox_limits *limits)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        apply_limits(limits);
+
+        // Redirecting STDIN, STDOUT and STDERR to the pipes, dup2 clears close-on-exec for the new descriptors
+        if (dup2(message2child[0], STDIN_FILENO) == -1 || dup2(message2parent[1], STDOUT_FILENO) == -1 || dup2(message2parent[1], STDERR_FILENO) == -1)
+        {
+            perror("[ERROR] There was an error binding pipes for standard file descriptors.");
+            _exit(-1);
+        }
+
+        execl(executable_path, executable_path, NULL);
+
+        // execl only returns on error, the message goes to the output pipe so it is returned as a FAIL result
+        perror("[ERROR] Couldn't execute the blackbox");
+        _exit(-1);
+    }
+
+    // Also set by the parent, so the group exists before this function returns whichever process runs first
+    if (pid > 0)
+    {
+        setpgid(pid, pid);
+    }
+
+    return pid;
+}
+
+// Creates the child process with posix_spawn(), the redirections are given as file actions
+static pid_t spawn_child(const char *executable_path, int message2child[2], int message2parent[2], const struct blackbox_limits *limits)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    char *arguments[] = {(char *)executable_path, NULL};
+    pid_t pid;
+    int error;
+
+    // Limits set after the spawn would miss what the blackbox maps or opens before, they can only be set in the child
+    if (limits->address_space != RLIM_INFINITY || limits->open_files != RLIM_INFINITY)
+    {
+        return fork_child(executable_path, message2child, message2parent, limits);
+    }
+
+    if ((error = posix_spawn_file_actions_init(&actions)) != 0)
+    {
+        errno = error;
+        return -1;
+    }
+    if ((error = posix_spawnattr_init(&attributes)) != 0)
+    {
+        posix_spawn_file_actions_destroy(&actions);
+        errno = error;
+        return -1;
+    }
+
+    if ((error = posix_spawn_file_actions_adddup2(&actions, message2child[0], STDIN_FILENO)) != 0 ||
+        (error = posix_spawn_file_actions_adddup2(&actions, message2parent[1], STDOUT_FILENO)) != 0 ||
+        (error = posix_spawn_file_actions_adddup2(&actions, message2parent[1], STDERR_FILENO)) != 0 ||
+        (error = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP)) != 0 ||
+        (error = posix_spawnattr_setpgroup(&attributes, 0)) != 0 ||
+        (error = posix_spawn(&pid, executable_path, &actions, &attributes, arguments, environ)) != 0)
+    {
+        pid = -1;
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    // If the executable itself couldn't be run, the fork path is used so the blackbox fails with its error message as before
+    if (pid == -1 && (error == ENOENT || error == EACCES || error == ENOEXEC || error == ENOTDIR || error == ELOOP || error == ENAMETOOLONG))
+    {
+        return fork_child(executable_path, message2child, message2parent, limits);
+    }
+
+    errno = error;
+    return pid;
+}
+
+// Returns a pidfd of the child, or -1 when pidfds are disabled or not supported by the kernel
+static int open_pidfd(pid_t pid)
+{
+    static int enabled = -1;
+
+    if (enabled == -1)
+    {
+        enabled = option_int("BLACKBOX_PIDFD", 1) != 0;
+    }
+#ifdef SYS_pidfd_open
+    if (enabled)
+    {
+        return syscall(SYS_pidfd_open, pid, 0);
+    }
+#endif
+    return -1;
+}
+
+int launch_blackbox_with(enum launch_method method, const char *executable_path, struct blackbox_process *process)
+{
+    int message2child[2], message2parent[2];
+    struct blackbox_limits limits;
+    struct forkserver *server = NULL;
+    pid_t pid = -1;
+
+    read_limits(&limits);
+
+    //Creating pipes
+    if (pipe2(message2child, O_CLOEXEC) == -1)
+    {
+        return -1;
+    }
+    if (pipe2(message2parent, O_CLOEXEC) == -1)
+    {
+        close(message2child[0]);
+        close(message2child[1]);
+        return -1;
+    }
+
+    if (method == LAUNCH_FORKSERVER)
+    {
+        struct forkserver_request request = {limits.address_space != RLIM_INFINITY ? limits.address_space : 0,
+                                             limits.open_files != RLIM_INFINITY ? limits.open_files : 0};
+        pid = forkserver_child(executable_path, message2child, message2parent, &request, &server);
+    }
+
+    if (method == LAUNCH_FORK)
+    {
+        pid = fork_child(executable_path, message2child, message2parent, &limits);
+    }
+    else if (server == NULL)
+    {
+        // Also for executables that can't be served by a fork server
+        pid = spawn_child(executable_path, message2child, message2parent, &limits);
+    }
+
+    if (pid == -1)
+    {
+        int error = errno;
+        close_pipes(message2child, message2parent);
+        errno = error;
+        return -1;
+    }
+
+    close(message2child[0]);  // Parent won't read from parent to child pipe
+    close(message2parent[1]); // Parent won't write to message channel from child to parent
+
+    process->pid = pid;
+    process->pidfd = open_pidfd(pid);
+    process->input_fd = message2child[1];
+    process->output_fd = message2parent[0];
+    process->forkserver = server;
+
+    return 0;
+}
+
+int launch_blackbox(const char *executable_path, struct blackbox_process *process)
+{
+    static int method = -1;
+
+    // Reading the option once, the value doesn't change while the program runs
+    if (method == -1)
+    {
+        const char *name = option_string("BLACKBOX_LAUNCHER", "spawn");
+        method = strcmp(name, "fork") == 0 ? LAUNCH_FORK : strcmp(name, "forkserver") == 0 ? LAUNCH_FORKSERVER : LAUNCH_SPAWN;
+    }
+
+    return launch_blackbox_with(method, executable_path, process);
+}
+
+pid_t reap_blackbox(struct blackbox_process *process, int *status, int options)
+{
+    siginfo_t info;
+    int ignored;
+
+    if (status == NULL)
+    {
+        status = &ignored;
+    }
+
+    // The fork server is the parent of its blackboxes, only it can wait for them
+    if (process->forkserver != NULL)
+    {
+        return forkserver_reap(process, status, options);
+    }
+
+    if (process->pidfd != -1)
+    {
+        info.si_pid = 0;
+        if (waitid(P_PIDFD, process->pidfd, &info, WEXITED | options) == 0)
+        {
+            if (info.si_pid == 0)
+            {
+                return 0; // Still running, only with WNOHANG
+            }
+
+            // waitid() reports the exit in parts, they are put together like waitpid() does
+            if (info.si_code == CLD_EXITED)
+            {
+                *status = (info.si_status & 0xff) << 8;
+            }
+            else
+            {
+                *status = (info.si_status & 0x7f) | (info.si_code == CLD_DUMPED ? 0x80 : 0);
+            }
+            close(process->pidfd);
+            process->pidfd = -1;
+            return process->pid;
+        }
+
+        // Linux 5.3 has pidfds but not P_PIDFD, the pid is used then
+        if (errno != EINVAL)
+        {
+            return -1;
+        }
+        close(process->pidfd);
+        process->pidfd = -1;
+    }
+
+    return waitpid(process->pid, status, options);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file    launcher.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Starts a blackbox in a child process with its STDIN, STDOUT and STDERR connected to pipes.
+ *
+ *  This is the code shared by part_a, part_b and part_c to create the child process. By default the child is created with posix_spawn(),
+ *  which glibc implements with clone(CLONE_VM|CLONE_VFORK), so the parent's memory isn't copied before the exec replaces it. The pipe
+ *  redirections are done with spawn file actions instead of dup2() calls in the child. The old fork() and execl() path is kept for
+ *  comparison, and is also used when the executable can't be executed so the error message is still delivered through the output pipe.
+ *
+ *  The launch method is selected with the environment variable BLACKBOX_LAUNCHER, which is "spawn" (default), "fork" or "forkserver".
+ *  The fork server method forks blackboxes from an already initialized copy of their executable, see forkserver.h.
+ *
+ *  Every blackbox also gets a pidfd, a file descriptor referring to exactly that process. reap_blackbox() waits through it with
+ *  waitid(P_PIDFD), and it can be polled to learn about the exit, so concurrent executions never collect each other's exit statuses. On
+ *  kernels without pidfds (before Linux 5.3), or with BLACKBOX_PIDFD=0, the process is waited for by its pid with waitpid() instead.
+ *
+ *  The blackbox runs in its own process group, whose id is its pid. Optional resource limits of the blackbox are also read from the
+ *  environment, and set in the child before the exec, so the spawn method falls back to fork() when one of them is set:
+ *      BLACKBOX_LIMIT_AS       Maximum size of the address space in bytes (RLIMIT_AS), 0 for no limit (default 0)
+ *      BLACKBOX_LIMIT_NOFILE   Maximum number of open file descriptors (RLIMIT_NOFILE), 0 for no limit (default 0)
+ */
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <sys/types.h>
+
+struct forkserver;
+
+// A running blackbox process whose STDIN is connected to input_fd and STDOUT/STDERR are connected to output_fd
+struct blackbox_process
+{
+    pid_t pid;
+    int pidfd;      // Becomes readable when the process exits, -1 when pidfds aren't available or after the process is reaped
+    int input_fd;
+    int output_fd;
+    struct forkserver *forkserver; // Fork server that started the process, NULL for the other launch methods
+};
+
+enum launch_method
+{
+    LAUNCH_SPAWN,
+    LAUNCH_FORK,
+    LAUNCH_FORKSERVER
+};
+
+// Runs executable_path in a new child process using the configured method. Returns 0 on success, -1 on error.
+// The caller owns the returned process: it should close both file descriptors and reap the process with reap_blackbox().
+int launch_blackbox(const char *executable_path, struct blackbox_process *process);
+
+// Same as launch_blackbox(), with an explicit launch method
+int launch_blackbox_with(enum launch_method method, const char *executable_path, struct blackbox_process *process);
+
+// Reaps the process, waiting for its exit unless options has WNOHANG, and closes its pidfd. status gets the exit status in the format
+// of waitpid() and may be NULL. Returns the pid once reaped, 0 if it is still running with WNOHANG, -1 on error
+pid_t reap_blackbox(struct blackbox_process *process, int *status, int options);
+
+#endif /* LAUNCHER_H */
@@ -0,0 +1,135 @@
+/**
+ * @file    launcher_bench.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Benchmark comparing the latency of the launch methods of launcher.c at several parent RSS sizes.
+ *
+ *  fork() copies the page tables of the parent, so its cost grows with the parent's resident memory while posix_spawn's doesn't.
+ *  For every given size, this program grows its own resident memory to that size by touching a heap allocation, then launches the
+ *  executable repeatedly with every method. Each launch is measured from the start of launch_blackbox_with() until it returns,
+ *  the child is then fed its input and reaped. Mean, median and maximum launch latencies are printed, with the median of the whole
+ *  run until the reap. Note that posix_spawn only returns after the exec, while fork returns before it, so the spawn numbers include
+ *  the exec. The fork server has no exec at all, so its run is the one to compare; it needs blackbox_forkserver.so in the working
+ *  directory or BLACKBOX_FORKSERVER_SHIM.
+ *
+ *  How to run:
+ *  > make launcher_bench
+ *  > ./launcher_bench.out   executable_path     iterations      rss_in_mb...
+ *  > ./launcher_bench.out   /bin/true   500     0 64 256 1024
+ */
+
+#include "launcher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Returns the current monotonic time in nanoseconds
+static long long now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static int compare_long_long(const void *first, const void *second)
+{
+    long long a = *(const long long *)first, b = *(const long long *)second;
+    return (a > b) - (a < b);
+}
+
+// Launches the executable the given number of times and prints the latency statistics of the method
+static void measure(enum launch_method method, const char *executable_path, int iterations, long rss_mb)
+{
+    static const char *method_names[] = {"spawn", "fork", "forkserver"};
+    long long *latencies = malloc(sizeof(long long) * iterations);
+    long long *runs = malloc(sizeof(long long) * iterations);
+    long long total = 0;
+    struct blackbox_process blackbox;
+    char discard[256];
+
+    if (latencies == NULL || runs == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        exit(-1);
+    }
+
+    for (int i = 0; i < iterations; i++)
+    {
+        long long start = now_ns();
+        if (launch_blackbox_with(method, executable_path, &blackbox) == -1)
+        {
+            perror("[ERROR] Child process couldn't be created.");
+            exit(-1);
+        }
+        latencies[i] = now_ns() - start;
+        total += latencies[i];
+
+        // Feeding the blackbox and reaping it, so it doesn't stay alive during the next measurement
+        write(blackbox.input_fd, "1 2\n", 4);
+        close(blackbox.input_fd);
+        while (read(blackbox.output_fd, discard, sizeof(discard)) > 0)
+            ;
+        close(blackbox.output_fd);
+        reap_blackbox(&blackbox, NULL, 0);
+        runs[i] = now_ns() - start;
+    }
+
+    qsort(latencies, iterations, sizeof(long long), compare_long_long);
+    qsort(runs, iterations, sizeof(long long), compare_long_long);
+    printf("%8ld MB  %-10s  mean %9.1f us  median %9.1f us  max %9.1f us  run median %9.1f us\n", rss_mb, method_names[method],
+           total / 1000.0 / iterations, latencies[iterations / 2] / 1000.0, latencies[iterations - 1] / 1000.0, runs[iterations / 2] / 1000.0);
+
+    free(latencies);
+    free(runs);
+}
+
+int main(int argc, char **argv)
+{
+    char *executable_path;
+    int iterations;
+    char *ballast = NULL;
+    long ballast_mb = 0;
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "[ERROR] Usage: %s executable_path iterations rss_in_mb...\n", argv[0]);
+        return -1;
+    }
+
+    executable_path = argv[1];
+    iterations = atoi(argv[2]);
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "[ERROR] Iteration count should be positive.\n");
+        return -1;
+    }
+
+    for (int i = 3; i < argc; i++)
+    {
+        long rss_mb = atol(argv[i]);
+
+        // The ballast only grows, so sizes should be given in increasing order
+        if (rss_mb > ballast_mb)
+        {
+            ballast = realloc(ballast, rss_mb << 20);
+            if (ballast == NULL)
+            {
+                perror("[ERROR] Memory allocation error.");
+                return -1;
+            }
+            memset(ballast, 1, rss_mb << 20); // Touching every page so it is resident
+            ballast_mb = rss_mb;
+        }
+
+        measure(LAUNCH_FORK, executable_path, iterations, ballast_mb);
+        measure(LAUNCH_SPAWN, executable_path, iterations, ballast_mb);
+        measure(LAUNCH_FORKSERVER, executable_path, iterations, ballast_mb);
+    }
+
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,459 @@
+/**
+ * @file    load_generator.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Load generator measuring the throughput and latency of an RPC server running blackboxes.
+ *
+ *  Every connection is a thread with its own RPC client, calling the server synchronously. In open loop mode, connection i sends its
+ *  k-th call at start + (i + k * concurrency) / rate, so the calls of all connections are spread evenly over time. A connection that is
+ *  late because of a slow reply sends its next calls right away until it catches up, and their latencies include the wait.
+ *
+ *  Every connection records into its own histogram, and they are merged after the run. Calls due during the warm up aren't recorded.
+ */
+
+#define _GNU_SOURCE
+
+#include "load_generator.h"
+#include "histogram.h"
+#include "options.h"
+
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+// Argument of the procedures, laid out like part_b's operands and part_c's arguments
+struct call_argument
+{
+    char *executable_path;
+    int a;
+    int b;
+};
+
+enum distribution
+{
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_FIXED,
+    DISTRIBUTION_ZIPF
+};
+
+static const char *distribution_names[] = {"uniform", "fixed", "zipf"};
+
+struct load_settings
+{
+    const struct load_procedure *procedure;
+    const char *host;
+    char *executable_path;
+    int tcp, port;
+    long concurrency, timeout_ms;
+    double rate, duration, warmup;
+    enum distribution distribution;
+    long range, keys;
+    double *zipf_cdf;           // Probability of the ranks up to each one, for the zipf distribution
+    long long start_ns, measure_ns, end_ns;
+};
+
+struct connection
+{
+    struct load_settings *settings;
+    long index;
+    uint64_t random_state;
+    int connected;
+    struct histogram latencies;
+    uint64_t success, fail, other, errors;
+    enum clnt_stat last_error;
+};
+
+// Returns the current monotonic time in nanoseconds
+static long long now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void sleep_until(long long time_ns)
+{
+    struct timespec time = {time_ns / 1000000000LL, time_ns % 1000000000LL};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) != 0)
+    {
+    }
+}
+
+// xorshift64*, every connection has its own state
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void pick_pair(struct connection *connection, int *a, int *b)
+{
+    struct load_settings *settings = connection->settings;
+    uint64_t random = next_random(&connection->random_state);
+
+    switch (settings->distribution)
+    {
+    case DISTRIBUTION_FIXED:
+        *a = 1;
+        *b = 2;
+        break;
+
+    case DISTRIBUTION_ZIPF:
+    {
+        // Binary search for the first rank whose cumulative probability reaches the random number
+        double target = (random >> 11) * 0x1.0p-53;
+        long low = 0, high = settings->keys - 1;
+        while (low < high)
+        {
+            long middle = (low + high) / 2;
+            if (settings->zipf_cdf[middle] < target)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        *a = low;
+        *b = 1;
+        break;
+    }
+
+    default:
+        *a = (random & 0xffffffff) % settings->range;
+        *b = (random >> 32) % settings->range;
+        break;
+    }
+}
+
+// Creates the client of a connection, through the portmapper unless the port is given
+static CLIENT *connect_server(struct load_settings *settings)
+{
+    const struct load_procedure *procedure = settings->procedure;
+    struct addrinfo hints, *addresses;
+    struct sockaddr_in address;
+    struct timeval retry = {1, 0};
+    int sock = RPC_ANYSOCK;
+
+    if (settings->port == 0)
+    {
+        return clnt_create(settings->host, procedure->program, procedure->version, settings->tcp ? "tcp" : "udp");
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(settings->host, NULL, &hints, &addresses) != 0)
+    {
+        return NULL;
+    }
+    memcpy(&address, addresses->ai_addr, sizeof(address));
+    freeaddrinfo(addresses);
+    address.sin_port = htons(settings->port);
+
+    if (settings->tcp)
+    {
+        return clnttcp_create(&address, procedure->program, procedure->version, &sock, 0, 0);
+    }
+    return clntudp_create(&address, procedure->program, procedure->version, retry, &sock);
+}
+
+static void *connection_thread(void *data)
+{
+    struct connection *connection = data;
+    struct load_settings *settings = connection->settings;
+    struct timeval timeout = {settings->timeout_ms / 1000, settings->timeout_ms % 1000 * 1000};
+    struct call_argument argument = {settings->executable_path, 0, 0};
+
+    CLIENT *client = connect_server(settings);
+    if (client == NULL)
+    {
+        clnt_pcreateerror(settings->host);
+        return NULL;
+    }
+    connection->connected = 1;
+    clnt_control(client, CLSET_TIMEOUT, (char *)&timeout);
+
+    for (long long call = 0;; call++)
+    {
+        long long due;
+        if (settings->rate > 0)
+        {
+            due = settings->start_ns + (long long)((connection->index + call * settings->concurrency) * 1e9 / settings->rate);
+            if (due >= settings->end_ns)
+            {
+                break;
+            }
+            sleep_until(due);
+        }
+        else
+        {
+            due = now_ns();
+            if (due >= settings->end_ns)
+            {
+                break;
+            }
+        }
+
+        char *reply = NULL;
+        pick_pair(connection, &argument.a, &argument.b);
+        enum clnt_stat status = clnt_call(client, settings->procedure->procedure, settings->procedure->xdr_argument, (caddr_t)&argument,
+                                          (xdrproc_t)xdr_wrapstring, (caddr_t)&reply, timeout);
+        long long done = now_ns();
+
+        if (due >= settings->measure_ns)
+        {
+            if (status != RPC_SUCCESS)
+            {
+                connection->errors++;
+                connection->last_error = status;
+            }
+            else
+            {
+                histogram_record(&connection->latencies, done - due);
+                if (strncmp(reply, "SUCCESS:", 8) == 0)
+                {
+                    connection->success++;
+                }
+                else if (strncmp(reply, "FAIL:", 5) == 0)
+                {
+                    connection->fail++;
+                }
+                else
+                {
+                    connection->other++;
+                }
+            }
+        }
+
+        if (status == RPC_SUCCESS)
+        {
+            xdr_free((xdrproc_t)xdr_wrapstring, (char *)&reply);
+        }
+        else if (settings->tcp && (status == RPC_CANTSEND || status == RPC_CANTRECV))
+        {
+            // The connection is broken, the next calls go over a new one
+            clnt_destroy(client);
+            client = connect_server(settings);
+            if (client == NULL)
+            {
+                clnt_pcreateerror(settings->host);
+                return NULL;
+            }
+            clnt_control(client, CLSET_TIMEOUT, (char *)&timeout);
+        }
+    }
+
+    clnt_destroy(client);
+    return NULL;
+}
+
+// Reads the options, returns -1 if one of them is invalid
+static int read_settings(struct load_settings *settings)
+{
+    const char *transport = option_string("LOAD_TRANSPORT", "udp");
+    const char *distribution = option_string("LOAD_DISTRIBUTION", "uniform");
+
+    settings->tcp = strcmp(transport, "tcp") == 0;
+    settings->port = option_int("LOAD_PORT", 0);
+    settings->concurrency = option_int("LOAD_CONCURRENCY", 8);
+    settings->rate = atof(option_string("LOAD_RATE", "0"));
+    settings->duration = atof(option_string("LOAD_DURATION", "10"));
+    settings->warmup = atof(option_string("LOAD_WARMUP", "1"));
+    settings->timeout_ms = option_int("LOAD_TIMEOUT_MS", 25000);
+    settings->range = option_int("LOAD_RANGE", 1000);
+    settings->keys = option_int("LOAD_KEYS", 1000);
+
+    if (!settings->tcp && strcmp(transport, "udp") != 0)
+    {
+        fprintf(stderr, "[ERROR] LOAD_TRANSPORT should be udp or tcp.\n");
+        return -1;
+    }
+    if (settings->concurrency < 1 || settings->duration <= 0 || settings->warmup < 0 || settings->rate < 0 || settings->range < 1 ||
+        settings->keys < 1 || settings->timeout_ms < 1)
+    {
+        fprintf(stderr, "[ERROR] LOAD_CONCURRENCY, LOAD_DURATION, LOAD_RANGE, LOAD_KEYS and LOAD_TIMEOUT_MS should be positive.\n");
+        return -1;
+    }
+
+    for (settings->distribution = DISTRIBUTION_UNIFORM; settings->distribution <= DISTRIBUTION_ZIPF; settings->distribution++)
+    {
+        if (strcmp(distribution, distribution_names[settings->distribution]) == 0)
+        {
+            break;
+        }
+    }
+    if (settings->distribution > DISTRIBUTION_ZIPF)
+    {
+        fprintf(stderr, "[ERROR] LOAD_DISTRIBUTION should be uniform, fixed or zipf.\n");
+        return -1;
+    }
+
+    settings->zipf_cdf = NULL;
+    if (settings->distribution == DISTRIBUTION_ZIPF)
+    {
+        double exponent = atof(option_string("LOAD_ZIPF_EXPONENT", "1.0")), sum = 0;
+        settings->zipf_cdf = (double *)malloc(settings->keys * sizeof(double));
+        if (settings->zipf_cdf == NULL)
+        {
+            perror("[ERROR] Memory allocation error.");
+            return -1;
+        }
+        for (long rank = 0; rank < settings->keys; rank++)
+        {
+            sum += 1.0 / pow(rank + 1, exponent);
+            settings->zipf_cdf[rank] = sum;
+        }
+        for (long rank = 0; rank < settings->keys; rank++)
+        {
+            settings->zipf_cdf[rank] /= sum;
+        }
+    }
+
+    return 0;
+}
+
+static void write_text_report(FILE *file, const struct load_settings *settings, const struct connection *total, double throughput)
+{
+    const struct histogram *latencies = &total->latencies;
+
+    fprintf(file, "%s over %s, %ld connections, ", settings->procedure->name, settings->tcp ? "tcp" : "udp", settings->concurrency);
+    if (settings->rate > 0)
+    {
+        fprintf(file, "open loop at %.1f calls/s, ", settings->rate);
+    }
+    else
+    {
+        fprintf(file, "closed loop, ");
+    }
+    fprintf(file, "%s inputs, %.1f s\n", distribution_names[settings->distribution], settings->duration);
+
+    fprintf(file, "Calls:    %llu, %.1f calls/s (%llu SUCCESS, %llu FAIL, %llu other, %llu RPC errors)\n",
+            (unsigned long long)latencies->total, throughput, (unsigned long long)total->success, (unsigned long long)total->fail,
+            (unsigned long long)total->other, (unsigned long long)total->errors);
+    fprintf(file, "Latency:  min %.3f ms  mean %.3f ms  p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  p99.9 %.3f ms  max %.3f ms\n",
+            (latencies->total > 0 ? latencies->min : 0) / 1e6, histogram_mean(latencies) / 1e6, histogram_percentile(latencies, 50) / 1e6,
+            histogram_percentile(latencies, 90) / 1e6, histogram_percentile(latencies, 99) / 1e6, histogram_percentile(latencies, 99.9) / 1e6,
+            latencies->max / 1e6);
+}
+
+static void write_json_report(FILE *file, const struct load_settings *settings, const struct connection *total, double throughput)
+{
+    const struct histogram *latencies = &total->latencies;
+
+    fprintf(file,
+            "{\"procedure\": \"%s\", \"transport\": \"%s\", \"concurrency\": %ld, \"mode\": \"%s\", \"target_rate\": %.1f, "
+            "\"distribution\": \"%s\", \"duration_s\": %.3f, \"calls\": %llu, \"success\": %llu, \"fail\": %llu, \"other\": %llu, "
+            "\"errors\": %llu, \"throughput\": %.3f, \"latency_us\": {\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+            "\"p99\": %.3f, \"p99_9\": %.3f, \"max\": %.3f}}\n",
+            settings->procedure->name, settings->tcp ? "tcp" : "udp", settings->concurrency, settings->rate > 0 ? "open" : "closed",
+            settings->rate, distribution_names[settings->distribution], settings->duration, (unsigned long long)latencies->total,
+            (unsigned long long)total->success, (unsigned long long)total->fail, (unsigned long long)total->other,
+            (unsigned long long)total->errors, throughput, (latencies->total > 0 ? latencies->min : 0) / 1e3, histogram_mean(latencies) / 1e3,
+            histogram_percentile(latencies, 50) / 1e3, histogram_percentile(latencies, 90) / 1e3, histogram_percentile(latencies, 99) / 1e3,
+            histogram_percentile(latencies, 99.9) / 1e3, latencies->max / 1e3);
+}
+
+int load_generator_main(int argc, char **argv, const struct load_procedure *procedure)
+{
+    struct load_settings settings;
+    struct connection total;
+    int connected = 0;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "[ERROR] Usage: %s server_host blackbox_path\n", argv[0]);
+        return -1;
+    }
+
+    settings.procedure = procedure;
+    settings.host = argv[1];
+    settings.executable_path = argv[2];
+    if (read_settings(&settings) == -1)
+    {
+        return -1;
+    }
+
+    // Histograms are big, the connections are on the heap
+    struct connection *connections = (struct connection *)calloc(settings.concurrency, sizeof(struct connection));
+    pthread_t *threads = (pthread_t *)calloc(settings.concurrency, sizeof(pthread_t));
+    if (connections == NULL || threads == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return -1;
+    }
+
+    settings.start_ns = now_ns();
+    settings.measure_ns = settings.start_ns + (long long)(settings.warmup * 1e9);
+    settings.end_ns = settings.measure_ns + (long long)(settings.duration * 1e9);
+    for (long i = 0; i < settings.concurrency; i++)
+    {
+        connections[i].settings = &settings;
+        connections[i].index = i;
+        connections[i].random_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+        histogram_init(&connections[i].latencies);
+        if (pthread_create(&threads[i], NULL, connection_thread, &connections[i]) != 0)
+        {
+            perror("[ERROR] Connection thread couldn't be created.");
+            return -1;
+        }
+    }
+
+    memset(&total, 0, sizeof(total));
+    histogram_init(&total.latencies);
+    for (long i = 0; i < settings.concurrency; i++)
+    {
+        pthread_join(threads[i], NULL);
+        connected += connections[i].connected;
+        histogram_merge(&total.latencies, &connections[i].latencies);
+        total.success += connections[i].success;
+        total.fail += connections[i].fail;
+        total.other += connections[i].other;
+        total.errors += connections[i].errors;
+        if (connections[i].errors > 0)
+        {
+            total.last_error = connections[i].last_error;
+        }
+    }
+    if (connected == 0)
+    {
+        fprintf(stderr, "[ERROR] No connection to the server could be made.\n");
+        return -1;
+    }
+
+    if (total.errors > 0)
+    {
+        fprintf(stderr, "[WARNING] %llu calls failed, the last one with:%s\n", (unsigned long long)total.errors, clnt_sperrno(total.last_error));
+    }
+
+    double throughput = total.latencies.total / settings.duration;
+    write_text_report(stdout, &settings, &total, throughput);
+
+    const char *json_path = option_string("LOAD_JSON", "-");
+    FILE *json_file = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (json_file == NULL)
+    {
+        perror("[ERROR] JSON report file couldn't be opened.");
+        return -1;
+    }
+    write_json_report(json_file, &settings, &total, throughput);
+    if (json_file != stdout)
+    {
+        fclose(json_file);
+    }
+
+    free(settings.zipf_cdf);
+    free(connections);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file    load_generator.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Load generator measuring the throughput and latency of an RPC server running blackboxes.
+ *
+ *  The part_b and part_c servers both have a procedure that takes a blackbox path with two integers and returns the result as a string.
+ *  The benchmarks of both parts describe their procedure and call load_generator_main(), which keeps a number of connections busy with
+ *  calls for a fixed time and reports the results.
+ *
+ *  In closed loop mode every connection sends its next call as soon as the reply of the previous one arrives. In open loop mode calls are
+ *  sent at a fixed total rate whatever the server does. A call is then measured from the time it was due, not from when it was sent, so
+ *  a server that falls behind isn't rewarded with fewer calls (the coordinated omission problem).
+ *
+ *  Latencies are kept in the histograms of histogram.h. The report has the throughput and p50/p90/p99/p99.9 latencies, as text and as a
+ *  JSON object to compare builds with.
+ *
+ *  Options are read from environment variables:
+ *      LOAD_CONCURRENCY    Number of connections, each with its own thread (default 8)
+ *      LOAD_RATE           Total calls per second in open loop mode, 0 for closed loop mode (default 0)
+ *      LOAD_TRANSPORT      "udp" or "tcp" (default udp)
+ *      LOAD_PORT           Port of the server, skips the portmapper when set (default 0)
+ *      LOAD_DURATION       Measured time in seconds (default 10)
+ *      LOAD_WARMUP         Seconds of calls before the measurement, which aren't recorded (default 1)
+ *      LOAD_TIMEOUT_MS     Timeout of a call (default 25000)
+ *      LOAD_DISTRIBUTION   Inputs of the calls: "uniform" pairs below LOAD_RANGE, "fixed" pair "1 2", or "zipf" over LOAD_KEYS pairs
+ *                          where the pair of rank k is picked with probability proportional to 1/k^LOAD_ZIPF_EXPONENT (default uniform)
+ *      LOAD_RANGE          Upper bound of the uniform inputs (default 1000)
+ *      LOAD_KEYS           Number of different pairs of the zipf distribution (default 1000)
+ *      LOAD_ZIPF_EXPONENT  Exponent of the zipf distribution (default 1.0)
+ *      LOAD_JSON           Path of the file the JSON report is written to, "-" or unset for STDOUT
+ */
+
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <rpc/rpc.h>
+
+// The procedure under load. Its argument is a struct of the blackbox path and two integers, in this order, and its result a string
+struct load_procedure
+{
+    const char *name;
+    u_long program, version, procedure;
+    xdrproc_t xdr_argument;
+};
+
+// Runs the benchmark with the command line arguments server_host blackbox_path. Returns 0 on success, -1 on error
+int load_generator_main(int argc, char **argv, const struct load_procedure *procedure);
+
+#endif /* LOAD_GENERATOR_H */
@@ -0,0 +1,44 @@
+/**
+ * @file    options.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Helpers to read tuning options of the executors from environment variables.
+ */
+
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+long option_int(const char *name, long default_value)
+{
+    const char *value = getenv(name);
+    char *end;
+    long parsed;
+
+    if (value == NULL || *value == '\0')
+    {
+        return default_value;
+    }
+
+    // Values that are not fully numeric are reported and ignored, so a typo doesn't silently change the behaviour
+    parsed = strtol(value, &end, 10);
+    if (*end != '\0')
+    {
+        fprintf(stderr, "[WARNING] Ignoring invalid value \"%s\" for %s.\n", value, name);
+        return default_value;
+    }
+
+    return parsed;
+}
+
+const char *option_string(const char *name, const char *default_value)
+{
+    const char *value = getenv(name);
+
+    if (value == NULL || *value == '\0')
+    {
+        return default_value;
+    }
+    return value;
+}
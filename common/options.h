@@ -0,0 +1,21 @@
+/**
+ * @file    options.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Helpers to read tuning options of the executors from environment variables.
+ *
+ *  The RPC servers take their command line arguments through the wrapper program or not at all, so optional tuning knobs are read
+ *  from the environment instead. Since the wrapper runs the server with execl(), variables set when starting the wrapper are also
+ *  visible to the server.
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+// Returns the integer value of environment variable name, or default_value if it is unset or not a number
+long option_int(const char *name, long default_value);
+
+// Returns the value of environment variable name, or default_value if it is unset or empty
+const char *option_string(const char *name, const char *default_value);
+
+#endif /* OPTIONS_H */
@@ -0,0 +1,255 @@
+/**
+ * @file    plugin.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Runs trusted blackboxes that are shared objects inside the server process, without creating a process for them.
+ *
+ *  Every executable path has an entry with the identity of the file it was checked at (device, inode, size and modification time) and
+ *  its entry point, NULL when it isn't a plugin. Requests only take the read lock to find their entry. A file that changed is checked
+ *  again and its entry updated; the old handle is never closed, since other threads may still be calling into it.
+ *
+ *  dlopen() gives back a library that is already loaded when the name or the device and inode match, so loading a changed file by its
+ *  path would keep running the old version. Every version is copied to a new private file instead, which is loaded and then unlinked,
+ *  and its identity is taken from the descriptor the copy was read from.
+ *
+ *  Position independent executables are ELF shared objects too, so a file is only loaded when it has no program interpreter, which
+ *  every executable has and libraries don't.
+ */
+
+#define _GNU_SOURCE
+
+#include "plugin.h"
+#include "options.h"
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PLUGIN_ERROR_SIZE 4096
+
+struct plugin_entry
+{
+    char *path;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    blackbox_compute_function compute;
+    struct plugin_entry *next;
+};
+
+static pthread_once_t plugin_once = PTHREAD_ONCE_INIT;
+static int plugins_enabled;
+static pthread_rwlock_t entries_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct plugin_entry *entries;
+
+static void plugin_init(void)
+{
+    plugins_enabled = option_int("BLACKBOX_PLUGINS", 0);
+}
+
+int plugin_enabled(void)
+{
+    pthread_once(&plugin_once, plugin_init);
+    return plugins_enabled;
+}
+
+static int entry_is_current(const struct plugin_entry *entry, const struct stat *file_status)
+{
+    return entry->device == file_status->st_dev && entry->inode == file_status->st_ino && entry->size == file_status->st_size &&
+           entry->modified.tv_sec == file_status->st_mtim.tv_sec && entry->modified.tv_nsec == file_status->st_mtim.tv_nsec;
+}
+
+// Returns 1 when the file is a 64 bit ELF shared object without a program interpreter
+static int is_shared_library(int fd)
+{
+    Elf64_Ehdr header;
+    Elf64_Phdr program_header;
+    int library = 0;
+
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) && memcmp(header.e_ident, ELFMAG, SELFMAG) == 0 &&
+        header.e_ident[EI_CLASS] == ELFCLASS64 && header.e_type == ET_DYN && header.e_phentsize == sizeof(Elf64_Phdr))
+    {
+        library = 1;
+        for (int i = 0; i < header.e_phnum && library; i++)
+        {
+            if (pread(fd, &program_header, sizeof(program_header), header.e_phoff + i * sizeof(program_header)) != sizeof(program_header) ||
+                program_header.p_type == PT_INTERP)
+            {
+                library = 0;
+            }
+        }
+    }
+
+    return library;
+}
+
+// Copies the file to a new private file and returns its path, which is absolute so dlopen() doesn't search for it. NULL on error
+static char *copy_plugin(int fd)
+{
+    char data[65536];
+    char *path;
+    ssize_t length;
+
+    if (asprintf(&path, "%s/blackbox_plugin_XXXXXX", option_string("TMPDIR", "/tmp")) == -1)
+    {
+        return NULL;
+    }
+    int copy_fd = mkostemp(path, O_CLOEXEC);
+    if (copy_fd == -1)
+    {
+        free(path);
+        return NULL;
+    }
+
+    off_t offset = 0;
+    while ((length = pread(fd, data, sizeof(data), offset)) > 0)
+    {
+        if (write(copy_fd, data, length) != length)
+        {
+            length = -1;
+            break;
+        }
+        offset += length;
+    }
+    close(copy_fd);
+    if (length == -1)
+    {
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+// Loads the file and returns its entry point, NULL if it isn't a plugin. file_status is set to the identity of the version that was
+// checked, it is left as it is when the file couldn't be opened
+static blackbox_compute_function load_plugin(const char *executable_path, struct stat *file_status)
+{
+    int fd = open(executable_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    if (fstat(fd, file_status) == -1 || !is_shared_library(fd))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *path = copy_plugin(fd);
+    close(fd);
+    if (path == NULL)
+    {
+        perror("[WARNING] Blackbox couldn't be copied to be loaded as a plugin");
+        return NULL;
+    }
+
+    // The mapping of the library keeps the copy alive after it is unlinked
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    unlink(path);
+    free(path);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "[WARNING] Blackbox %s couldn't be loaded as a plugin: %s\n", executable_path, dlerror());
+        return NULL;
+    }
+
+    blackbox_compute_function compute = (blackbox_compute_function)dlsym(handle, PLUGIN_ENTRY_POINT);
+    if (compute == NULL)
+    {
+        dlclose(handle);
+    }
+    return compute;
+}
+
+blackbox_compute_function plugin_lookup(const char *executable_path)
+{
+    struct stat file_status;
+    struct plugin_entry *entry;
+    blackbox_compute_function compute = NULL;
+    int found = 0;
+
+    if (!plugin_enabled() || stat(executable_path, &file_status) == -1)
+    {
+        return NULL;
+    }
+
+    pthread_rwlock_rdlock(&entries_lock);
+    for (entry = entries; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->path, executable_path) == 0 && entry_is_current(entry, &file_status))
+        {
+            compute = entry->compute;
+            found = 1;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&entries_lock);
+    if (found)
+    {
+        return compute;
+    }
+
+    // Checking the file outside of the lock, two threads checking it at once load a copy each and both handles stay loaded
+    compute = load_plugin(executable_path, &file_status);
+
+    pthread_rwlock_wrlock(&entries_lock);
+    for (entry = entries; entry != NULL && strcmp(entry->path, executable_path) != 0; entry = entry->next)
+    {
+    }
+    if (entry == NULL && (entry = (struct plugin_entry *)calloc(1, sizeof(struct plugin_entry))) != NULL &&
+        (entry->path = strdup(executable_path)) != NULL)
+    {
+        entry->next = entries;
+        entries = entry;
+    }
+    if (entry != NULL && entry->path != NULL)
+    {
+        entry->device = file_status.st_dev;
+        entry->inode = file_status.st_ino;
+        entry->size = file_status.st_size;
+        entry->modified = file_status.st_mtim;
+        entry->compute = compute;
+    }
+    pthread_rwlock_unlock(&entries_lock);
+
+    return compute;
+}
+
+int plugin_run(blackbox_compute_function compute, int a, int b, struct captured_output *output)
+{
+    char error[PLUGIN_ERROR_SIZE] = "";
+    int out = 0;
+
+    memset(output, 0, sizeof(struct captured_output));
+    int status = compute(a, b, &out, error, sizeof(error));
+    if (status == 0)
+    {
+        // The number is printed like a blackbox process prints it
+        output->data = (char *)malloc(16);
+        if (output->data == NULL)
+        {
+            return -1;
+        }
+        output->length = sprintf(output->data, "%d\n", out);
+        return 0;
+    }
+
+    // The message becomes the output and the returned value the exit status, which a process can't give as 0 for a failure
+    error[sizeof(error) - 1] = '\0';
+    output->data = strdup(error);
+    if (output->data == NULL)
+    {
+        return -1;
+    }
+    output->length = strlen(error);
+    output->status = ((status & 0xff) != 0 ? status & 0xff : 1) << 8;
+    return 0;
+}
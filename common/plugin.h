@@ -0,0 +1,49 @@
+/**
+ * @file    plugin.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Runs trusted blackboxes that are shared objects inside the server process, without creating a process for them.
+ *
+ *  Creating the pipes and the process of a blackbox takes far longer than what most blackboxes compute. A blackbox can instead be
+ *  built as a shared object exporting the entry point
+ *
+ *      int blackbox_compute(int a, int b, int *out, char *err, size_t errlen);
+ *
+ *  which returns 0 and sets *out on success, or returns a non-zero exit status and writes a NUL terminated message to err on failure.
+ *  It may be called from many threads at once. Build it with
+ *
+ *      gcc -shared -fPIC -O2 blackbox.c -o blackbox.so
+ *
+ *  When BLACKBOX_PLUGINS=1, the executable path of a request is checked once for every version of the file: an ELF shared object
+ *  exporting the entry point is loaded with dlopen() from a private copy and its handle is kept, so a changed file is loaded again
+ *  instead of reusing the library already loaded from that path. Any other file runs as a process as before. The result
+ *  of a plugin is given as the output a process would give, "out\n" with exit status 0 or the message with the returned status, so
+ *  the servers format it exactly like the output of a process.
+ *
+ *  A plugin runs in the server: it can't be killed, so time and resource limits don't apply to it, and a crash of the plugin is a
+ *  crash of the server. Only enable plugins for blackboxes you trust.
+ */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "capture.h"
+
+#include <stddef.h>
+
+#define PLUGIN_ENTRY_POINT "blackbox_compute"
+
+typedef int (*blackbox_compute_function)(int a, int b, int *out, char *err, size_t errlen);
+
+// Returns 1 when BLACKBOX_PLUGINS enables plugins
+int plugin_enabled(void);
+
+// Returns the entry point of executable_path if it is a shared object exporting it, NULL otherwise or when plugins are disabled.
+// The answer is cached until the file changes
+blackbox_compute_function plugin_lookup(const char *executable_path);
+
+// Calls the entry point with the two numbers and fills output with what a blackbox process would have given. Returns 0 on success,
+// -1 on error
+int plugin_run(blackbox_compute_function compute, int a, int b, struct captured_output *output);
+
+#endif /* PLUGIN_H */
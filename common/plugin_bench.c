@@ -0,0 +1,140 @@
+/**
+ * @file    plugin_bench.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Benchmark comparing a blackbox run as a process with the same blackbox called as a plugin of plugin.h.
+ *
+ *  Every iteration gives the pair "iteration iteration+1" to the blackbox. The process path launches the executable, writes the pair
+ *  and captures its output and exit status, which is what the servers do for a request without the warm pool. The plugin path calls
+ *  the entry point of the shared object with plugin_run(). Mean, median, p99 and maximum latencies are printed for both, and the
+ *  outputs and exit statuses of the two are compared for every pair, since the servers format them the same way.
+ *
+ *  How to run:
+ *  > make plugin_bench
+ *  > gcc -shared -fPIC -O2 blackbox.c -o blackbox.so
+ *  > ./plugin_bench.out   executable_path     plugin_path     iterations
+ */
+
+#include "capture.h"
+#include "launcher.h"
+#include "plugin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Returns the current monotonic time in nanoseconds
+static long long now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static int compare_long_long(const void *first, const void *second)
+{
+    long long a = *(const long long *)first, b = *(const long long *)second;
+    return (a > b) - (a < b);
+}
+
+static void print_latencies(const char *name, long long *latencies, int iterations)
+{
+    long long total = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        total += latencies[i];
+    }
+    qsort(latencies, iterations, sizeof(long long), compare_long_long);
+    printf("%-8s  mean %9.2f us  median %9.2f us  p99 %9.2f us  max %9.2f us\n", name, total / 1000.0 / iterations,
+           latencies[iterations / 2] / 1000.0, latencies[iterations * 99 / 100] / 1000.0, latencies[iterations - 1] / 1000.0);
+}
+
+// Runs the executable as a process with the pair, the way the servers do without the warm pool
+static void run_process(const char *executable_path, int a, int b, struct captured_output *output)
+{
+    struct blackbox_process blackbox;
+    char input[64];
+
+    if (launch_blackbox(executable_path, &blackbox) == -1)
+    {
+        perror("[ERROR] Child process couldn't be created.");
+        exit(-1);
+    }
+    int length = sprintf(input, "%d %d\n", a, b);
+    write(blackbox.input_fd, input, length);
+    if (capture_blackbox(&blackbox, output) == -1)
+    {
+        perror("[ERROR] Output of the blackbox couldn't be read.");
+        exit(-1);
+    }
+    close(blackbox.input_fd);
+    close(blackbox.output_fd);
+}
+
+int main(int argc, char **argv)
+{
+    struct captured_output process_output, plugin_output;
+    int iterations, mismatches = 0;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "[ERROR] Usage: %s executable_path plugin_path iterations\n", argv[0]);
+        return -1;
+    }
+
+    iterations = atoi(argv[3]);
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "[ERROR] Iteration count should be positive.\n");
+        return -1;
+    }
+
+    setenv("BLACKBOX_PLUGINS", "1", 1);
+    blackbox_compute_function compute = plugin_lookup(argv[2]);
+    if (compute == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s isn't a shared object exporting %s.\n", argv[2], PLUGIN_ENTRY_POINT);
+        return -1;
+    }
+
+    long long *process_latencies = malloc(sizeof(long long) * iterations);
+    long long *plugin_latencies = malloc(sizeof(long long) * iterations);
+    if (process_latencies == NULL || plugin_latencies == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return -1;
+    }
+
+    for (int i = 0; i < iterations; i++)
+    {
+        long long start = now_ns();
+        run_process(argv[1], i, i + 1, &process_output);
+        process_latencies[i] = now_ns() - start;
+
+        start = now_ns();
+        if (plugin_run(compute, i, i + 1, &plugin_output) == -1)
+        {
+            perror("[ERROR] Plugin couldn't be run.");
+            return -1;
+        }
+        plugin_latencies[i] = now_ns() - start;
+
+        if (process_output.status != plugin_output.status || strcmp(process_output.data, plugin_output.data) != 0)
+        {
+            mismatches++;
+        }
+        free(process_output.data);
+        free(plugin_output.data);
+    }
+
+    print_latencies("process", process_latencies, iterations);
+    print_latencies("plugin", plugin_latencies, iterations);
+    printf("%d of %d pairs gave a different output or status\n", mismatches, iterations);
+
+    free(process_latencies);
+    free(plugin_latencies);
+    return 0;
+}
@@ -7,147 +7,315 @@
 *   The program takes 2 input arguments: Binary executable file location and output file location. The given binary executable file is executed in a child process, while
 *   the outputs and inputs are redirected to the main process with pipes. Then the result is printed with a FAIL or SUCCESS message to the given output file.
 *   Redirecting works by creating 3 one directional pipes: first pipe connects parent to child's STDIN, second one connects child's STDOUT and STDERR to parent.
-*   Difference between error and successful run is made by using wait(status), as if there was an error in the program, return value wouldn't be 0. Then according to this
-*   return value from blackbox, SUCCESS or FAIL messages are printed to the file.
+*   Difference between error and successful run is made by the exit status reaped through the pidfd of the blackbox, as if there was an error in the
+*   program, return value wouldn't be 0. Then according to this return value from blackbox, SUCCESS or FAIL messages are printed to the file.
+*
+*   The child process is created by the shared launcher in common/launcher.c.
+*   The output is read by common/capture.c while the blackbox runs, so a blackbox with an output bigger than the pipe buffer can finish.
+*
+*   In stream mode the output isn't kept in memory. An output longer than a few kilobytes can only be an error message in practice, so it
+*   is moved into the output file with splice() under a FAIL header while the blackbox runs. If the blackbox succeeds after all, the
+*   streamed part is cut from the file and the SUCCESS result is written from the first bytes of the output instead.
+*
+*   In batch mode, pairs are read from STDIN or from an input file until its end, and up to PART_A_WORKERS blackboxes (default is the
+*   number of processors) run at once on the event loop of common/executor.c, so one thread watches all of them. Results are written in
+*   the order of the pairs: a finished result waits in a reorder buffer of PART_A_REORDER_SIZE slots (default 4 per worker) until the
+*   results before it are written, and a pair that wouldn't fit in the buffer isn't started, so one slow pair can't make it grow.
 *
 *   Coded with the help of PS6 materials io_capture.c and simpleredirect.c
 *
 *   How to run:
 *   > make
 *   > ./part_a.out binary_executable_path output_file_path
+*   > ./part_a.out binary_executable_path output_file_path stream
+*   > ./part_a.out binary_executable_path output_file_path batch [input_file_path]
 */
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
 
-int main(int argc, char **argv)
+#include "capture.h"
+#include "executor.h"
+#include "launcher.h"
+#include "options.h"
+
+// Formats the captured output as a SUCCESS or FAIL result. Returns a malloc'd string, or NULL if there isn't enough memory
+static char *format_result(struct captured_output *output)
 {
+    char *result;
 
-    int message2child[2], message2parent[2];
-    char write_buffer[256], read_buffer[256];
-    char *executable_path, *output_path;
+    if (output->status == 0)
+    {
+        result = (char *)malloc(32);
+        if (result != NULL)
+        {
+            sprintf(result, "SUCCESS:\n%d\n", atoi(output->data));
+        }
+        return result;
+    }
 
-    // Checks number of console args, if it is less than or more than 3, the program was ran wrongly
-    if (argc != 3)
+    // Checking if the returned error message ends with \n, then removing it since we add \n after it
+    if (output->length > 0 && output->data[output->length - 1] == '\n')
     {
-        printf("[ERROR] Usage: %s binary_file_path output_file_path", argv[0]);
-        return -1;
+        output->data[--output->length] = '\0';
     }
 
-    // Reading input arguments
-    executable_path = argv[1];
-    output_path = argv[2];
+    result = (char *)malloc(output->length + 8);
+    if (result != NULL)
+    {
+        memcpy(result, "FAIL:\n", 6);
+        memcpy(result + 6, output->data, output->length);
+        strcpy(result + 6 + output->length, "\n");
+    }
+    return result;
+}
+
+// Called by the executor when the blackbox of a pair finished, formats its result into the slot of the pair in the reorder buffer
+static void pair_done(struct captured_output *output, void *slot)
+{
+    char *result = format_result(output);
 
-    //Creating pipes
-    if ((pipe(message2child) == -1) || (pipe(message2parent) == -1))
+    free(output->data);
+    if (result == NULL)
     {
-        perror("[ERROR] Couldn't create pipe.");
-        return -1;
+        perror("[ERROR] Memory allocation error.");
+        exit(-1);
     }
+    *(char **)slot = result;
+}
+
+// Runs every pair of the input on the event loop of common/executor.c and writes the results in input order. Pair i goes to slot
+// i % window of the reorder buffer. Returns 0 on success, -1 on error
+static int run_batch(char *executable_path, const char *input_path, const char *output_path)
+{
+    long workers = option_int("PART_A_WORKERS", sysconf(_SC_NPROCESSORS_ONLN));
+    long window, next = 0, written = 0;
+    int input_ended = 0, a, b;
+    char write_buffer[256];
 
-    switch (fork())
+    if (workers < 1)
     {
-    case -1: // If the return value of fork() is -1, fork is failed
+        workers = 1;
+    }
+    window = option_int("PART_A_REORDER_SIZE", workers * 4);
+    if (window < workers)
+    {
+        window = workers;
+    }
 
-        perror("[ERROR] Child process couldn't be created.");
+    FILE *input = input_path == NULL ? stdin : fopen(input_path, "r");
+    if (input == NULL)
+    {
+        perror("[ERROR] Input file couldn't be opened.");
+        return -1;
+    }
+    FILE *output_file = fopen(output_path, "a");
+    if (output_file == NULL)
+    {
+        perror("[ERROR] Output file couldn't be opened.");
+        return -1;
+    }
+    char **slots = (char **)calloc(window, sizeof(char *));
+    struct executor *executor = executor_create(workers);
+    if (slots == NULL || executor == NULL)
+    {
+        perror("[ERROR] Batch couldn't be started.");
         return -1;
+    }
+
+    while (1)
+    {
+        // A pair is started when a blackbox can run and its result has a free slot, which is the case once the result of the pair
+        // window places before it is written
+        while (!input_ended && executor_running(executor) < workers && next < written + window)
+        {
+            if (fscanf(input, "%d %d", &a, &b) != 2)
+            {
+                input_ended = 1;
+                break;
+            }
+
+            struct blackbox_process blackbox;
+            if (launch_blackbox(executable_path, &blackbox) == -1)
+            {
+                perror("[ERROR] Child process couldn't be created.");
+                return -1;
+            }
+            sprintf(write_buffer, "%d %d\n", a, b);
+            if (executor_submit(executor, &blackbox, write_buffer, NULL, pair_done, &slots[next % window]) == -1)
+            {
+                perror("[ERROR] Blackbox couldn't be started.");
+                return -1;
+            }
+            next++;
+        }
 
-    case 0: // If the return value of fork() is 0, then it is the child process
+        // Results are written as soon as the ones before them are, later ones wait in their slots
+        while (written < next && slots[written % window] != NULL)
+        {
+            fputs(slots[written % window], output_file);
+            free(slots[written % window]);
+            slots[written % window] = NULL;
+            written++;
+        }
 
-        // Redirects STDIN, STDERR, STDOUT to pipes
-        if (dup2(message2child[0], STDIN_FILENO) == -1 || dup2(message2parent[1], STDOUT_FILENO) == -1 || dup2(message2parent[1], STDERR_FILENO) == -1)
+        if (input_ended && written == next)
+        {
+            break;
+        }
+        if (executor_wait(executor) == -1)
         {
-            perror("[ERROR] Couldn't bind pipes for std file descriptors.");
+            perror("[ERROR] Blackboxes couldn't be watched.");
             return -1;
         }
+    }
 
-        // Closing pipes since they are duplicated for standard file descriptors, we don't need them open
-        close(message2parent[0]);
-        close(message2parent[1]);
-        close(message2child[0]);
-        close(message2child[1]);
+    executor_destroy(executor);
+    free(slots);
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    return fclose(output_file) == 0 ? 0 : -1;
+}
 
-        // Executing program from given path
-        execl(executable_path, executable_path, NULL);
-        break;
+// Writes the result of the blackbox to the output file without holding its whole output in memory. Returns 0 on success, -1 on error
+static int write_streamed_result(struct blackbox_process *blackbox, const char *output_path)
+{
+    struct streamed_output output;
+    char last;
 
-    default: // Otherwise, current process is the main process
+    // splice() can't write to a file opened for appending, so the end of the file is found with lseek() instead
+    int output_fd = open(output_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (output_fd == -1)
+    {
+        perror("[ERROR] Output file couldn't be opened.");
+        return -1;
+    }
 
-        close(message2child[0]);  // Parent won't read from parent to child pipe
-        close(message2parent[1]); // Parent won't write to message channel from child to parent
+    if (stream_blackbox(blackbox, output_fd, "FAIL:\n", &output) == -1)
+    {
+        perror("[ERROR] Output of the blackbox couldn't be written.");
+        close(output_fd);
+        return -1;
+    }
 
-        /* Taking 2 new arguments as input for child process, and writing to the pipe connected to stdin of child process */
-        int a, b;
-        scanf("%d %d", &a, &b);
-        sprintf(write_buffer, "%d %d\n", a, b);
-        write(message2child[1], write_buffer, strlen(write_buffer));
+    if (output.streamed && output.status == 0)
+    {
+        // The long output was a successful one after all, it is replaced with the SUCCESS result
+        ftruncate(output_fd, output.start);
+        lseek(output_fd, output.start, SEEK_SET);
+        dprintf(output_fd, "SUCCESS:\n%d\n", atoi(output.prefix));
+    }
+    else if (output.streamed)
+    {
+        // The message is already in the file, it only needs to end with a newline like in the other mode
+        off_t end = lseek(output_fd, 0, SEEK_END);
+        if (pread(output_fd, &last, 1, end - 1) == 1 && last != '\n')
+        {
+            write(output_fd, "\n", 1);
+        }
+    }
+    else
+    {
+        // The whole output fit in the prefix, it is formatted the same way as in the other mode
+        lseek(output_fd, 0, SEEK_END);
+        if (output.status == 0)
+        {
+            dprintf(output_fd, "SUCCESS:\n%d\n", atoi(output.prefix));
+        }
+        else
+        {
+            if (output.prefix_length > 0 && output.prefix[output.prefix_length - 1] == '\n')
+            {
+                output.prefix[output.prefix_length - 1] = '\0';
+            }
+            dprintf(output_fd, "FAIL:\n%s\n", output.prefix);
+        }
+    }
 
-        // Waiting for child process to finish, then saving the return status
-        int status;
-        wait(&status);
+    close(output_fd);
+    return 0;
+}
 
-        // Initializing char pointer for reading from pipe
-        char *full_message;
-        full_message = (char *)malloc(sizeof(char));
-        strcpy(full_message, "");
+int main(int argc, char **argv)
+{
 
-        // Buffer size is set as 256, so parent process will read till there is nothing to read.
-        // Outputs bigger than 255 size need to be read more than once.
-        ssize_t read_size;
-        while ((read_size = read(message2parent[0], read_buffer, sizeof(read_buffer) - 1)) > 0)
-        {
-            // Creates a new local char array to hold temporary string with bigger size than full_message array
-            char temp_string[read_size + strlen(full_message) + 1];
+    struct blackbox_process blackbox;
+    char write_buffer[256];
+    char *executable_path, *output_path;
 
-            // Copies full message to the newly created temp string
-            strcpy(temp_string, full_message);
-            read_buffer[read_size] = '\0';     // Adding EOS null char to end the string
-            strcat(temp_string, read_buffer); //Concanterates newly read message to message that is read earlier
+    // Checks number of console args, it is 3 or 4, or 5 for a batch with an input file. Otherwise the program was ran wrongly
+    int batch_mode = (argc == 4 || argc == 5) && strcmp(argv[3], "batch") == 0;
+    if (!batch_mode && ((argc != 3 && argc != 4) || (argc == 4 && strcmp(argv[3], "stream") != 0)))
+    {
+        printf("[ERROR] Usage: %s binary_file_path output_file_path [stream | batch [input_file_path]]", argv[0]);
+        return -1;
+    }
 
-            // Reallocating memory and checking result
-            full_message = realloc(full_message, sizeof(temp_string));
-            if (full_message == NULL)
-            {
-                perror("[ERROR] Memory allocation error.\n");
-                return -1;
-            }
+    // Reading input arguments
+    executable_path = argv[1];
+    output_path = argv[2];
 
-            // Copies the read message to full message again
-            strcpy(full_message, temp_string);
-        }
+    if (batch_mode)
+    {
+        return run_batch(executable_path, argc == 5 ? argv[4] : NULL, output_path);
+    }
 
-        /* Creating file for output operation, and binding the file to standard output */
-        FILE *output_file;
-        output_file = fopen(output_path, "a");
+    // Creating the child process running the blackbox, with its standard file descriptors connected to pipes
+    if (launch_blackbox(executable_path, &blackbox) == -1)
+    {
+        perror("[ERROR] Child process couldn't be created.");
+        return -1;
+    }
 
-        // Checking the error status of blackbox, and printing respective output
-        if (status == 0)
-        {
-            fprintf(output_file, "SUCCESS:\n%d\n", atoi(full_message));
-        }
-        else
-        {
+    /* Taking 2 new arguments as input for child process, and writing to the pipe connected to stdin of child process */
+    int a, b;
+    scanf("%d %d", &a, &b);
+    sprintf(write_buffer, "%d %d\n", a, b);
+    write(blackbox.input_fd, write_buffer, strlen(write_buffer));
 
-            // Checking if the returned error message ends with \n, then removing it since we add \n in fprintf()
-            if (full_message[strlen(full_message)-1] == '\n'){
-                full_message[strlen(full_message)-1] = '\0';
-            }
+    if (argc == 4)
+    {
+        int result = write_streamed_result(&blackbox, output_path);
+        close(blackbox.input_fd);
+        close(blackbox.output_fd);
+        return result;
+    }
 
-            fprintf(output_file, "FAIL:\n%s\n", full_message);
-        }
+    // Reading the output while waiting for the blackbox to finish, then saving the return status. Waiting first would block forever
+    // when the output doesn't fit in the pipe
+    struct captured_output output;
+    if (capture_blackbox(&blackbox, &output) == -1)
+    {
+        perror("[ERROR] Output of the blackbox couldn't be read.");
+        return -1;
+    }
+    // Checking the error status of blackbox, and formatting the respective output
+    char *result = format_result(&output);
+    free(output.data); // Free area allocated by malloc and realloc
+    if (result == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return -1;
+    }
 
-        free(full_message); // Free area allocated by malloc and realloc
+    /* Creating file for output operation, and binding the file to standard output */
+    FILE *output_file;
+    output_file = fopen(output_path, "a");
+    fputs(result, output_file);
+    free(result);
 
-        // Close file
-        fclose(output_file);
+    // Close file
+    fclose(output_file);
 
-        // Close remaining pipes
-        close(message2child[1]);
-        close(message2parent[0]);
-    }
+    // Close remaining pipes
+    close(blackbox.input_fd);
+    close(blackbox.output_fd);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+/**
+ * @file    part_b_bench.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Benchmark measuring the throughput and latency of part_b_server under load.
+ *
+ *  Keeps LOAD_CONCURRENCY connections calling runCompiled for LOAD_DURATION seconds and prints the throughput with the latency
+ *  percentiles, see load_generator.h for all options.
+ *
+ *   How to run:
+ *   > make benchmark
+ *   > ./part_b_bench.out   server_ip_address   blackbox_path
+ *   > LOAD_RATE=2000 LOAD_TRANSPORT=tcp LOAD_JSON=result.json ./part_b_bench.out   server_ip_address   blackbox_path
+ */
+
+#include "part_b.h"
+#include "load_generator.h"
+
+int main(int argc, char *argv[])
+{
+    struct load_procedure procedure = {"runCompiled", PART_B, PART_B_VERS, runCompiled, (xdrproc_t)xdr_operands};
+
+    return load_generator_main(argc, argv, &procedure) == 0 ? 0 : 1;
+}
@@ -11,7 +11,10 @@
 *
 *   Redirecting the inputs and outputs works by creating 2 one directional pipes: first pipe connects parent to child's STDIN, second one connects child's STDOUT and 
 *   STDERR to the parent process. 
-*   Blackbox's fail or success is checked by use of wait(status), in which if status 0 blackbox runs successfully otherwise it should be an error.
+*   Blackbox's fail or success is checked by its exit status, collected through the pidfd of that blackbox, in which if status 0 blackbox runs successfully
+*   otherwise it should be an error.
+*   Blackbox processes are taken from the warm pool in common/blackbox_pool.c, which spawns them on demand when the pool is disabled or empty.
+*   The output is read by common/capture.c while the blackbox runs, so a blackbox with an output bigger than the pipe buffer can finish.
 *
 *   This code is referenced from PS6's rpc tutorials and io_capture.c and simpleredirect.c
 *
@@ -22,6 +25,8 @@
 */
 
 #include "part_b.h"
+#include "blackbox_pool.h"
+#include "capture.h"
 #include <sys/wait.h>
 
 
@@ -31,125 +36,62 @@ runcompiled_1_svc(operands *argp, struct svc_req *rqstp)
 
     static char *result;
 
-    int message2child[2], message2parent[2];
-    char write_buffer[256], read_buffer[256];
-
-    //Creating pipes
-    if ((pipe(message2child) == -1) || (pipe(message2parent) == -1))
-    {
-        perror("[ERROR] Couldn't create pipe.");
-        exit(-1);
-    }
+    struct blackbox_process blackbox;
+    char write_buffer[256];
 
     // Clearing results from previous calls to the function
     xdr_free((xdrproc_t)xdr_wrapstring, (char *)&result);
 
-    // Creates a child process
-    switch (fork())
+    // Takes an already running blackbox from the pool, or creates a child process with its pipes if there is none ready
+    if (blackbox_pool_acquire(argp->executable_path, &blackbox) == -1)
     {
-    // If return value of fork() is -1, then there was an error creating child process
-    case -1:
-        perror("[ERROR] Failed fork process.");
+        perror("[ERROR] Failed to start blackbox process.");
         exit(-1);
+    }
 
-    // If return of fork() is 0, then this is the child process
-    case 0:
-
-        // Redirecting STDIN, STDOUT and STDERR to the pipes
-        if (dup2(message2child[0], STDIN_FILENO) == -1 || dup2(message2parent[1], STDOUT_FILENO) == -1 || dup2(message2parent[1], STDERR_FILENO) == -1)
-        {
-            perror("[ERROR] There was an error binding pipes for standard file descriptors.");
-            exit(-1);
-        }
-
-        // Closing pipes since they are duplicated for standard file descriptors, we don't need them open
-        close(message2parent[0]);
-        close(message2parent[1]);
-        close(message2child[0]);
-        close(message2child[1]);
-
-        execl(argp->executable_path, argp->executable_path, NULL);
-
-    // If the return value is not 0 or -1, then it should be the parent process
-    default:
-
-        close(message2child[0]);  // Parent won't read from parent to child pipe
-        close(message2parent[1]); // Parent won't write to message channel from child to parent
-
-        /* Taking 2 new arguments as input for child process */
-        sprintf(write_buffer, "%d %d\n", argp->a, argp->b);
-        // Redirecting the input to child process as standard input
-        write(message2child[1], write_buffer, strlen(write_buffer));
-
-        // Waiting for child process to finish, then saving the return status
-        int status;
-        wait(&status);
-
-        // Initializing char pointer for reading from pipe
-        char *full_message;
-        full_message = (char *)malloc(sizeof(char));
-        strcpy(full_message, "");
-
-        // Buffer size is set as 256, so parent process will read till there is nothing to read.
-        // Since outputs bigger than 255 size needs to be read more than once.
-        ssize_t read_size;
-        while ((read_size = read(message2parent[0], read_buffer, sizeof(read_buffer) - 1)) > 0)
-        {
-            // Creates a new local char array to hold temporary string with bigger size than full_message array
-            char read_message[read_size + strlen(full_message) + 1];
-
-            // Copies full message to the newly created temp string
-            strcpy(read_message, full_message);
-            read_buffer[read_size] = '\0';     // Adding EOS null char to end the string
-            strcat(read_message, read_buffer); //Concanterates newly read message to message that is read earlier
-
-            // Reallocating memory and checking result
-            full_message = realloc(full_message, sizeof(read_message));
-            if (full_message == NULL)
-            {
-                perror("[ERROR] Memory allocation error.\n");
-                exit(-1);
-            }
-
-            // Copies the read message to full message again
-            strcpy(full_message, read_message);
-        }
+    /* Taking 2 new arguments as input for child process */
+    sprintf(write_buffer, "%d %d\n", argp->a, argp->b);
+    // Redirecting the input to child process as standard input
+    write(blackbox.input_fd, write_buffer, strlen(write_buffer));
 
-        // Checking the error status of blackbox, and printing respective output
-        if (status == 0)
-        {
-            // Creating a temp string with enough space for full message and SUCCESS title
-            char temp_string[strlen(full_message) + 10];
-            // SUCCESS and full message are formatted and concentrated
-            sprintf(temp_string, "SUCCESS:\n%d\n", atoi(full_message));
+    // Reading the output while waiting for the blackbox to finish, then saving the return status. Waiting first would block forever
+    // when the output doesn't fit in the pipe
+    struct captured_output output;
+    if (capture_blackbox(&blackbox, &output) == -1)
+    {
+        perror("[ERROR] Output of the blackbox couldn't be read.");
+        exit(-1);
+    }
+    int status = output.status;
+    char *full_message = output.data;
 
-            // Reserves heap memory space for the result to be copied
-            result = (char *)malloc(sizeof(temp_string));
-            strcpy(result, temp_string);
-        }
-        else
+    // Checking the error status of blackbox, and printing respective output
+    if (status == 0)
+    {
+        // SUCCESS title and the returned number are formatted directly into the result
+        result = (char *)malloc(32);
+        sprintf(result, "SUCCESS:\n%d\n", atoi(full_message));
+    }
+    else
+    {
+        // Checking if the returned error message ends with \n, then removing it since we add \n after it
+        if (output.length > 0 && full_message[output.length - 1] == '\n')
         {
-            // Checking if the returned error message ends with \n, then removing it since we add \n in fprintf()
-            if (full_message[strlen(full_message) - 1] == '\n')
-                full_message[strlen(full_message) - 1] = '\0';
-
-            // Creating a temp string with enough space for full message and FAIL title
-            char temp_string[strlen(full_message) + 7];
-            sprintf(temp_string, "FAIL:\n%s\n", full_message);
-
-            // Reserves heap memory space for the result to be copied
-            result = (char *)malloc(sizeof(temp_string));
-            strcpy(result, temp_string);
+            full_message[--output.length] = '\0';
         }
 
-        free(full_message); // Free area allocated by malloc and realloc
+        // The message is copied once into the result after the FAIL title. Outputs can be megabytes, so there is no temporary copy on the stack
+        result = (char *)malloc(output.length + 8);
+        memcpy(result, "FAIL:\n", 6);
+        memcpy(result + 6, full_message, output.length);
+        strcpy(result + 6 + output.length, "\n");
+    }
 
-        // Closing remaining pipes
-        close(message2child[1]);
-        close(message2parent[0]);
+    free(full_message); // Free area allocated by malloc and realloc
 
-        break;
-    }
+    // Closing remaining pipes
+    close(blackbox.input_fd);
+    close(blackbox.output_fd);
 
     return &result;
 }
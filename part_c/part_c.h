@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <string.h>
 
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,6 +26,69 @@ struct arguments {
 };
 typedef struct arguments arguments;
 
+struct limited_arguments {
+	char *executable_path;
+	int a;
+	int b;
+	int wall_timeout_ms;
+	int cpu_timeout_ms;
+};
+typedef struct limited_arguments limited_arguments;
+
+struct operands {
+	int a;
+	int b;
+};
+typedef struct operands operands;
+
+struct batch_arguments {
+	char *executable_path;
+	struct {
+		u_int pairs_len;
+		operands *pairs_val;
+	} pairs;
+};
+typedef struct batch_arguments batch_arguments;
+
+typedef char *result_message;
+
+struct batch_results {
+	struct {
+		u_int results_len;
+		result_message *results_val;
+	} results;
+};
+typedef struct batch_results batch_results;
+
+struct phase_stats {
+	char *name;
+	u_quad_t count;
+	u_quad_t total_ns;
+	u_quad_t min_ns;
+	u_quad_t max_ns;
+	u_quad_t p50_ns;
+	u_quad_t p90_ns;
+	u_quad_t p99_ns;
+	u_quad_t p999_ns;
+};
+typedef struct phase_stats phase_stats;
+
+struct server_stats {
+	u_quad_t elapsed_ns;
+	u_quad_t cache_hits;
+	u_quad_t successes;
+	u_quad_t failures;
+	u_quad_t timeouts;
+	u_quad_t log_dropped;
+	struct {
+		u_int phases_len;
+		phase_stats *phases_val;
+	} phases;
+};
+typedef struct server_stats server_stats;
+
+typedef char *trace_document;
+
 #define PART_C 0x12345678
 #define PART_C_VERS 1
 
@@ -32,12 +96,36 @@ typedef struct arguments arguments;
 #define run_binary 1
 extern  char ** run_binary_1(arguments *, CLIENT *);
 extern  char ** run_binary_1_svc(arguments *, struct svc_req *);
+#define run_binary_batch 2
+extern  batch_results * run_binary_batch_1(batch_arguments *, CLIENT *);
+extern  batch_results * run_binary_batch_1_svc(batch_arguments *, struct svc_req *);
+#define run_binary_limited 3
+extern  char ** run_binary_limited_1(limited_arguments *, CLIENT *);
+extern  char ** run_binary_limited_1_svc(limited_arguments *, struct svc_req *);
+#define get_stats 4
+extern  server_stats * get_stats_1(int *, CLIENT *);
+extern  server_stats * get_stats_1_svc(int *, struct svc_req *);
+#define get_trace 5
+extern  trace_document * get_trace_1(int *, CLIENT *);
+extern  trace_document * get_trace_1_svc(int *, struct svc_req *);
 extern int part_c_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
 #define run_binary 1
 extern  char ** run_binary_1();
 extern  char ** run_binary_1_svc();
+#define run_binary_batch 2
+extern  batch_results * run_binary_batch_1();
+extern  batch_results * run_binary_batch_1_svc();
+#define run_binary_limited 3
+extern  char ** run_binary_limited_1();
+extern  char ** run_binary_limited_1_svc();
+#define get_stats 4
+extern  server_stats * get_stats_1();
+extern  server_stats * get_stats_1_svc();
+#define get_trace 5
+extern  trace_document * get_trace_1();
+extern  trace_document * get_trace_1_svc();
 extern int part_c_1_freeresult ();
 #endif /* K&R C */
 
@@ -45,9 +133,25 @@ extern int part_c_1_freeresult ();
 
 #if defined(__STDC__) || defined(__cplusplus)
 extern  bool_t xdr_arguments (XDR *, arguments*);
+extern  bool_t xdr_limited_arguments (XDR *, limited_arguments*);
+extern  bool_t xdr_operands (XDR *, operands*);
+extern  bool_t xdr_batch_arguments (XDR *, batch_arguments*);
+extern  bool_t xdr_result_message (XDR *, result_message*);
+extern  bool_t xdr_batch_results (XDR *, batch_results*);
+extern  bool_t xdr_phase_stats (XDR *, phase_stats*);
+extern  bool_t xdr_server_stats (XDR *, server_stats*);
+extern  bool_t xdr_trace_document (XDR *, trace_document*);
 
 #else /* K&R C */
 extern bool_t xdr_arguments ();
+extern bool_t xdr_limited_arguments ();
+extern bool_t xdr_operands ();
+extern bool_t xdr_batch_arguments ();
+extern bool_t xdr_result_message ();
+extern bool_t xdr_batch_results ();
+extern bool_t xdr_phase_stats ();
+extern bool_t xdr_server_stats ();
+extern bool_t xdr_trace_document ();
 
 #endif /* K&R C */
 
@@ -5,6 +5,61 @@ struct arguments{
 	int b;
 };
 
+/* Arguments with time limits for this call, 0 uses the limit of the server */
+struct limited_arguments{
+	string executable_path<>;
+	int a;
+	int b;
+	int wall_timeout_ms;
+	int cpu_timeout_ms;
+};
+
+/* A pair of numbers to feed to the blackbox */
+struct operands{
+	int a;
+	int b;
+};
+
+/* Arguments of a batch, all pairs are run with the same blackbox */
+struct batch_arguments{
+	string executable_path<>;
+	operands pairs<>;
+};
+
+/* Results of a batch, in the same order as the pairs */
+typedef string result_message<>;
+
+struct batch_results{
+	result_message results<>;
+};
+
+/* Timing of one phase of the requests, in nanoseconds */
+struct phase_stats{
+	string name<>;
+	unsigned hyper count;
+	unsigned hyper total_ns;
+	unsigned hyper min_ns;
+	unsigned hyper max_ns;
+	unsigned hyper p50_ns;
+	unsigned hyper p90_ns;
+	unsigned hyper p99_ns;
+	unsigned hyper p999_ns;
+};
+
+/* Counters and phase timings of the server since it started or was last reset */
+struct server_stats{
+	unsigned hyper elapsed_ns;
+	unsigned hyper cache_hits;
+	unsigned hyper successes;
+	unsigned hyper failures;
+	unsigned hyper timeouts;
+	unsigned hyper log_dropped;
+	phase_stats phases<>;
+};
+
+/* Chrome trace-event JSON of the flight recorder, unlike a string result it isn't limited to 9000 bytes by libtirpc */
+typedef string trace_document<>;
+
 /* 
  * 1. Name the program and give it a unique number.
  * 2. Specify the version of the program.
@@ -14,5 +69,13 @@ program PART_C{
 	version PART_C_VERS{
 		/* Takes a numbers structure and gives the integer result. */
 		string run_binary(arguments)=1;
+		/* Takes many pairs for one blackbox and gives the result of each pair. */
+		batch_results run_binary_batch(batch_arguments)=2;
+		/* Same as run_binary, with its own time limits. A blackbox passing them gives a TIMEOUT result. */
+		string run_binary_limited(limited_arguments)=3;
+		/* Gives the timings of the server, which are cleared after reading when the argument isn't 0. */
+		server_stats get_stats(int)=4;
+		/* Gives the spans of the flight recorder that ended in the given last seconds as Chrome trace-event JSON, 0 for the default. */
+		trace_document get_trace(int)=5;
 	}=1;
 }=0x12345678;
\ No newline at end of file
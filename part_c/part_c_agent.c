@@ -0,0 +1,489 @@
+/**
+ * @file    part_c_agent.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Local agent that keeps persistent TCP connections to part_c servers and relays the calls of part_c_client to them.
+ *
+ *  Every part_c_client invocation used to look the server up in the portmapper and create a new socket for its single call. With
+ *  PART_C_AGENT_SOCKET set, the client connects to this agent over a UNIX socket instead and sends it two records: the server address
+ *  given on its command line, then its encoded call. The agent sends the call over its connection to that server, which is opened on
+ *  the first call for the address and then kept, and sends the reply back to the client. Calls of many clients share a connection,
+ *  so the agent gives every call its own XID on the connection and puts the XID of the client back into the reply.
+ *
+ *  A single thread watches the UNIX socket, the clients and the server connections with epoll, every socket is non-blocking. Opening a
+ *  server connection is the only blocking step, it happens once per address. When a server connection breaks, the clients waiting on
+ *  it are disconnected, so they report a failed call, and the next call opens a new connection. Replies for clients that already left
+ *  are dropped.
+ *
+ *  Server addresses given as arguments are connected to at start. The server port is asked from the portmapper once per address,
+ *  unless PART_C_SERVER_PORT gives it. Options are read from environment variables:
+ *      PART_C_AGENT_SOCKET     Path of the UNIX socket (default /tmp/part_c_agent.sock)
+ *
+ *  How to run:
+ *  > make
+ *  > ./part_c_agent.out   [server_ip_address...]
+ *  > PART_C_AGENT_SOCKET=/tmp/part_c_agent.sock ./part_c_client.out   blackbox_path   output_path   server_ip_address
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_stream.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 64
+#define PENDING_BUCKETS 4096
+
+// A client or server connection of the agent
+struct agent_connection
+{
+    int fd;
+    int is_server;
+    int closed;    // The socket is closed, the struct is freed once no call refers to it
+    int collected; // Already on the list of connections to free
+    int writing;   // EPOLLOUT is watched, while output has unsent data
+    struct record_reader reader;
+    struct stream_buffer output;
+    size_t sent;
+    int pending;                   // Calls waiting for their reply
+    char *host;                    // Server address of the connection, for a client NULL until its first record
+    struct agent_connection *next; // Next server connection, or next connection to free
+};
+
+// A relayed call waiting for its reply
+struct pending_call
+{
+    u_int32_t xid;
+    u_int32_t client_xid;
+    struct agent_connection *client;
+    struct agent_connection *server;
+    struct pending_call *next;
+};
+
+static int epoll_fd;
+static u_int32_t next_xid;
+static struct pending_call *pending_calls[PENDING_BUCKETS];
+static struct agent_connection *servers;
+static struct agent_connection *garbage; // Closed connections to free after the current events
+
+static void close_connection(struct agent_connection *connection);
+
+// Frees the closed connections that no call refers to anymore
+static void collect_garbage(void)
+{
+    while (garbage != NULL)
+    {
+        struct agent_connection *connection = garbage;
+        garbage = connection->next;
+        record_reader_free(&connection->reader);
+        free(connection->output.data);
+        free(connection->host);
+        free(connection);
+    }
+}
+
+// Frees the connection after the current events if it is closed and no call refers to it
+static void release_if_unused(struct agent_connection *connection)
+{
+    if (connection->closed && connection->pending == 0 && !connection->collected)
+    {
+        connection->collected = 1;
+        connection->next = garbage;
+        garbage = connection;
+    }
+}
+
+// Watches the socket for being writable only while there is output waiting
+static void update_events(struct agent_connection *connection)
+{
+    struct epoll_event event;
+    int writing = connection->sent < connection->output.length;
+
+    if (writing != connection->writing)
+    {
+        event.events = EPOLLIN | EPOLLRDHUP | (writing ? EPOLLOUT : 0);
+        event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->writing = writing;
+    }
+}
+
+// Writes as much of the output as the socket takes without blocking
+static void flush_connection(struct agent_connection *connection)
+{
+    while (connection->sent < connection->output.length)
+    {
+        ssize_t written = send(connection->fd, connection->output.data + connection->sent, connection->output.length - connection->sent,
+                               MSG_NOSIGNAL);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                close_connection(connection);
+                return;
+            }
+            break;
+        }
+        connection->sent += written;
+    }
+
+    if (connection->sent == connection->output.length)
+    {
+        connection->sent = connection->output.length = 0;
+    }
+    update_events(connection);
+}
+
+// Removes the pending call of the xid from the table and returns it, NULL when there isn't one
+static struct pending_call *take_pending_call(u_int32_t xid)
+{
+    struct pending_call **link = &pending_calls[xid % PENDING_BUCKETS];
+
+    while (*link != NULL && (*link)->xid != xid)
+    {
+        link = &(*link)->next;
+    }
+
+    struct pending_call *call = *link;
+    if (call != NULL)
+    {
+        *link = call->next;
+    }
+    return call;
+}
+
+// Forgets a pending call, and frees its connections if they were waiting for it
+static void finish_call(struct pending_call *call)
+{
+    call->client->pending--;
+    call->server->pending--;
+    release_if_unused(call->client);
+    release_if_unused(call->server);
+    free(call);
+}
+
+// Closes the socket of the connection. The clients waiting for a broken server connection are disconnected, so they report the failure
+static void close_connection(struct agent_connection *connection)
+{
+    if (connection->closed)
+    {
+        return;
+    }
+    connection->closed = 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+
+    if (connection->is_server)
+    {
+        struct agent_connection **link = &servers;
+        while (*link != NULL && *link != connection)
+        {
+            link = &(*link)->next;
+        }
+        if (*link != NULL)
+        {
+            *link = connection->next;
+        }
+
+        for (int i = 0; i < PENDING_BUCKETS; i++)
+        {
+            struct pending_call **call_link = &pending_calls[i];
+            while (*call_link != NULL)
+            {
+                struct pending_call *call = *call_link;
+                if (call->server != connection)
+                {
+                    call_link = &call->next;
+                    continue;
+                }
+                *call_link = call->next;
+                close_connection(call->client);
+                finish_call(call);
+            }
+        }
+    }
+
+    release_if_unused(connection);
+}
+
+// Returns the connection to the server at host, opening it if there isn't one. NULL when the server can't be reached
+static struct agent_connection *server_connection(const char *host)
+{
+    struct agent_connection *server;
+    struct epoll_event event;
+    int enabled = 1;
+
+    for (server = servers; server != NULL; server = server->next)
+    {
+        if (strcmp(server->host, host) == 0)
+        {
+            return server;
+        }
+    }
+
+    int fd = stream_connect(host);
+    if (fd == -1)
+    {
+        fprintf(stderr, "[WARNING] Couldn't connect to the server at %s.\n", host);
+        return NULL;
+    }
+
+    // Calls are small and sent one by one, they shouldn't wait for each other
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    server = (struct agent_connection *)calloc(1, sizeof(struct agent_connection));
+    if (server == NULL || (server->host = strdup(host)) == NULL || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        perror("[ERROR] Couldn't set up the server connection.");
+        close(fd);
+        if (server != NULL)
+        {
+            free(server->host);
+            free(server);
+        }
+        return NULL;
+    }
+    server->fd = fd;
+    server->is_server = 1;
+
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = server;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        perror("[ERROR] Couldn't watch the server connection.");
+        close(fd);
+        free(server->host);
+        free(server);
+        return NULL;
+    }
+
+    server->next = servers;
+    servers = server;
+    return server;
+}
+
+// Handles a record of a client: the first one is the server address, the next ones are calls for that server
+static void handle_client_record(char *record, size_t length, void *context)
+{
+    struct agent_connection *client = context;
+    u_int32_t xid;
+
+    if (client->closed)
+    {
+        return;
+    }
+
+    if (client->host == NULL)
+    {
+        client->host = strndup(record, length);
+        if (client->host == NULL)
+        {
+            close_connection(client);
+        }
+        return;
+    }
+
+    // Looked up for every call, a connection that broke since the last one is opened again
+    struct agent_connection *server = server_connection(client->host);
+    struct pending_call *call = (struct pending_call *)malloc(sizeof(struct pending_call));
+    if (length < 4 || server == NULL || call == NULL)
+    {
+        free(call);
+        close_connection(client);
+        return;
+    }
+
+    // The call goes to the server with an xid that is unique on its connection
+    memcpy(&xid, record, 4);
+    call->client_xid = xid;
+    call->xid = next_xid++;
+    xid = htonl(call->xid);
+    memcpy(record, &xid, 4);
+    if (stream_append_record(&server->output, record, length) == -1)
+    {
+        free(call);
+        close_connection(client);
+        return;
+    }
+
+    call->client = client;
+    call->server = server;
+    call->next = pending_calls[call->xid % PENDING_BUCKETS];
+    pending_calls[call->xid % PENDING_BUCKETS] = call;
+    client->pending++;
+    server->pending++;
+
+    flush_connection(server);
+}
+
+// Handles a reply of a server by sending it to the client of its call, with the xid the client gave
+static void handle_server_record(char *record, size_t length, void *context)
+{
+    struct pending_call *call = take_pending_call(stream_reply_xid(record, length));
+
+    (void)context;
+    if (call == NULL)
+    {
+        return;
+    }
+
+    struct agent_connection *client = call->client;
+    if (!client->closed)
+    {
+        memcpy(record, &call->client_xid, 4);
+        if (stream_append_record(&client->output, record, length) == -1)
+        {
+            close_connection(client);
+        }
+        else
+        {
+            flush_connection(client);
+        }
+    }
+    finish_call(call);
+}
+
+// Reads everything the connection has and handles its complete records
+static void read_connection(struct agent_connection *connection)
+{
+    unsigned char data[65536];
+
+    while (!connection->closed)
+    {
+        ssize_t length = read(connection->fd, data, sizeof(data));
+        if (length == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length == -1 && errno == EAGAIN)
+        {
+            return;
+        }
+        if (length <= 0 ||
+            record_reader_feed(&connection->reader, data, length, connection->is_server ? handle_server_record : handle_client_record,
+                               connection) == -1)
+        {
+            close_connection(connection);
+            return;
+        }
+    }
+}
+
+// Accepts every waiting client and adds them to epoll
+static void accept_clients(int listener)
+{
+    struct epoll_event event;
+    int fd;
+
+    while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        struct agent_connection *client = (struct agent_connection *)calloc(1, sizeof(struct agent_connection));
+        if (client == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+        {
+            close(fd);
+            free(client);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct sockaddr_un address;
+    const char *socket_path = option_string("PART_C_AGENT_SOCKET", "/tmp/part_c_agent.sock");
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "[ERROR] Socket path %s is too long.\n", socket_path);
+        exit(1);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // A socket file left by an agent that was stopped would make the bind fail
+    unlink(socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(listener, SOMAXCONN) == -1)
+    {
+        perror("[ERROR] Couldn't create the agent socket.");
+        exit(1);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {EPOLLIN, {.ptr = NULL}};
+    if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event) == -1)
+    {
+        perror("[ERROR] Couldn't create epoll instance.");
+        exit(1);
+    }
+
+    next_xid = (u_int32_t)getpid() << 16;
+    for (int i = 1; i < argc; i++)
+    {
+        server_connection(argv[i]);
+    }
+
+    while (1)
+    {
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("[ERROR] Waiting for connections failed");
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            struct agent_connection *connection = events[i].data.ptr;
+
+            if (connection == NULL)
+            {
+                accept_clients(listener);
+                continue;
+            }
+            if (!connection->closed && (events[i].events & EPOLLOUT))
+            {
+                flush_connection(connection);
+            }
+            if (!connection->closed && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            {
+                read_connection(connection);
+            }
+        }
+
+        // Connections closed by these events may still be referred to by later events of the same batch until here
+        collect_garbage();
+    }
+
+    close(listener);
+    unlink(socket_path);
+    return 1;
+}
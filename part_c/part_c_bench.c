@@ -0,0 +1,24 @@
+/**
+ * @file    part_c_bench.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Benchmark measuring the throughput and latency of part_c_server under load.
+ *
+ *  Keeps LOAD_CONCURRENCY connections calling run_binary for LOAD_DURATION seconds and prints the throughput with the latency
+ *  percentiles, see load_generator.h for all options. LOAD_DISTRIBUTION=zipf gives the skewed inputs the result cache is made for.
+ *
+ *   How to run:
+ *   > make benchmark
+ *   > ./part_c_bench.out   server_ip_address   blackbox_path
+ *   > LOAD_DISTRIBUTION=zipf LOAD_RATE=2000 LOAD_JSON=result.json ./part_c_bench.out   server_ip_address   blackbox_path
+ */
+
+#include "part_c.h"
+#include "load_generator.h"
+
+int main(int argc, char *argv[])
+{
+    struct load_procedure procedure = {"run_binary", PART_C, PART_C_VERS, run_binary, (xdrproc_t)xdr_arguments};
+
+    return load_generator_main(argc, argv, &procedure) == 0 ? 0 : 1;
+}
@@ -7,41 +7,90 @@
  *	This program reads the command line arguments and sends executable_path to the server. Then it scans for 2 integer user inputs
  *	which will be sent to the server for calculation by blackbox on executable_path. Then the result is returned with SUCCESS or FAIL
  *	title from the server, returned message is directly printed to output file given in command line arguments.
+ *	With PART_C_CALL_TIMEOUT_MS or PART_C_CALL_CPU_TIMEOUT_MS set, the call is sent as run_binary_limited with these wall clock and
+ *	CPU time limits, and a blackbox passing one of them returns a TIMEOUT result.
+ *
+ *	In batch mode, pairs are read from STDIN until its end and sent to the server in run_binary_batch calls over TCP, each carrying
+ *	up to PART_C_BATCH_SIZE pairs (default 4096). All results are written to the output file with one buffered write at the end.
+ *
+ *	In pipeline mode, pairs are read from STDIN and sent as run_binary calls over one TCP connection, keeping up to PART_C_WINDOW calls
+ *	(default 32) waiting for their replies at once. Replies are matched to their pairs by XID, and results are written to the output
+ *	file in the order of the pairs.
+ *
+ *	With PART_C_AGENT_SOCKET set, a single call is sent through the agent listening on that UNIX socket (part_c_agent.c), which
+ *	keeps its connections to the servers open between invocations. When the agent isn't running the call is made directly.
+ *
+ *	server_ip_address can also be a comma separated list of servers, or "@file" naming a file that lists them. Every pair is then
+ *	sent to the server chosen by consistent hashing of (executable_path, a, b) (part_c_shard.h), in every mode: batch mode sends
+ *	each server a batch of its own pairs, and pipeline mode keeps a connection to each server, while the results are still written
+ *	in the order of the pairs. A server that can't be reached or fails a call is left out, and its pairs are sent to the servers
+ *	that take its keys.
  *
  *   How to run:
  *   > make
  *   > ./part_c_client.out   blackbox_path       output_path     server_ip_address
+ *   > PART_C_CALL_TIMEOUT_MS=500 ./part_c_client.out   blackbox_path       output_path     server_ip_address
+ *   > ./part_c_client.out   blackbox_path       output_path     server_ip_address   batch
+ *   > ./part_c_client.out   blackbox_path       output_path     server_ip_address   pipeline
+ *   > PART_C_AGENT_SOCKET=/tmp/part_c_agent.sock ./part_c_client.out   blackbox_path       output_path     server_ip_address
+ *   > ./part_c_client.out   blackbox_path       output_path     10.0.0.1,10.0.0.2,10.0.0.3:9752   pipeline
  * 
  */
 
 #include "part_c.h"
+#include "part_c_shard.h"
+#include "part_c_stream.h"
+#include "options.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+// Outcome of a single call. A call that didn't succeed is tried on the next server of the pair, and when every server was tried, the
+// client exits with the status it always had for the last outcome: 1 when no client could be created, 0 when the call failed
+enum call_outcome
+{
+	CALL_SUCCEEDED,
+	CALL_FAILED,
+	CALL_UNREACHABLE
+};
 
-void part_c_1(char *host, char *runnable_path, char *output_path)
+// Sends the pair to the server
+enum call_outcome part_c_1(const struct shard_server *server, char *runnable_path, char *output_path, int x, int y)
 {
 	CLIENT *clnt;
 	char **result_1;
 	arguments run_binary_1_arg;
 
 #ifndef DEBUG
-	clnt = clnt_create(host, PART_C, PART_C_VERS, "udp");
+	clnt = shard_client_create(server, "udp");
 	if (clnt == NULL)
 	{
-		clnt_pcreateerror(host);
-		exit(1);
+		clnt_pcreateerror(server->name);
+		return CALL_UNREACHABLE;
 	}
 #endif /* DEBUG */
 
-	// Scanning input from STDIN (user input)
-	int x, y;
-	scanf("%d %d", &x, &y);
-
 	// Read inputs are stored in struct
 	run_binary_1_arg.a = x;
 	run_binary_1_arg.b = y;
 	run_binary_1_arg.executable_path = runnable_path;
 
+	// Limits of the call, which replace the ones of the server when they are given
+	limited_arguments run_binary_limited_1_arg = {runnable_path, x, y, option_int("PART_C_CALL_TIMEOUT_MS", 0),
+		option_int("PART_C_CALL_CPU_TIMEOUT_MS", 0)};
+
 	// handling response from server, checking if the return is a null pointer
-	result_1 = run_binary_1(&run_binary_1_arg, clnt);
+	if (run_binary_limited_1_arg.wall_timeout_ms > 0 || run_binary_limited_1_arg.cpu_timeout_ms > 0)
+	{
+		result_1 = run_binary_limited_1(&run_binary_limited_1_arg, clnt);
+	}
+	else
+	{
+		result_1 = run_binary_1(&run_binary_1_arg, clnt);
+	}
 	if (result_1 == (char **)NULL)
 	{
 		clnt_perror(clnt, "call failed");
@@ -58,25 +107,656 @@ void part_c_1(char *host, char *runnable_path, char *output_path)
 #ifndef DEBUG
 	clnt_destroy(clnt);
 #endif /* DEBUG */
+	return result_1 == (char **)NULL ? CALL_FAILED : CALL_SUCCEEDED;
+}
+
+// Reply of the call sent through the agent
+struct agent_reply
+{
+	int received;
+	enum clnt_stat status;
+	char *result;
+};
+
+// Decodes the reply record of the call
+static void handle_agent_reply(char *record, size_t length, void *data)
+{
+	struct agent_reply *reply = data;
+
+	if (!reply->received)
+	{
+		reply->status = stream_decode_reply(record, length, (xdrproc_t)xdr_wrapstring, &reply->result);
+		reply->received = 1;
+	}
+}
+
+// Connects to the agent of PART_C_AGENT_SOCKET, returns the socket or -1 when it isn't set or the agent isn't running
+static int agent_connect(void)
+{
+	struct sockaddr_un address;
+	const char *socket_path = option_string("PART_C_AGENT_SOCKET", "");
+	int fd;
+
+	if (socket_path[0] == '\0' || strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd != -1 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+	{
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+// Same as part_c_1, with the call sent through the agent connected to fd. The first record tells the agent which server to call
+enum call_outcome part_c_agent_1(int fd, char *host, char *runnable_path, char *output_path, int x, int y)
+{
+	struct stream_buffer calls = {NULL, 0, 0};
+	struct record_reader reader;
+	struct agent_reply reply = {0, RPC_SUCCESS, NULL};
+	int appended, failed = 0;
+
+	// Limits of the call, which replace the ones of the server when they are given
+	arguments run_binary_1_arg = {runnable_path, x, y};
+	limited_arguments run_binary_limited_1_arg = {runnable_path, x, y, option_int("PART_C_CALL_TIMEOUT_MS", 0),
+		option_int("PART_C_CALL_CPU_TIMEOUT_MS", 0)};
+
+	// The agent gives the call its own xid on the server connection
+	appended = stream_append_record(&calls, host, strlen(host)) == 0;
+	if (run_binary_limited_1_arg.wall_timeout_ms > 0 || run_binary_limited_1_arg.cpu_timeout_ms > 0)
+	{
+		appended = appended && stream_append_call(&calls, 1, run_binary_limited, (xdrproc_t)xdr_limited_arguments, &run_binary_limited_1_arg) == 0;
+	}
+	else
+	{
+		appended = appended && stream_append_call(&calls, 1, run_binary, (xdrproc_t)xdr_arguments, &run_binary_1_arg) == 0;
+	}
+	if (!appended)
+	{
+		fprintf(stderr, "%s", "couldn't encode call\n");
+		exit(1);
+	}
+
+	for (size_t sent = 0; sent < calls.length && !failed;)
+	{
+		ssize_t written = send(fd, calls.data + sent, calls.length - sent, MSG_NOSIGNAL);
+		if (written == -1 && errno != EINTR)
+		{
+			perror("call failed");
+			failed = 1;
+		}
+		sent += written > 0 ? written : 0;
+	}
+
+	// Waiting for the reply as long as clnt_call would. The agent closes the connection when it can't reach the server
+	memset(&reader, 0, sizeof(reader));
+	while (!reply.received && !failed)
+	{
+		struct pollfd events = {fd, POLLIN, 0};
+		int ready = poll(&events, 1, 25000);
+		if (ready == 0)
+		{
+			fprintf(stderr, "%s", "call failed: RPC: Timed out\n");
+			failed = 1;
+			break;
+		}
+		if (ready == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("[ERROR] poll failed");
+			exit(1);
+		}
+
+		unsigned char data[65536];
+		ssize_t length = read(fd, data, sizeof(data));
+		if (length == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (length <= 0)
+		{
+			fprintf(stderr, "%s", "call failed: connection closed by the agent\n");
+			failed = 1;
+		}
+		else if (record_reader_feed(&reader, data, length, handle_agent_reply, &reply) == -1)
+		{
+			fprintf(stderr, "%s", "call failed: RPC: Can't decode result\n");
+			failed = 1;
+		}
+	}
+
+	if (!failed && reply.status != RPC_SUCCESS)
+	{
+		fprintf(stderr, "call failed: %s\n", clnt_sperrno(reply.status));
+	}
+	else if (!failed)
+	{
+		// Opening file for output operation, and printing the result to the file
+		FILE *output_file;
+		output_file = fopen(output_path, "a");
+		fprintf(output_file, "%s", reply.result);
+		fclose(output_file);
+	}
+
+	xdr_free((xdrproc_t)xdr_wrapstring, (char *)&reply.result);
+	record_reader_free(&reader);
+	free(calls.data);
+	close(fd);
+
+	// Without a reply the agent couldn't reach the server, a reply with an error is a failed call
+	if (failed)
+	{
+		return CALL_UNREACHABLE;
+	}
+	return reply.status != RPC_SUCCESS ? CALL_FAILED : CALL_SUCCEEDED;
+}
+
+// Runs the pairs on one server with run_binary_batch calls, moving each result into results at the index of its pair. Returns -1 when
+// the server couldn't be reached or a call failed, the pairs without a result are then left for the other servers
+static int part_c_shard_batch_1(const struct shard_server *server, char *runnable_path, operands *pairs, u_int *indices, u_int count,
+	long batch_size, char **results)
+{
+	CLIENT *clnt;
+	batch_results *result_1;
+	batch_arguments run_binary_batch_1_arg;
+	struct timeval timeout = {300, 0};
+
+	// Batch replies are bigger than a UDP datagram, so batches are always sent over TCP
+	clnt = shard_client_create(server, "tcp");
+	if (clnt == NULL)
+	{
+		clnt_pcreateerror(server->name);
+		return -1;
+	}
+
+	// A batch takes as long as its slowest pairs, the default 25 second timeout isn't enough for big batches
+	clnt_control(clnt, CLSET_TIMEOUT, (char *)&timeout);
+
+	run_binary_batch_1_arg.executable_path = runnable_path;
+	for (u_int sent = 0; sent < count; sent += run_binary_batch_1_arg.pairs.pairs_len)
+	{
+		run_binary_batch_1_arg.pairs.pairs_val = pairs + sent;
+		run_binary_batch_1_arg.pairs.pairs_len = count - sent < batch_size ? count - sent : batch_size;
+
+		// handling response from server, checking if the return is a null pointer
+		result_1 = run_binary_batch_1(&run_binary_batch_1_arg, clnt);
+		if (result_1 == (batch_results *)NULL)
+		{
+			clnt_perror(clnt, "call failed");
+			clnt_destroy(clnt);
+			return -1;
+		}
+
+		// The strings are taken over, xdr_free skips the NULL ones
+		for (u_int i = 0; i < result_1->results.results_len && i < run_binary_batch_1_arg.pairs.pairs_len; i++)
+		{
+			results[indices[sent + i]] = result_1->results.results_val[i];
+			result_1->results.results_val[i] = NULL;
+		}
+		xdr_free((xdrproc_t)xdr_batch_results, (char *)result_1);
+	}
+
+	clnt_destroy(clnt);
+	return 0;
+}
+
+// Reads every pair from STDIN, runs them with run_binary_batch calls on their servers and writes all of the results at once
+void part_c_batch_1(struct shard_ring *ring, char *runnable_path, char *output_path)
+{
+	u_int capacity = 1024, count = 0;
+	long batch_size;
+
+	// Scanning every pair from STDIN (user input)
+	operands *pairs = (operands *)malloc(capacity * sizeof(operands));
+	int x, y;
+	while (pairs != NULL && scanf("%d %d", &x, &y) == 2)
+	{
+		if (count == capacity)
+		{
+			capacity *= 2;
+			pairs = (operands *)realloc(pairs, capacity * sizeof(operands));
+			if (pairs == NULL)
+			{
+				break;
+			}
+		}
+		pairs[count].a = x;
+		pairs[count].b = y;
+		count++;
+	}
+
+	// Server of every pair, and the pairs of one server with their indices
+	char **results = (char **)calloc(count + 1, sizeof(char *));
+	int *owners = (int *)malloc((count + 1) * sizeof(int));
+	operands *shard_pairs = (operands *)malloc((count + 1) * sizeof(operands));
+	u_int *indices = (u_int *)malloc((count + 1) * sizeof(u_int));
+	if (pairs == NULL || results == NULL || owners == NULL || shard_pairs == NULL || indices == NULL)
+	{
+		perror("[ERROR] Memory allocation error.");
+		exit(1);
+	}
+
+	batch_size = option_int("PART_C_BATCH_SIZE", 4096);
+	if (batch_size < 1)
+	{
+		batch_size = 4096;
+	}
+
+	for (u_int i = 0; i < count; i++)
+	{
+		owners[i] = shard_pick(ring, runnable_path, pairs[i].a, pairs[i].b);
+	}
+
+	// Servers are called one after another, each with all of its pairs. A failed server gives its pairs left to the next servers on
+	// the ring, which are called in later rounds, until every pair has a result or every server failed
+	for (;;)
+	{
+		int server = -1;
+		for (u_int i = 0; i < count && server == -1; i++)
+		{
+			if (results[i] == NULL)
+			{
+				server = owners[i];
+			}
+		}
+		if (server == -1)
+		{
+			break;
+		}
+
+		u_int shard_count = 0;
+		for (u_int i = 0; i < count; i++)
+		{
+			if (results[i] == NULL && owners[i] == server)
+			{
+				shard_pairs[shard_count] = pairs[i];
+				indices[shard_count++] = i;
+			}
+		}
+		if (part_c_shard_batch_1(&ring->servers[server], runnable_path, shard_pairs, indices, shard_count, batch_size, results) == -1)
+		{
+			shard_fail(ring, server);
+			for (u_int i = 0; i < count; i++)
+			{
+				if (results[i] == NULL && owners[i] == server)
+				{
+					owners[i] = shard_pick(ring, runnable_path, pairs[i].a, pairs[i].b);
+				}
+			}
+		}
+	}
+
+	// Results are collected in memory in the order of the pairs, so the output file is written only once. When every server failed,
+	// only the results before the first missing one are written, like a single server whose batch failed
+	char *output;
+	size_t output_length;
+	FILE *output_buffer = open_memstream(&output, &output_length);
+	for (u_int i = 0; i < count && results[i] != NULL; i++)
+	{
+		fputs(results[i], output_buffer);
+	}
+	fclose(output_buffer);
+
+	// Opening file for output operation, and printing the results to the file
+	FILE *output_file;
+	output_file = fopen(output_path, "a");
+	fwrite(output, 1, output_length, output_file);
+	fclose(output_file);
+
+	free(output);
+	for (u_int i = 0; i < count; i++)
+	{
+		free(results[i]);
+	}
+	free(results);
+	free(owners);
+	free(shard_pairs);
+	free(indices);
+	free(pairs);
+}
+
+// Connection of the pipeline to one server, opened with the first call the server gets
+struct pipeline_connection
+{
+	int fd;					// -1 when it isn't open
+	struct record_reader reader;
+	struct stream_buffer calls;
+	size_t sent;
+};
+
+// Calls of the pipeline, a pair with index i uses xid first_xid + i and slot i % window
+struct pipeline
+{
+	u_int32_t first_xid;
+	u_int window;
+	u_int written, next;	// Pairs before written are in the output file, pairs before next are sent
+	char *states;			// CALL_SENT or CALL_DONE for every slot
+	char **results;
+	operands *pairs;		// Pair of every slot, sent again when its server fails
+	int *servers;			// Server every slot was sent to
+	char *runnable_path;
+	struct shard_ring *ring;
+	struct pipeline_connection *connections;
+};
+
+#define CALL_SENT 1
+#define CALL_DONE 2
+
+// Stores the result of a reply record in the slot of its call
+static void handle_reply(char *record, size_t length, void *data)
+{
+	struct pipeline *pipeline = data;
+	u_int index = stream_reply_xid(record, length) - pipeline->first_xid;
+	u_int slot = index % pipeline->window;
+
+	// Replies that don't belong to a waiting call are ignored, like clnt_call does
+	if (index - pipeline->written >= pipeline->next - pipeline->written || pipeline->states[slot] != CALL_SENT)
+	{
+		return;
+	}
+
+	pipeline->results[slot] = NULL;
+	enum clnt_stat status = stream_decode_reply(record, length, (xdrproc_t)xdr_wrapstring, &pipeline->results[slot]);
+	if (status != RPC_SUCCESS)
+	{
+		fprintf(stderr, "call failed: %s\n", clnt_sperrno(status));
+		xdr_free((xdrproc_t)xdr_wrapstring, (char *)&pipeline->results[slot]);
+	}
+	pipeline->states[slot] = CALL_DONE;
+}
+
+// Queues the call of the pair with the given index on the connection of its server, connecting to the server on its first call.
+// Servers that can't be reached are left out. Exits when every server failed
+static void pipeline_send(struct pipeline *pipeline, u_int index)
+{
+	u_int slot = index % pipeline->window;
+	arguments run_binary_1_arg = {pipeline->runnable_path, pipeline->pairs[slot].a, pipeline->pairs[slot].b};
+	int server;
+
+	while ((server = shard_pick(pipeline->ring, pipeline->runnable_path, run_binary_1_arg.a, run_binary_1_arg.b)) != -1)
+	{
+		struct pipeline_connection *connection = &pipeline->connections[server];
+		if (connection->fd == -1)
+		{
+			connection->fd = stream_connect(pipeline->ring->servers[server].name);
+			if (connection->fd == -1 || fcntl(connection->fd, F_SETFL, fcntl(connection->fd, F_GETFL) | O_NONBLOCK) == -1)
+			{
+				fprintf(stderr, "%s: couldn't connect to the server\n", pipeline->ring->servers[server].name);
+				if (connection->fd != -1)
+				{
+					close(connection->fd);
+					connection->fd = -1;
+				}
+				shard_fail(pipeline->ring, server);
+				continue;
+			}
+		}
+
+		if (stream_append_call(&connection->calls, pipeline->first_xid + index, run_binary, (xdrproc_t)xdr_arguments, &run_binary_1_arg) == -1)
+		{
+			fprintf(stderr, "%s", "couldn't encode call\n");
+			exit(1);
+		}
+		pipeline->servers[slot] = server;
+		pipeline->states[slot] = CALL_SENT;
+		return;
+	}
+	exit(1);
+}
+
+// Closes the connection of a failed server and sends its calls that are still waiting to the other servers
+static void pipeline_fail(struct pipeline *pipeline, int server)
+{
+	struct pipeline_connection *connection = &pipeline->connections[server];
+
+	close(connection->fd);
+	connection->fd = -1;
+	record_reader_free(&connection->reader);
+	memset(&connection->reader, 0, sizeof(connection->reader));
+	connection->calls.length = connection->sent = 0;
+	shard_fail(pipeline->ring, server);
+
+	for (u_int index = pipeline->written; index < pipeline->next; index++)
+	{
+		u_int slot = index % pipeline->window;
+		if (pipeline->states[slot] == CALL_SENT && pipeline->servers[slot] == server)
+		{
+			pipeline_send(pipeline, index);
+		}
+	}
+}
+
+// Keeps a window of run_binary calls in flight over TCP connections to their servers and writes the results in input order
+void part_c_pipeline_1(struct shard_ring *ring, char *runnable_path, char *output_path)
+{
+	struct pipeline pipeline;
+	int input_done = 0;
+	long window;
+
+	window = option_int("PART_C_WINDOW", 32);
+	if (window < 1)
+	{
+		window = 32;
+	}
+
+	memset(&pipeline, 0, sizeof(pipeline));
+	pipeline.first_xid = (u_int32_t)getpid() ^ (u_int32_t)time(NULL) << 8;
+	pipeline.window = window;
+	pipeline.runnable_path = runnable_path;
+	pipeline.ring = ring;
+	pipeline.states = (char *)calloc(window, sizeof(char));
+	pipeline.results = (char **)calloc(window, sizeof(char *));
+	pipeline.pairs = (operands *)calloc(window, sizeof(operands));
+	pipeline.servers = (int *)calloc(window, sizeof(int));
+	pipeline.connections = (struct pipeline_connection *)calloc(ring->server_count, sizeof(struct pipeline_connection));
+	struct pollfd *events = (struct pollfd *)calloc(ring->server_count, sizeof(struct pollfd));
+	if (pipeline.states == NULL || pipeline.results == NULL || pipeline.pairs == NULL || pipeline.servers == NULL ||
+		pipeline.connections == NULL || events == NULL)
+	{
+		perror("[ERROR] Memory allocation error.");
+		exit(1);
+	}
+	for (int server = 0; server < ring->server_count; server++)
+	{
+		pipeline.connections[server].fd = -1;
+	}
+
+	// Opening file for output operation, results are written through its buffer as soon as all earlier pairs are written
+	FILE *output_file;
+	output_file = fopen(output_path, "a");
+
+	while (!input_done || pipeline.written < pipeline.next)
+	{
+		// Sending new calls while the window has room, reading each pair from STDIN just before its call
+		int x, y;
+		while (!input_done && pipeline.next - pipeline.written < pipeline.window)
+		{
+			if (scanf("%d %d", &x, &y) != 2)
+			{
+				input_done = 1;
+				break;
+			}
+
+			pipeline.pairs[pipeline.next % pipeline.window].a = x;
+			pipeline.pairs[pipeline.next % pipeline.window].b = y;
+			pipeline_send(&pipeline, pipeline.next);
+			pipeline.next++;
+		}
+		if (pipeline.written == pipeline.next)
+		{
+			break;
+		}
+
+		// Waiting until calls can be written or replies can be read, poll skips the servers without a connection
+		for (int server = 0; server < ring->server_count; server++)
+		{
+			struct pipeline_connection *connection = &pipeline.connections[server];
+			events[server].fd = connection->fd;
+			events[server].events = POLLIN | (connection->sent < connection->calls.length ? POLLOUT : 0);
+			events[server].revents = 0;
+		}
+		int ready = poll(events, ring->server_count, 25000);
+		if (ready == 0)
+		{
+			fprintf(stderr, "%s", "call failed: RPC: Timed out\n");
+			exit(1);
+		}
+		if (ready == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("[ERROR] poll failed");
+			exit(1);
+		}
+
+		for (int server = 0; server < ring->server_count; server++)
+		{
+			struct pipeline_connection *connection = &pipeline.connections[server];
+			if (events[server].fd == -1 || connection->fd == -1)
+			{
+				continue;
+			}
+
+			if (events[server].revents & POLLOUT)
+			{
+				ssize_t written = send(connection->fd, connection->calls.data + connection->sent,
+					connection->calls.length - connection->sent, MSG_NOSIGNAL);
+				if (written == -1 && errno != EAGAIN && errno != EINTR)
+				{
+					perror("call failed");
+					pipeline_fail(&pipeline, server);
+					continue;
+				}
+				if (written > 0)
+				{
+					connection->sent += written;
+				}
+				if (connection->sent == connection->calls.length)
+				{
+					connection->sent = connection->calls.length = 0;
+				}
+			}
+
+			if (events[server].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				unsigned char data[65536];
+				ssize_t length = read(connection->fd, data, sizeof(data));
+				if (length == 0 || (length == -1 && errno != EAGAIN && errno != EINTR))
+				{
+					fprintf(stderr, "%s", "call failed: connection closed by the server\n");
+					pipeline_fail(&pipeline, server);
+				}
+				else if (length > 0 && record_reader_feed(&connection->reader, data, length, handle_reply, &pipeline) == -1)
+				{
+					fprintf(stderr, "%s", "call failed: RPC: Can't decode result\n");
+					pipeline_fail(&pipeline, server);
+				}
+			}
+		}
+
+		// Writing the results that are complete and have no earlier pair waiting
+		while (pipeline.written < pipeline.next && pipeline.states[pipeline.written % pipeline.window] == CALL_DONE)
+		{
+			u_int slot = pipeline.written % pipeline.window;
+			if (pipeline.results[slot] != NULL)
+			{
+				fputs(pipeline.results[slot], output_file);
+				xdr_free((xdrproc_t)xdr_wrapstring, (char *)&pipeline.results[slot]);
+			}
+			pipeline.states[slot] = 0;
+			pipeline.written++;
+		}
+	}
+
+	fclose(output_file);
+	for (int server = 0; server < ring->server_count; server++)
+	{
+		if (pipeline.connections[server].fd != -1)
+		{
+			close(pipeline.connections[server].fd);
+		}
+		record_reader_free(&pipeline.connections[server].reader);
+		free(pipeline.connections[server].calls.data);
+	}
+	free(events);
+	free(pipeline.connections);
+	free(pipeline.states);
+	free(pipeline.results);
+	free(pipeline.pairs);
+	free(pipeline.servers);
 }
 
 int main(int argc, char *argv[])
 {
-	char *host, *executable_path, *output_path;
+	char *executable_path, *output_path;
+	struct shard_ring ring;
+	int agent_fd, server;
 
 	// Checking command line arguments
-	if (argc != 4)
+	if (argc != 4 && !(argc == 5 && (strcmp(argv[4], "batch") == 0 || strcmp(argv[4], "pipeline") == 0)))
 	{
-		printf("[ERROR] Usage: %s executable_path output_path server_ip_address\n", argv[0]);
+		printf("[ERROR] Usage: %s executable_path output_path server_ip_address[,server_ip_address...] [batch|pipeline]\n", argv[0]);
 		exit(1);
 	}
 
 	// Processing command line arguments
 	executable_path = argv[1];
 	output_path = argv[2];
-	host = argv[3];
+	if (shard_ring_create(&ring, argv[3]) == -1)
+	{
+		fprintf(stderr, "[ERROR] No server could be read from %s.\n", argv[3]);
+		exit(1);
+	}
 
 	// Sends request to the server
-	part_c_1(host, executable_path, output_path);
+	if (argc == 5 && strcmp(argv[4], "batch") == 0)
+	{
+		part_c_batch_1(&ring, executable_path, output_path);
+	}
+	else if (argc == 5)
+	{
+		part_c_pipeline_1(&ring, executable_path, output_path);
+	}
+	else
+	{
+		// Scanning input from STDIN (user input)
+		int x, y;
+		scanf("%d %d", &x, &y);
+
+		// Trying the servers of the pair in ring order until one of them answers
+		enum call_outcome outcome = CALL_UNREACHABLE;
+		while ((server = shard_pick(&ring, executable_path, x, y)) != -1)
+		{
+			if ((agent_fd = agent_connect()) != -1)
+			{
+				outcome = part_c_agent_1(agent_fd, ring.servers[server].name, executable_path, output_path, x, y);
+			}
+			else
+			{
+				outcome = part_c_1(&ring.servers[server], executable_path, output_path, x, y);
+			}
+			if (outcome == CALL_SUCCEEDED)
+			{
+				break;
+			}
+			shard_fail(&ring, server);
+		}
+		if (outcome == CALL_UNREACHABLE)
+		{
+			exit(1);
+		}
+	}
+	shard_ring_free(&ring);
 	exit(0);
 }
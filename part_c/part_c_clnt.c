@@ -23,3 +23,63 @@ run_binary_1(arguments *argp, CLIENT *clnt)
 	}
 	return (&clnt_res);
 }
+
+batch_results *
+run_binary_batch_1(batch_arguments *argp, CLIENT *clnt)
+{
+	static batch_results clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, run_binary_batch,
+		(xdrproc_t) xdr_batch_arguments, (caddr_t) argp,
+		(xdrproc_t) xdr_batch_results, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+char **
+run_binary_limited_1(limited_arguments *argp, CLIENT *clnt)
+{
+	static char *clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, run_binary_limited,
+		(xdrproc_t) xdr_limited_arguments, (caddr_t) argp,
+		(xdrproc_t) xdr_wrapstring, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+server_stats *
+get_stats_1(int *argp, CLIENT *clnt)
+{
+	static server_stats clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, get_stats,
+		(xdrproc_t) xdr_int, (caddr_t) argp,
+		(xdrproc_t) xdr_server_stats, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+trace_document *
+get_trace_1(int *argp, CLIENT *clnt)
+{
+	static trace_document clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, get_trace,
+		(xdrproc_t) xdr_int, (caddr_t) argp,
+		(xdrproc_t) xdr_trace_document, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
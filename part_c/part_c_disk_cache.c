@@ -0,0 +1,393 @@
+/**
+ * @file    part_c_disk_cache.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Memory mapped result cache file, safe to use from many processes at the same time.
+ *
+ *  Layout of the file: a header, slot_count fixed size slots, then the message area. A key may be in any of the PROBE_LIMIT slots
+ *  after its home slot, so lookups and stores look at a small, fixed window and never need tombstones. When the window is full a
+ *  store replaces one slot of it.
+ *
+ *  Every slot is guarded by a sequence lock kept in the slot itself. A writer makes the sequence odd with a compare and swap, changes
+ *  the slot and makes it even again; readers copy the slot and use the copy only if the sequence was even and didn't change. Since
+ *  the locks live in the shared mapping, they work between processes as well as threads, and a reader never blocks a writer.
+ *  Messages are written once to space reserved with an atomic add on the header and never changed, so a slot only refers to them
+ *  after they are complete.
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_disk_cache.h"
+#include "options.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define DISK_CACHE_MAGIC "PCRCACHE"
+#define DISK_CACHE_VERSION 1
+#define PROBE_LIMIT 8
+#define READ_RETRIES 4
+
+enum slot_state
+{
+    SLOT_EMPTY,
+    SLOT_SUCCESS,
+    SLOT_FAIL
+};
+
+struct disk_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slot_count;
+    uint64_t message_capacity;
+    uint64_t message_used;      // Bytes of the message area that are reserved, only grows
+};
+
+struct disk_cache_slot
+{
+    uint32_t sequence;          // Odd while a writer changes the slot
+    uint32_t state;
+    uint64_t device, inode;
+    int64_t modification_sec, modification_nsec, size;
+    int32_t a, b;
+    int32_t value;              // Result of a SUCCESS
+    uint32_t message_length;    // Message of a FAIL, at message_offset in the message area
+    uint64_t message_offset;
+};
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static struct disk_cache_header *header;
+static struct disk_cache_slot *slots;
+static char *messages;
+
+// Offset of the last message this process stored. Blackboxes usually fail with the same few messages, so a repeated message is shared
+static pthread_mutex_t last_message_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t last_message_offset;
+static uint32_t last_message_length;
+
+// Creates the file if it doesn't exist yet and maps it. The file lock makes sure only one process writes the header of a new file
+static void cache_init(void)
+{
+    const char *path = option_string("PART_C_DISK_CACHE", "");
+    struct disk_cache_header new_header;
+    struct stat file_status;
+
+    if (path[0] == '\0')
+    {
+        return;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1 || flock(fd, LOCK_EX) == -1 || fstat(fd, &file_status) == -1)
+    {
+        perror("[WARNING] Disk cache couldn't be opened, continuing without it");
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    if (file_status.st_size == 0)
+    {
+        long requested_slots = option_int("PART_C_DISK_CACHE_SLOTS", 1048576);
+        long message_bytes = option_int("PART_C_DISK_CACHE_MESSAGE_BYTES", 16777216);
+
+        memset(&new_header, 0, sizeof(new_header));
+        memcpy(new_header.magic, DISK_CACHE_MAGIC, sizeof(new_header.magic));
+        new_header.version = DISK_CACHE_VERSION;
+        new_header.slot_size = sizeof(struct disk_cache_slot);
+        new_header.slot_count = PROBE_LIMIT;
+        while (new_header.slot_count < (uint64_t)requested_slots)
+        {
+            new_header.slot_count *= 2;
+        }
+        new_header.message_capacity = message_bytes < 0 ? 0 : message_bytes;
+
+        // The file is sparse, pages of the table are only allocated when slots in them are used
+        file_status.st_size = sizeof(new_header) + new_header.slot_count * sizeof(struct disk_cache_slot) + new_header.message_capacity;
+        if (ftruncate(fd, file_status.st_size) == -1 || pwrite(fd, &new_header, sizeof(new_header), 0) != sizeof(new_header))
+        {
+            perror("[WARNING] Disk cache couldn't be created, continuing without it");
+            close(fd);
+            return;
+        }
+    }
+    flock(fd, LOCK_UN);
+
+    void *map = mmap(NULL, file_status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("[WARNING] Disk cache couldn't be mapped, continuing without it");
+        return;
+    }
+
+    // A file of another format or a cut file is left alone
+    struct disk_cache_header *file_header = map;
+    if ((size_t)file_status.st_size < sizeof(*file_header) || memcmp(file_header->magic, DISK_CACHE_MAGIC, sizeof(file_header->magic)) != 0 ||
+        file_header->version != DISK_CACHE_VERSION || file_header->slot_size != sizeof(struct disk_cache_slot) ||
+        file_header->slot_count < PROBE_LIMIT || (file_header->slot_count & (file_header->slot_count - 1)) != 0 ||
+        (uint64_t)file_status.st_size < sizeof(*file_header) + file_header->slot_count * sizeof(struct disk_cache_slot) + file_header->message_capacity)
+    {
+        fprintf(stderr, "[WARNING] %s is not a valid disk cache, continuing without it\n", path);
+        munmap(map, file_status.st_size);
+        return;
+    }
+
+    slots = (struct disk_cache_slot *)(file_header + 1);
+    messages = (char *)(slots + file_header->slot_count);
+    header = file_header;
+}
+
+// The modification time and size are left out of the hash, so the results of an older version of a file are in the same window as the
+// new ones, where lookups and stores find and discard them
+static uint64_t hash_key(const struct stat *executable, int a, int b)
+{
+    uint64_t values[] = {executable->st_dev, executable->st_ino, ((uint64_t)(uint32_t)a << 32) | (uint32_t)b};
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        hash = (hash ^ values[i]) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Returns 1 when the slot is for the same executable file and inputs
+static int same_key(const struct disk_cache_slot *slot, const struct stat *executable, int a, int b)
+{
+    return slot->a == a && slot->b == b && slot->device == executable->st_dev && slot->inode == executable->st_ino &&
+           slot->modification_sec == executable->st_mtim.tv_sec && slot->modification_nsec == executable->st_mtim.tv_nsec &&
+           slot->size == executable->st_size;
+}
+
+// Returns 1 when the slot belongs to an older version of the same executable file, which can't be used anymore
+static int stale_key(const struct disk_cache_slot *slot, const struct stat *executable)
+{
+    return slot->state != SLOT_EMPTY && slot->device == executable->st_dev && slot->inode == executable->st_ino &&
+           (slot->modification_sec != executable->st_mtim.tv_sec || slot->modification_nsec != executable->st_mtim.tv_nsec ||
+            slot->size != executable->st_size);
+}
+
+// Copies a slot without a torn read, returns -1 if writers kept changing it
+static int read_slot(struct disk_cache_slot *slot, struct disk_cache_slot *copy)
+{
+    for (int i = 0; i < READ_RETRIES; i++)
+    {
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        memcpy(copy, slot, sizeof(struct disk_cache_slot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Takes the write lock of a slot if its sequence is still the expected one. Returns 0 when the caller may write the slot
+static int lock_slot(struct disk_cache_slot *slot, uint32_t sequence)
+{
+    if (sequence & 1 || !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return 0;
+}
+
+static void unlock_slot(struct disk_cache_slot *slot)
+{
+    __atomic_fetch_add(&slot->sequence, 1, __ATOMIC_RELEASE);
+}
+
+// Puts the message in the message area, returns -1 if it doesn't fit
+static int store_message(const char *message, uint32_t length, uint64_t *offset)
+{
+    pthread_mutex_lock(&last_message_lock);
+    if (last_message_length == length && memcmp(messages + last_message_offset, message, length) == 0)
+    {
+        *offset = last_message_offset;
+        pthread_mutex_unlock(&last_message_lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&last_message_lock);
+
+    uint64_t reserved = __atomic_fetch_add(&header->message_used, length, __ATOMIC_RELAXED);
+    if (reserved + length > header->message_capacity)
+    {
+        return -1;
+    }
+    memcpy(messages + reserved, message, length);
+    *offset = reserved;
+
+    pthread_mutex_lock(&last_message_lock);
+    last_message_offset = reserved;
+    last_message_length = length;
+    pthread_mutex_unlock(&last_message_lock);
+
+    return 0;
+}
+
+int disk_cache_enabled(void)
+{
+    pthread_once(&cache_once, cache_init);
+    return header != NULL;
+}
+
+char *disk_cache_lookup(const struct stat *executable, int a, int b)
+{
+    struct disk_cache_slot copy;
+    char *result;
+
+    if (!disk_cache_enabled())
+    {
+        return NULL;
+    }
+
+    uint64_t hash = hash_key(executable, a, b);
+    for (uint64_t i = 0; i < PROBE_LIMIT; i++)
+    {
+        struct disk_cache_slot *slot = &slots[(hash + i) & (header->slot_count - 1)];
+        if (read_slot(slot, &copy) == -1)
+        {
+            continue;
+        }
+
+        if (stale_key(&copy, executable))
+        {
+            // Discarding the result of the old executable, unless another process changed the slot meanwhile
+            if (lock_slot(slot, copy.sequence) == 0)
+            {
+                slot->state = SLOT_EMPTY;
+                unlock_slot(slot);
+            }
+            continue;
+        }
+        if (copy.state == SLOT_EMPTY || !same_key(&copy, executable, a, b))
+        {
+            continue;
+        }
+
+        if (copy.state == SLOT_SUCCESS)
+        {
+            result = malloc(32);
+            if (result != NULL)
+            {
+                sprintf(result, "SUCCESS:\n%d\n", copy.value);
+            }
+            return result;
+        }
+
+        // Messages are never changed after they are referenced, so only their bounds need checking
+        if (copy.message_offset + copy.message_length > header->message_capacity)
+        {
+            return NULL;
+        }
+        result = malloc(copy.message_length + 8);
+        if (result != NULL)
+        {
+            memcpy(result, "FAIL:\n", 6);
+            memcpy(result + 6, messages + copy.message_offset, copy.message_length);
+            strcpy(result + 6 + copy.message_length, "\n");
+        }
+        return result;
+    }
+
+    return NULL;
+}
+
+void disk_cache_store(const struct stat *executable, int a, int b, const char *result)
+{
+    struct disk_cache_slot copy, new_slot;
+    struct disk_cache_slot *target = NULL;
+    uint32_t target_sequence = 0;
+    int target_rank = 0; // 3 for the same key, 2 for an empty slot, 1 for a stale slot
+
+    if (!disk_cache_enabled())
+    {
+        return;
+    }
+
+    memset(&new_slot, 0, sizeof(new_slot));
+    if (strncmp(result, "SUCCESS:\n", 9) == 0)
+    {
+        new_slot.state = SLOT_SUCCESS;
+        new_slot.value = atoi(result + 9);
+    }
+    else if (strncmp(result, "FAIL:\n", 6) == 0)
+    {
+        // The message is kept without the FAIL title and the newline after it
+        size_t length = strlen(result + 6);
+        if (length > 0 && result[6 + length - 1] == '\n')
+        {
+            length--;
+        }
+        new_slot.state = SLOT_FAIL;
+        new_slot.message_length = length;
+        if (store_message(result + 6, length, &new_slot.message_offset) == -1)
+        {
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+    new_slot.device = executable->st_dev;
+    new_slot.inode = executable->st_ino;
+    new_slot.modification_sec = executable->st_mtim.tv_sec;
+    new_slot.modification_nsec = executable->st_mtim.tv_nsec;
+    new_slot.size = executable->st_size;
+    new_slot.a = a;
+    new_slot.b = b;
+
+    // Choosing the best slot of the window; when every slot holds another key, one chosen by the hash is replaced
+    uint64_t hash = hash_key(executable, a, b);
+    for (uint64_t i = 0; i < PROBE_LIMIT && target_rank < 3; i++)
+    {
+        struct disk_cache_slot *slot = &slots[(hash + i) & (header->slot_count - 1)];
+        if (read_slot(slot, &copy) == -1)
+        {
+            continue;
+        }
+
+        int rank = copy.state != SLOT_EMPTY && same_key(&copy, executable, a, b) ? 3 : copy.state == SLOT_EMPTY ? 2 : stale_key(&copy, executable) ? 1 : 0;
+        if (rank > target_rank || target == NULL)
+        {
+            target = slot;
+            target_sequence = copy.sequence;
+            target_rank = rank;
+        }
+    }
+    if (target_rank == 0)
+    {
+        target = &slots[(hash + (hash >> 32) % PROBE_LIMIT) & (header->slot_count - 1)];
+        target_sequence = __atomic_load_n(&target->sequence, __ATOMIC_RELAXED);
+    }
+
+    // If another writer got the slot first, this result is simply not stored
+    if (target == NULL || lock_slot(target, target_sequence) == -1)
+    {
+        return;
+    }
+    // Everything after the sequence is written, the sequence itself is only changed atomically
+    memcpy((char *)target + sizeof(target->sequence), (char *)&new_slot + sizeof(new_slot.sequence), sizeof(new_slot) - sizeof(new_slot.sequence));
+    unlock_slot(target);
+}
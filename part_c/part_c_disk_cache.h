@@ -0,0 +1,35 @@
+/**
+ * @file    part_c_disk_cache.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Persistent cache of blackbox results in a memory mapped file, shared by the part_c servers of a host.
+ *
+ *  The file is an open addressing hash table keyed like part_c_result_cache.h, by the identity of the executable (device, inode,
+ *  modification time and size) and the two inputs. A SUCCESS result is kept in its slot, the message of a FAIL result is kept in a
+ *  message area after the table and the slot refers to it. Opening the cache only maps the file, so results of earlier runs are
+ *  available right after a restart without reading or parsing them.
+ *
+ *  The cache is configured with environment variables:
+ *      PART_C_DISK_CACHE                   Path of the cache file, empty disables the cache (default empty)
+ *      PART_C_DISK_CACHE_SLOTS             Slot count used when the file is created, rounded up to a power of 2 (default 1048576)
+ *      PART_C_DISK_CACHE_MESSAGE_BYTES     Size of the message area used when the file is created (default 16777216)
+ *
+ *  An existing file keeps its own sizes. Entries of an executable that was modified in place (same inode, different modification time
+ *  or size) are discarded when they are found.
+ */
+
+#ifndef PART_C_DISK_CACHE_H
+#define PART_C_DISK_CACHE_H
+
+#include <sys/stat.h>
+
+// Returns 1 when the cache is enabled and its file is mapped
+int disk_cache_enabled(void);
+
+// Returns a malloc'd copy of the result of (a, b) for the executable, or NULL if it isn't cached
+char *disk_cache_lookup(const struct stat *executable, int a, int b);
+
+// Adds the result of (a, b) for the executable. A FAIL result is left out when the message area is full
+void disk_cache_store(const struct stat *executable, int a, int b, const char *result);
+
+#endif /* PART_C_DISK_CACHE_H */
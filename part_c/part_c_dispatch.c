@@ -0,0 +1,792 @@
+/**
+ * @file    part_c_dispatch.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Worker pool server mode for the part_c RPC server, used instead of svc_run() when PART_C_WORKERS is set.
+ *
+ *  The main thread watches the UDP socket, the TCP listening socket and every accepted TCP connection with epoll. UDP datagrams are
+ *  complete calls, TCP connections are read without blocking and their record marked fragments are put together by the record reader
+ *  of the connection (part_c_stream.c). Every complete call is decoded here; NULLPROC calls and malformed calls are answered right
+ *  away, other calls are queued as jobs together with where their reply should go.
+ *
+ *  Workers take jobs from the queue, run the reentrant handler of the procedure into a result of their own and encode the reply into
+ *  their own buffer. UDP replies are sent to the address the call came from, TCP replies are written to the connection of the call
+ *  under the connection's write lock, so replies of different workers don't mix. A connection is only closed after its last queued
+ *  job is answered.
+ *
+ *  Call and reply messages follow RFC 5531, the same as the svc_run() transports do, so clients can't tell the two modes apart.
+ *
+ *  On an upgrade (part_c_upgrade.h) the main thread stops watching the RPC sockets once the new server is ready, and drains. A
+ *  connection that is in the middle of a call is only read until the end of that call, so no byte of the next call is taken from the
+ *  kernel. It is then left unwatched until its last job is answered, and handed over. The main thread keeps the list of its open
+ *  connections for this.
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_dispatch.h"
+#include "part_c_log_sender.h"
+#include "part_c_stream.h"
+#include "part_c_timing.h"
+#include "part_c_trace.h"
+#include "part_c_upgrade.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define MAX_EVENTS 64
+#define SEND_TIMEOUT_MS 5000
+
+// An accepted TCP connection, shared by the main thread and the workers answering its calls
+struct connection
+{
+    int fd;
+    int references;                 // One for the main thread while the connection is open, one for every queued job
+    pthread_mutex_t write_lock;
+
+    struct record_reader reader;    // Only used by the main thread, like the fields below
+    int watched;                    // Read by the main thread, an upgrade stops this between two calls
+    struct connection *previous, *next;
+};
+
+// Where the reply of a call is sent, connection is NULL for UDP calls
+struct reply_target
+{
+    struct connection *connection;
+    int udp_socket;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+};
+
+// A decoded call waiting for a worker
+struct job
+{
+    u_int32_t xid;
+    const struct procedure *procedure;
+    union
+    {
+        arguments run_binary_1_arg;
+        batch_arguments run_binary_batch_1_arg;
+        limited_arguments run_binary_limited_1_arg;
+        int get_stats_1_arg;
+        int get_trace_1_arg;
+    } argument;
+    struct reply_target target;
+    long long queued_ns;
+    struct job *next;
+};
+
+// Reentrant handler of a procedure and the XDR routines of its argument and result
+struct procedure
+{
+    u_long number;
+    xdrproc_t xdr_argument, xdr_result;
+    bool_t (*local)(char *argument, char *result);
+};
+
+static const struct procedure procedures[] = {
+    {run_binary, (xdrproc_t)xdr_arguments, (xdrproc_t)xdr_wrapstring, (bool_t(*)(char *, char *))run_binary_1_worker},
+    {run_binary_batch, (xdrproc_t)xdr_batch_arguments, (xdrproc_t)xdr_batch_results, (bool_t(*)(char *, char *))run_binary_batch_1_worker},
+    {run_binary_limited, (xdrproc_t)xdr_limited_arguments, (xdrproc_t)xdr_wrapstring, (bool_t(*)(char *, char *))run_binary_limited_1_worker},
+    {get_stats, (xdrproc_t)xdr_int, (xdrproc_t)xdr_server_stats, (bool_t(*)(char *, char *))get_stats_1_worker},
+    {get_trace, (xdrproc_t)xdr_int, (xdrproc_t)xdr_trace_document, (bool_t(*)(char *, char *))get_trace_1_worker},
+};
+
+// Growing buffer for encoding replies, every thread has its own
+struct buffer
+{
+    char *data;
+    size_t capacity;
+};
+
+// Markers for the epoll events of the listening sockets and the upgrade descriptors, connections use their own struct
+static struct connection udp_endpoint, tcp_listener, upgrade_request, handoff_endpoint;
+
+static struct connection *connections; // Open connections of the main thread
+static int jobs_in_flight;             // Queued or running jobs, decremented by the workers
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+static struct job *queue_head, *queue_tail;
+
+// Drops a reference of the connection, the last one closes it
+static void release_connection(struct connection *connection)
+{
+    if (__atomic_sub_fetch(&connection->references, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        close(connection->fd);
+        pthread_mutex_destroy(&connection->write_lock);
+        record_reader_free(&connection->reader);
+        free(connection);
+    }
+}
+
+// Writes all of the data to a non-blocking socket, waiting for it to be writable when its buffer is full
+static int send_all(int fd, const char *data, size_t length)
+{
+    struct pollfd writable = {fd, POLLOUT, 0};
+
+    while (length > 0)
+    {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN || poll(&writable, 1, SEND_TIMEOUT_MS) <= 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+// Encodes the reply message into the buffer and sends it to the target, returns -1 if it couldn't be encoded or sent
+static int send_reply(struct reply_target *target, struct rpc_msg *reply, struct buffer *buffer)
+{
+    // Space for the record mark is reserved at the start, it is only sent for TCP replies
+    size_t size = xdr_sizeof((xdrproc_t)xdr_replymsg, reply) + 4;
+    XDR xdrs;
+    u_int length;
+
+    if (size > buffer->capacity)
+    {
+        char *data = realloc(buffer->data, size);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        buffer->data = data;
+        buffer->capacity = size;
+    }
+
+    xdrmem_create(&xdrs, buffer->data + 4, size - 4, XDR_ENCODE);
+    if (!xdr_replymsg(&xdrs, reply))
+    {
+        xdr_destroy(&xdrs);
+        return -1;
+    }
+    length = xdr_getpos(&xdrs);
+    xdr_destroy(&xdrs);
+
+    if (target->connection == NULL)
+    {
+        // Clients can't receive UDP replies bigger than their buffer, svcudp fails the same way for these
+        if (length > UDPMSGSIZE)
+        {
+            return -1;
+        }
+        return sendto(target->udp_socket, buffer->data + 4, length, 0, (struct sockaddr *)&target->address, target->address_length) == -1 ? -1 : 0;
+    }
+
+    uint32_t record_mark = htonl(LAST_FRAGMENT | length);
+    memcpy(buffer->data, &record_mark, 4);
+
+    pthread_mutex_lock(&target->connection->write_lock);
+    int sent = send_all(target->connection->fd, buffer->data, length + 4);
+    pthread_mutex_unlock(&target->connection->write_lock);
+
+    return sent;
+}
+
+// Sends an accepted reply with the given status. Results are only encoded for SUCCESS replies
+static void send_accepted(struct reply_target *target, u_int32_t xid, enum accept_stat status, xdrproc_t xdr_result, char *result, struct buffer *buffer)
+{
+    struct rpc_msg reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.rm_xid = xid;
+    reply.rm_direction = REPLY;
+    reply.rm_reply.rp_stat = MSG_ACCEPTED;
+    reply.acpted_rply.ar_verf = _null_auth;
+    reply.acpted_rply.ar_stat = status;
+
+    if (status == SUCCESS)
+    {
+        reply.acpted_rply.ar_results.where = result;
+        reply.acpted_rply.ar_results.proc = xdr_result;
+    }
+    else if (status == PROG_MISMATCH)
+    {
+        reply.acpted_rply.ar_vers.low = PART_C_VERS;
+        reply.acpted_rply.ar_vers.high = PART_C_VERS;
+    }
+    else
+    {
+        reply.acpted_rply.ar_results.where = NULL;
+        reply.acpted_rply.ar_results.proc = (xdrproc_t)xdr_void;
+    }
+
+    // A result that can't be sent is reported to the client as a system error, like svc_sendreply failures are
+    if (send_reply(target, &reply, buffer) == -1 && status == SUCCESS)
+    {
+        send_accepted(target, xid, SYSTEM_ERR, NULL, NULL, buffer);
+    }
+}
+
+// Sends a denied reply for calls with an RPC version other than 2
+static void send_rpc_mismatch(struct reply_target *target, u_int32_t xid, struct buffer *buffer)
+{
+    struct rpc_msg reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.rm_xid = xid;
+    reply.rm_direction = REPLY;
+    reply.rm_reply.rp_stat = MSG_DENIED;
+    reply.rjcted_rply.rj_stat = RPC_MISMATCH;
+    reply.rjcted_rply.rj_vers.low = RPC_MSG_VERSION;
+    reply.rjcted_rply.rj_vers.high = RPC_MSG_VERSION;
+
+    send_reply(target, &reply, buffer);
+}
+
+// Adds a job to the end of the queue and wakes a worker
+static void enqueue_job(struct job *job)
+{
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail == NULL)
+    {
+        queue_head = job;
+    }
+    else
+    {
+        queue_tail->next = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal(&queue_not_empty);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// Decodes a complete call message and either answers it or queues it for the workers
+static void handle_call(char *data, size_t length, struct reply_target *target, struct buffer *buffer)
+{
+    struct rpc_msg call;
+    char credentials[2 * MAX_AUTH_BYTES];
+    const struct procedure *procedure = NULL;
+    long long started_ns = timing_now();
+    XDR xdrs;
+
+    memset(&call, 0, sizeof(call));
+    call.rm_call.cb_cred.oa_base = credentials;
+    call.rm_call.cb_verf.oa_base = credentials + MAX_AUTH_BYTES;
+
+    // Messages that aren't calls can't be answered, they are dropped like svc_run() does
+    xdrmem_create(&xdrs, data, length, XDR_DECODE);
+    if (!xdr_callmsg(&xdrs, &call) || call.rm_direction != CALL)
+    {
+        xdr_destroy(&xdrs);
+        return;
+    }
+
+    if (call.rm_call.cb_rpcvers != RPC_MSG_VERSION)
+    {
+        send_rpc_mismatch(target, call.rm_xid, buffer);
+    }
+    else if (call.rm_call.cb_prog != PART_C)
+    {
+        send_accepted(target, call.rm_xid, PROG_UNAVAIL, NULL, NULL, buffer);
+    }
+    else if (call.rm_call.cb_vers != PART_C_VERS)
+    {
+        send_accepted(target, call.rm_xid, PROG_MISMATCH, NULL, NULL, buffer);
+    }
+    else if (call.rm_call.cb_proc == NULLPROC)
+    {
+        send_accepted(target, call.rm_xid, SUCCESS, (xdrproc_t)xdr_void, NULL, buffer);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(procedures) / sizeof(procedures[0]); i++)
+        {
+            if (procedures[i].number == call.rm_call.cb_proc)
+            {
+                procedure = &procedures[i];
+            }
+        }
+
+        if (procedure == NULL)
+        {
+            send_accepted(target, call.rm_xid, PROC_UNAVAIL, NULL, NULL, buffer);
+        }
+        else
+        {
+            struct job *job = calloc(1, sizeof(struct job));
+            if (job == NULL)
+            {
+                perror("[ERROR] Memory allocation error.");
+                exit(-1);
+            }
+
+            if (!procedure->xdr_argument(&xdrs, (char *)&job->argument))
+            {
+                xdr_free(procedure->xdr_argument, (char *)&job->argument);
+                free(job);
+                send_accepted(target, call.rm_xid, GARBAGE_ARGS, NULL, NULL, buffer);
+            }
+            else
+            {
+                job->xid = call.rm_xid;
+                job->procedure = procedure;
+                job->target = *target;
+                trace_set_request(job->xid);
+                job->queued_ns = timing_now();
+                trace_span("decode", started_ns, job->queued_ns);
+                trace_set_request(0);
+                if (target->connection != NULL)
+                {
+                    __atomic_add_fetch(&target->connection->references, 1, __ATOMIC_RELAXED);
+                }
+                __atomic_add_fetch(&jobs_in_flight, 1, __ATOMIC_RELAXED);
+                enqueue_job(job);
+            }
+        }
+    }
+
+    xdr_destroy(&xdrs);
+}
+
+// Runs the queued jobs and sends their replies
+static void *worker_thread(void *unused)
+{
+    struct buffer buffer = {NULL, 0};
+    union
+    {
+        char *run_binary_1_res;
+        batch_results run_binary_batch_1_res;
+        char *run_binary_limited_1_res;
+        server_stats get_stats_1_res;
+        trace_document get_trace_1_res;
+    } result;
+
+    while (1)
+    {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL)
+        {
+            pthread_cond_wait(&queue_not_empty, &queue_lock);
+        }
+        struct job *job = queue_head;
+        queue_head = job->next;
+        if (queue_head == NULL)
+        {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        const struct procedure *procedure = job->procedure;
+
+        // Spans of the request are tagged with its xid, from the time it waited in the queue to its reply
+        trace_set_request(job->xid);
+        trace_span("queue", job->queued_ns, timing_now());
+
+        memset(&result, 0, sizeof(result));
+        bool_t succeeded = procedure->local((char *)&job->argument, (char *)&result);
+        long long started_ns = timing_now();
+        if (succeeded)
+        {
+            send_accepted(&job->target, job->xid, SUCCESS, procedure->xdr_result, (char *)&result, &buffer);
+        }
+        else
+        {
+            send_accepted(&job->target, job->xid, SYSTEM_ERR, NULL, NULL, &buffer);
+        }
+        trace_span("reply", started_ns, timing_now());
+        trace_set_request(0);
+
+        xdr_free(procedure->xdr_result, (char *)&result);
+        xdr_free(procedure->xdr_argument, (char *)&job->argument);
+        if (job->target.connection != NULL)
+        {
+            release_connection(job->target.connection);
+        }
+        free(job);
+        __atomic_sub_fetch(&jobs_in_flight, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+// Reads every waiting datagram from the UDP socket
+static void read_datagrams(int udp_socket, struct buffer *buffer)
+{
+    char datagram[UDPMSGSIZE];
+    struct reply_target target;
+    ssize_t length;
+
+    memset(&target, 0, sizeof(target));
+    target.udp_socket = udp_socket;
+
+    while (1)
+    {
+        target.address_length = sizeof(target.address);
+        length = recvfrom(udp_socket, datagram, sizeof(datagram), 0, (struct sockaddr *)&target.address, &target.address_length);
+        if (length == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return; // EAGAIN, nothing left to read
+        }
+        handle_call(datagram, length, &target, buffer);
+    }
+}
+
+// Connection and encoding buffer of the records read by the main thread
+struct record_context
+{
+    struct connection *connection;
+    struct buffer *buffer;
+};
+
+// Handles a completed call record of a TCP connection
+static void handle_record(char *record, size_t length, void *data)
+{
+    struct record_context *context = data;
+    struct reply_target target;
+
+    memset(&target, 0, sizeof(target));
+    target.connection = context->connection;
+    handle_call(record, length, &target, context->buffer);
+}
+
+// Returns 1 when the reader of the connection is between two records
+static int between_records(const struct connection *connection)
+{
+    return connection->reader.header_length == 0 && connection->reader.record_length == 0;
+}
+
+// Returns how many bytes can be read without going past the end of the current record, 0 between two records
+static size_t rest_of_record(const struct connection *connection)
+{
+    if (connection->reader.header_length < 4)
+    {
+        return between_records(connection) ? 0 : 4 - connection->reader.header_length;
+    }
+    return connection->reader.fragment_remaining;
+}
+
+// Reads everything available on the connection, returns -1 when the connection should be closed. While draining for an upgrade, reads
+// only until the end of the current record
+static int read_connection(struct connection *connection, struct buffer *buffer, int draining)
+{
+    unsigned char data[65536];
+    struct record_context context = {connection, buffer};
+
+    while (1)
+    {
+        size_t size = sizeof(data);
+        if (draining)
+        {
+            size = rest_of_record(connection);
+            if (size == 0)
+            {
+                return 0;
+            }
+            size = size < sizeof(data) ? size : sizeof(data);
+        }
+
+        ssize_t length = read(connection->fd, data, size);
+        if (length == 0)
+        {
+            return -1;
+        }
+        if (length == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+        if (record_reader_feed(&connection->reader, data, length, handle_record, &context) == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+// Adds a connection to epoll and to the list of open connections
+static void add_connection(int epoll_fd, int fd)
+{
+    struct epoll_event event;
+
+    struct connection *connection = calloc(1, sizeof(struct connection));
+    if (connection == NULL)
+    {
+        close(fd);
+        return;
+    }
+    connection->fd = fd;
+    connection->references = 1;
+    connection->watched = 1;
+    pthread_mutex_init(&connection->write_lock, NULL);
+
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = connection;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        release_connection(connection);
+        return;
+    }
+
+    connection->next = connections;
+    if (connections != NULL)
+    {
+        connections->previous = connection;
+    }
+    connections = connection;
+}
+
+// Removes the connection from epoll and from the list, queued jobs still hold it until they are answered
+static void remove_connection(int epoll_fd, struct connection *connection)
+{
+    if (connection->watched)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    }
+    if (connection->previous != NULL)
+    {
+        connection->previous->next = connection->next;
+    }
+    else
+    {
+        connections = connection->next;
+    }
+    if (connection->next != NULL)
+    {
+        connection->next->previous = connection->previous;
+    }
+    release_connection(connection);
+}
+
+// Accepts every waiting TCP connection and adds them to epoll
+static void accept_connections(int epoll_fd, int tcp_socket)
+{
+    int fd;
+
+    while ((fd = accept4(tcp_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        add_connection(epoll_fd, fd);
+    }
+}
+
+// Receives a message of the old server after an upgrade. Returns -1 once the old server is gone
+static int receive_handoff(int epoll_fd, int handoff_socket, int *logger_adopted)
+{
+    int fd;
+
+    int kind = upgrade_receive(handoff_socket, &fd, NULL);
+    if (kind == UPGRADE_CONNECTION && fd != -1 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != -1)
+    {
+        add_connection(epoll_fd, fd);
+    }
+    else if (kind == UPGRADE_LOGGER || kind == -1)
+    {
+        // Without the connection of the old server, the log sender connects by itself
+        if (!*logger_adopted)
+        {
+            log_sender_adopt(fd);
+            *logger_adopted = 1;
+        }
+    }
+    else if (fd != -1)
+    {
+        close(fd);
+    }
+    return kind == -1 ? -1 : 0;
+}
+
+// Hands every idle connection over to the new server, and stops reading the ones that are between two calls. Returns 1 when the
+// drain is complete and the old server can exit
+static int drain_connections(int epoll_fd, int handoff_socket, long long deadline_ns)
+{
+    struct connection *connection = connections;
+    int expired = timing_now() >= deadline_ns;
+
+    while (connection != NULL)
+    {
+        struct connection *next = connection->next;
+
+        if (between_records(connection) && connection->watched)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+            connection->watched = 0;
+        }
+
+        // Busy connections are closed after the deadline, their jobs still hold them until they are answered
+        if (!connection->watched && __atomic_load_n(&connection->references, __ATOMIC_ACQUIRE) == 1)
+        {
+            upgrade_send(handoff_socket, UPGRADE_CONNECTION, connection->fd);
+            remove_connection(epoll_fd, connection);
+        }
+        else if (expired)
+        {
+            remove_connection(epoll_fd, connection);
+        }
+        connection = next;
+    }
+
+    return connections == NULL && __atomic_load_n(&jobs_in_flight, __ATOMIC_ACQUIRE) == 0;
+}
+
+// Starts the new server and stops serving the RPC sockets. Returns the handoff socket, -1 if the upgrade couldn't be started
+static int start_upgrade(int epoll_fd, int udp_socket, int tcp_socket)
+{
+    struct sockaddr_in logger_address;
+
+    // The new server can't read the logger address from the wrapper, it gets it from this one
+    logger_address_get(&logger_address);
+    int handoff_socket = upgrade_start(udp_socket, tcp_socket, &logger_address);
+    if (handoff_socket == -1)
+    {
+        return -1;
+    }
+
+    // The UDP socket is kept for the replies of the queued UDP calls
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, udp_socket, NULL);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, tcp_socket, NULL);
+    close(tcp_socket);
+    fprintf(stderr, "%s", "[INFO] The new server is ready, draining.\n");
+
+    return handoff_socket;
+}
+
+// Hands the logger connection over after the last log line of this server, and exits
+static void finish_upgrade(int handoff_socket)
+{
+    int logger_socket = log_sender_detach(SEND_TIMEOUT_MS);
+
+    if (upgrade_send(handoff_socket, UPGRADE_LOGGER, logger_socket) == -1)
+    {
+        perror("[WARNING] Couldn't hand the logger connection over");
+    }
+    exit(0);
+}
+
+// Makes the socket non-blocking and adds it to epoll with the given marker
+static void watch_socket(int epoll_fd, int fd, struct connection *marker)
+{
+    struct epoll_event event;
+
+    event.events = EPOLLIN;
+    event.data.ptr = marker;
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        perror("[ERROR] Couldn't watch RPC socket.");
+        exit(1);
+    }
+}
+
+void dispatch_run(int udp_socket, int tcp_socket, int workers, int upgrade_fd, int handoff_socket)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct buffer buffer = {NULL, 0};
+    pthread_t thread;
+    int epoll_fd;
+    int draining = 0, logger_adopted = 0;
+    int drain_socket = -1; // Handoff socket to the new server while draining
+    long long drain_deadline_ns = 0;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        perror("[ERROR] Couldn't create epoll instance.");
+        exit(1);
+    }
+    watch_socket(epoll_fd, udp_socket, &udp_endpoint);
+    watch_socket(epoll_fd, tcp_socket, &tcp_listener);
+    if (upgrade_fd != -1)
+    {
+        watch_socket(epoll_fd, upgrade_fd, &upgrade_request);
+    }
+    if (handoff_socket != -1)
+    {
+        watch_socket(epoll_fd, handoff_socket, &handoff_endpoint);
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&thread, NULL, worker_thread, NULL) != 0)
+        {
+            fprintf(stderr, "%s", "cannot create worker thread.");
+            exit(1);
+        }
+    }
+
+    // The old server stops reading the sockets once this server can serve them
+    if (handoff_socket != -1 && upgrade_send(handoff_socket, UPGRADE_READY, -1) == -1)
+    {
+        perror("[ERROR] Couldn't report to the old server");
+        exit(1);
+    }
+
+    while (1)
+    {
+        // While draining, idle connections are looked for regularly, since workers don't wake the main thread
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, draining ? 10 : -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("[ERROR] epoll_wait failed.");
+            exit(1);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            struct connection *connection = events[i].data.ptr;
+
+            if (connection == &udp_endpoint)
+            {
+                read_datagrams(udp_socket, &buffer);
+            }
+            else if (connection == &tcp_listener)
+            {
+                accept_connections(epoll_fd, tcp_socket);
+            }
+            else if (connection == &upgrade_request)
+            {
+                // An upgrade that started earlier can't be started again, a failed one can
+                if (upgrade_requested() && !draining && (drain_socket = start_upgrade(epoll_fd, udp_socket, tcp_socket)) != -1)
+                {
+                    draining = 1;
+                    drain_deadline_ns = timing_now() + option_int("PART_C_UPGRADE_DRAIN_MS", 30000) * 1000000LL;
+                }
+            }
+            else if (connection == &handoff_endpoint)
+            {
+                if (receive_handoff(epoll_fd, handoff_socket, &logger_adopted) == -1)
+                {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, handoff_socket, NULL);
+                    close(handoff_socket);
+                }
+            }
+            else if (read_connection(connection, &buffer, draining) == -1 || (events[i].events & EPOLLERR))
+            {
+                // Closed by the client or broken, queued jobs still hold the connection until they are answered
+                remove_connection(epoll_fd, connection);
+            }
+        }
+
+        if (draining && drain_connections(epoll_fd, drain_socket, drain_deadline_ns))
+        {
+            finish_upgrade(drain_socket);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file    part_c_dispatch.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Worker pool server mode for the part_c RPC server, used instead of svc_run() when PART_C_WORKERS is set.
+ *
+ *  svc_run() handles one request at a time and the rpcgen handlers return static results, so only one blackbox can be running at
+ *  once. In worker pool mode, the main thread reads the calls from the UDP and TCP sockets created by part_c_svc.c, decodes them and
+ *  queues them. Worker threads run the requests with the reentrant handlers below, each writing to its own result, and send the
+ *  encoded reply back on the transport the call came from.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_WORKERS      Number of worker threads, 0 keeps the single threaded svc_run() loop (default 0)
+ *
+ *  Only this mode can be upgraded without downtime with SIGHUP, see part_c_upgrade.h.
+ */
+
+#ifndef PART_C_DISPATCH_H
+#define PART_C_DISPATCH_H
+
+#include "part_c.h"
+
+#include <netinet/in.h>
+
+// Reentrant version of run_binary_1_svc, the result is allocated for the caller and freed with xdr_free()
+extern bool_t run_binary_1_worker(arguments *argp, char **result);
+
+// Reentrant version of run_binary_limited_1_svc, the result is allocated for the caller and freed with xdr_free()
+extern bool_t run_binary_limited_1_worker(limited_arguments *argp, char **result);
+
+// Reentrant version of run_binary_batch_1_svc, the results are allocated for the caller and freed with xdr_free()
+extern bool_t run_binary_batch_1_worker(batch_arguments *argp, batch_results *result);
+
+// Reentrant version of get_stats_1_svc, the phases are allocated for the caller and freed with xdr_free()
+extern bool_t get_stats_1_worker(int *argp, server_stats *result);
+
+// Reentrant version of get_trace_1_svc, the result is allocated for the caller and freed with xdr_free()
+extern bool_t get_trace_1_worker(int *argp, trace_document *result);
+
+// Returns the logger address, reading it from the wrapper if no request did yet
+extern void logger_address_get(struct sockaddr_in *address);
+
+// Uses the logger address handed over by an upgrade instead of reading it from the wrapper
+extern void logger_address_adopt(const struct sockaddr_in *address);
+
+// Serves the registered UDP and TCP sockets with the given number of worker threads. An upgrade is started when upgrade_fd becomes
+// readable, and connections of the old server are received from handoff_socket when it isn't -1. Only returns by exiting
+extern void dispatch_run(int udp_socket, int tcp_socket, int workers, int upgrade_fd, int handoff_socket);
+
+#endif /* PART_C_DISPATCH_H */
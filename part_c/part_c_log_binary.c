@@ -0,0 +1,351 @@
+/**
+ * @file    part_c_log_binary.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Converts log lines to the records of the binary log, and keeps the segment files and their hash indexes.
+ *
+ *  The index of the current segment is a shared file mapping, so it is updated in place as records are encoded and readers see it
+ *  without the logger writing it out. Records themselves go through the append buffer of the logger, so an index slot can point to a
+ *  record that isn't in the segment file yet; part_c_log_query checks every position against the size of the segment. Keys of the
+ *  current segment are also kept in memory, so collisions are resolved without reading records back from the file.
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_log_binary.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LINE_LENGTH 4096
+
+struct log_key
+{
+    int32_t a;
+    int32_t b;
+};
+
+struct binary_log
+{
+    char *prefix;
+    long segment_records;   // Maximum record count of a segment
+    unsigned number;        // Number of the current segment
+
+    int segment_fd;
+    char *index_map;        // Shared mapping of the index file, starting with its header
+    size_t index_size;
+    uint32_t *slots;
+    uint32_t capacity;
+    struct log_key *keys;   // Keys of the records in the current segment, by position
+    uint32_t count;         // Records in the current segment
+
+    char **executables;     // Executable paths, the id of a path is its position + 1
+    uint32_t executable_count, last_executable;
+    int executables_fd;
+};
+
+// Formats the path of a file of the log, kind is seg or idx
+static void segment_path(char *path, size_t size, const char *prefix, unsigned number, const char *kind)
+{
+    snprintf(path, size, "%s.%06u.%s", prefix, number, kind);
+}
+
+// Creates the segment and the index files of the current number, and maps the index
+static int open_segment(struct binary_log *log)
+{
+    char path[PATH_MAX];
+    struct log_segment_header segment_header;
+    struct log_index_header index_header;
+
+    segment_path(path, sizeof(path), log->prefix, log->number, "seg");
+    log->segment_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (log->segment_fd == -1)
+    {
+        return -1;
+    }
+
+    memset(&segment_header, 0, sizeof(segment_header));
+    memcpy(segment_header.magic, LOG_SEGMENT_MAGIC, sizeof(segment_header.magic));
+    segment_header.version = LOG_FORMAT_VERSION;
+    segment_header.record_size = sizeof(struct log_record);
+    if (write(log->segment_fd, &segment_header, sizeof(segment_header)) != sizeof(segment_header))
+    {
+        close(log->segment_fd);
+        return -1;
+    }
+
+    // The file is sized for the whole table up front, untouched slots read as zero which means empty
+    segment_path(path, sizeof(path), log->prefix, log->number, "idx");
+    int index_fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    log->index_size = sizeof(index_header) + (size_t)log->capacity * sizeof(uint32_t);
+    if (index_fd == -1 || ftruncate(index_fd, log->index_size) == -1)
+    {
+        if (index_fd != -1)
+        {
+            close(index_fd);
+        }
+        close(log->segment_fd);
+        return -1;
+    }
+
+    log->index_map = mmap(NULL, log->index_size, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd, 0);
+    close(index_fd);
+    if (log->index_map == MAP_FAILED)
+    {
+        close(log->segment_fd);
+        return -1;
+    }
+
+    memset(&index_header, 0, sizeof(index_header));
+    memcpy(index_header.magic, LOG_INDEX_MAGIC, sizeof(index_header.magic));
+    index_header.version = LOG_FORMAT_VERSION;
+    index_header.capacity = log->capacity;
+    memcpy(log->index_map, &index_header, sizeof(index_header));
+    log->slots = (uint32_t *)(log->index_map + sizeof(index_header));
+    log->count = 0;
+
+    return 0;
+}
+
+// Reads the known executables, so their ids stay the same across runs of the logger
+static int load_executables(struct binary_log *log)
+{
+    char path[PATH_MAX];
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+
+    snprintf(path, sizeof(path), "%s.executables", log->prefix);
+    FILE *file = fopen(path, "r");
+    if (file != NULL)
+    {
+        while ((length = getline(&line, &line_capacity, file)) > 0)
+        {
+            if (line[length - 1] == '\n')
+            {
+                line[length - 1] = '\0';
+            }
+
+            char **executables = realloc(log->executables, (log->executable_count + 1) * sizeof(char *));
+            if (executables == NULL || (executables[log->executable_count] = strdup(line)) == NULL)
+            {
+                free(line);
+                fclose(file);
+                return -1;
+            }
+            log->executables = executables;
+            log->executable_count++;
+        }
+        free(line);
+        fclose(file);
+    }
+
+    log->executables_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    return log->executables_fd == -1 ? -1 : 0;
+}
+
+// Returns the id of an executable path, adding it to the executables file the first time it is seen. Returns 0 if it can't be added
+static uint32_t executable_id(struct binary_log *log, const char *path)
+{
+    // Requests usually repeat the same executable, so the last one is checked before the others
+    if (log->last_executable != 0 && strcmp(log->executables[log->last_executable - 1], path) == 0)
+    {
+        return log->last_executable;
+    }
+    for (uint32_t i = 0; i < log->executable_count; i++)
+    {
+        if (strcmp(log->executables[i], path) == 0)
+        {
+            log->last_executable = i + 1;
+            return log->last_executable;
+        }
+    }
+
+    char **executables = realloc(log->executables, (log->executable_count + 1) * sizeof(char *));
+    if (executables == NULL)
+    {
+        return 0;
+    }
+    log->executables = executables;
+    if ((executables[log->executable_count] = strdup(path)) == NULL)
+    {
+        return 0;
+    }
+
+    size_t length = strlen(path);
+    executables[log->executable_count][length] = '\n';
+    ssize_t written = write(log->executables_fd, executables[log->executable_count], length + 1);
+    executables[log->executable_count][length] = '\0';
+    if (written != (ssize_t)length + 1)
+    {
+        perror("[WARNING] Executable couldn't be added to the executables file");
+        free(executables[log->executable_count]);
+        return 0;
+    }
+
+    log->last_executable = ++log->executable_count;
+    return log->last_executable;
+}
+
+// Parses a decimal number that fits in 32 bits, returns NULL if there is none
+static const char *parse_int32(const char *text, int32_t *value)
+{
+    char *end;
+
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX)
+    {
+        return NULL;
+    }
+
+    *value = (int32_t)parsed;
+    return end;
+}
+
+struct binary_log *binary_log_open(const char *prefix, long segment_records)
+{
+    char path[PATH_MAX];
+    struct stat file_status;
+
+    struct binary_log *log = calloc(1, sizeof(struct binary_log));
+    if (log == NULL || (log->prefix = strdup(prefix)) == NULL)
+    {
+        free(log);
+        return NULL;
+    }
+
+    // Twice the records rounded up to a power of 2, so the table is at most half full and a slot is a mask away
+    log->segment_records = segment_records;
+    log->capacity = 1;
+    while (log->capacity < 2 * segment_records)
+    {
+        log->capacity *= 2;
+    }
+
+    log->keys = malloc(segment_records * sizeof(struct log_key));
+    if (log->keys == NULL || load_executables(log) == -1)
+    {
+        free(log->keys);
+        free(log->prefix);
+        free(log);
+        return NULL;
+    }
+
+    // Segments of earlier runs are kept, this run starts after the last one
+    segment_path(path, sizeof(path), prefix, log->number, "seg");
+    while (stat(path, &file_status) == 0)
+    {
+        log->number++;
+        segment_path(path, sizeof(path), prefix, log->number, "seg");
+    }
+
+    if (open_segment(log) == -1)
+    {
+        close(log->executables_fd);
+        free(log->keys);
+        free(log->prefix);
+        free(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+int binary_log_fd(struct binary_log *log)
+{
+    return log->segment_fd;
+}
+
+int binary_log_full(struct binary_log *log)
+{
+    return log->count >= log->segment_records;
+}
+
+int binary_log_roll(struct binary_log *log)
+{
+    msync(log->index_map, log->index_size, MS_ASYNC);
+    munmap(log->index_map, log->index_size);
+    close(log->segment_fd);
+
+    log->number++;
+    return open_segment(log);
+}
+
+int binary_log_encode(struct binary_log *log, const char *line, size_t length, struct log_record *record)
+{
+    char text[MAX_LINE_LENGTH + 1];
+    const char *position;
+    struct timespec now;
+
+    if (length > MAX_LINE_LENGTH)
+    {
+        return -1;
+    }
+    memcpy(text, line, length);
+    text[length] = '\0';
+
+    memset(record, 0, sizeof(struct log_record));
+
+    // "a b result", "a b _" or "a b timeout", optionally followed by the executable path
+    if ((position = parse_int32(text, &record->a)) == NULL || *position != ' ' ||
+        (position = parse_int32(position + 1, &record->b)) == NULL || *position != ' ')
+    {
+        return -1;
+    }
+    position++;
+    if (*position == '_')
+    {
+        record->status = LOG_STATUS_FAIL;
+        position++;
+    }
+    else if (strncmp(position, "timeout", 7) == 0)
+    {
+        record->status = LOG_STATUS_TIMEOUT;
+        position += 7;
+    }
+    else if ((position = parse_int32(position, &record->result)) == NULL)
+    {
+        return -1;
+    }
+    if (*position == ' ' && position[1] != '\0')
+    {
+        record->executable_id = executable_id(log, position + 1);
+    }
+    else if (*position != '\0')
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->timestamp_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    // Linear probing until the slot of the key or an empty slot. The record becomes the head of its key, and links to the old head
+    uint32_t mask = log->capacity - 1;
+    uint32_t slot = log_key_hash(record->a, record->b) & mask;
+    while (log->slots[slot] != 0)
+    {
+        struct log_key *key = &log->keys[log->slots[slot] - 1];
+        if (key->a == record->a && key->b == record->b)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    record->previous = log->slots[slot];
+    log->keys[log->count].a = record->a;
+    log->keys[log->count].b = record->b;
+    log->count++;
+    log->slots[slot] = log->count;
+
+    return 0;
+}
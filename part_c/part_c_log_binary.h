@@ -0,0 +1,35 @@
+/**
+ * @file    part_c_log_binary.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Writer side of the binary log format of part_c_log_format.h, used by part_c_logger.
+ *
+ *  The logger keeps writing through its own append buffer; this module only turns log lines into records, keeps the hash index of
+ *  the current segment and opens a new segment when the current one is full.
+ */
+
+#ifndef PART_C_LOG_BINARY_H
+#define PART_C_LOG_BINARY_H
+
+#include "part_c_log_format.h"
+
+#include <stddef.h>
+
+struct binary_log;
+
+// Starts a new segment after the existing ones of the prefix, returns NULL on error
+struct binary_log *binary_log_open(const char *prefix, long segment_records);
+
+// File descriptor of the current segment, records are appended to it
+int binary_log_fd(struct binary_log *log);
+
+// Returns 1 when the current segment can't take more records. The caller writes out its buffered records, then calls binary_log_roll()
+int binary_log_full(struct binary_log *log);
+
+// Closes the current segment and its index, and starts the next segment. Returns -1 on error
+int binary_log_roll(struct binary_log *log);
+
+// Converts a "a b result|_ [executable_path]" line without its newline to a record and adds it to the index. Returns -1 for a malformed line
+int binary_log_encode(struct binary_log *log, const char *line, size_t length, struct log_record *record);
+
+#endif /* PART_C_LOG_BINARY_H */
@@ -0,0 +1,74 @@
+/**
+ * @file    part_c_log_format.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Layout of the binary log written by part_c_logger and read by part_c_log_query.
+ *
+ *  A binary log with prefix P is made of these files:
+ *      P.NNNNNN.seg    Segment files, a header followed by fixed size records in the order they were logged
+ *      P.NNNNNN.idx    Hash index of the segment with the same number, keyed on (a, b)
+ *      P.executables   Executable paths, one per line. The executable id of a record is its line number, 0 means unknown
+ *
+ *  The index is an open addressing table with linear probing. Every slot holds 1 + the position of the newest record of a key in the
+ *  segment, or 0 for an empty slot. Older records of the same key are reached through the previous field of the records, so a point
+ *  lookup never looks at records of other keys except for probe collisions. Every run of the logger starts a new segment, and a
+ *  segment is closed when it holds its maximum record count, so segments never need to be rehashed.
+ *
+ *  All fields are stored in the byte order of the host, logs are meant to be read on the machine that wrote them.
+ */
+
+#ifndef PART_C_LOG_FORMAT_H
+#define PART_C_LOG_FORMAT_H
+
+#include <stdint.h>
+
+#define LOG_SEGMENT_MAGIC "PCLOGSEG"
+#define LOG_INDEX_MAGIC "PCLOGIDX"
+#define LOG_FORMAT_VERSION 1
+
+#define LOG_STATUS_SUCCESS 0
+#define LOG_STATUS_FAIL 1
+#define LOG_STATUS_TIMEOUT 2
+
+struct log_segment_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct log_index_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity; // Number of slots, a power of 2
+};
+
+struct log_record
+{
+    int64_t timestamp_ns; // Wall clock time the logger received the line
+    int32_t a;
+    int32_t b;
+    int32_t result;       // Only meaningful when status is LOG_STATUS_SUCCESS
+    uint16_t status;
+    uint16_t reserved;
+    uint32_t executable_id;
+    uint32_t previous;    // 1 + position of the previous record with the same (a, b) in the segment, 0 if there is none
+};
+
+// Hash of an (a, b) key, the index slot is this value masked with capacity - 1
+static inline uint32_t log_key_hash(int32_t a, int32_t b)
+{
+    uint64_t key = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+
+    // Finalizer of MurmurHash3, mixes every bit of the key into the low bits used for the slot
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (uint32_t)key;
+}
+
+#endif /* PART_C_LOG_FORMAT_H */
@@ -0,0 +1,301 @@
+/**
+ * @file    part_c_log_query.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Reads the binary log of part_c_logger without parsing it, by mapping its segments into memory.
+ *
+ *  A point query finds every record of one (a, b) pair through the hash index of each segment, and follows the links between the
+ *  records of the same pair. A range query scans the records of every segment for a in [a_from, a_to], and optionally b in
+ *  [b_from, b_to]. Records are printed oldest first, as "time a b result|_ executable_path".
+ *
+ *  The log can be queried while the logger is writing it. The newest records of the current segment may be indexed before they are
+ *  written to the segment file; when the index points past the end of a segment, that segment is scanned instead.
+ *
+ *  How to run:
+ *  > make
+ *  > ./part_c_log_query.out   log_prefix   point   a   b
+ *  > ./part_c_log_query.out   log_prefix   range   a_from   a_to   [b_from   b_to]
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_log_format.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct query
+{
+    int point;
+    int32_t a_from, a_to, b_from, b_to;
+};
+
+static char **executables;
+static uint32_t executable_count;
+
+// Reads the executable paths, records refer to them by their line number
+static void load_executables(const char *prefix)
+{
+    char path[PATH_MAX];
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+
+    snprintf(path, sizeof(path), "%s.executables", prefix);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    while ((length = getline(&line, &line_capacity, file)) > 0)
+    {
+        if (line[length - 1] == '\n')
+        {
+            line[length - 1] = '\0';
+        }
+
+        char **new_executables = realloc(executables, (executable_count + 1) * sizeof(char *));
+        if (new_executables == NULL)
+        {
+            perror("[ERROR] Memory allocation error.");
+            exit(-1);
+        }
+        executables = new_executables;
+        executables[executable_count++] = line;
+        line = NULL;
+        line_capacity = 0;
+    }
+    free(line);
+    fclose(file);
+}
+
+// Maps a whole file read only, returns NULL if it can't be opened or is smaller than minimum_size
+static void *map_file(const char *path, size_t minimum_size, size_t *size)
+{
+    struct stat file_status;
+    void *map;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &file_status) == -1 || (size_t)file_status.st_size < minimum_size)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    *size = file_status.st_size;
+    map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return map == MAP_FAILED ? NULL : map;
+}
+
+static void print_record(const struct log_record *record)
+{
+    char time_text[32];
+    time_t seconds = record->timestamp_ns / 1000000000LL;
+    struct tm local_time;
+
+    localtime_r(&seconds, &local_time);
+    strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", &local_time);
+    printf("%s.%03d %d %d ", time_text, (int)(record->timestamp_ns % 1000000000LL / 1000000), record->a, record->b);
+
+    if (record->status == LOG_STATUS_SUCCESS)
+    {
+        printf("%d", record->result);
+    }
+    else if (record->status == LOG_STATUS_TIMEOUT)
+    {
+        printf("timeout");
+    }
+    else
+    {
+        printf("_");
+    }
+
+    if (record->executable_id > 0 && record->executable_id <= executable_count)
+    {
+        printf(" %s", executables[record->executable_id - 1]);
+    }
+    printf("\n");
+}
+
+// Prints the records of the segment that match the query, in the order they were logged
+static void scan_segment(const struct log_record *records, uint32_t count, const struct query *query)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (records[i].a >= query->a_from && records[i].a <= query->a_to && records[i].b >= query->b_from && records[i].b <= query->b_to)
+        {
+            print_record(&records[i]);
+        }
+    }
+}
+
+// Finds the records of the point query through the index. Returns -1 if the index can't be used for this segment
+static int lookup_segment(const char *index_path, const struct log_record *records, uint32_t count, const struct query *query)
+{
+    size_t index_size;
+    struct log_index_header *header = map_file(index_path, sizeof(struct log_index_header), &index_size);
+    uint32_t *chain = NULL;
+    uint32_t chain_length = 0, head = 0;
+    int result = -1;
+
+    if (header == NULL)
+    {
+        return -1;
+    }
+    if (memcmp(header->magic, LOG_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->version != LOG_FORMAT_VERSION || header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) != 0 || index_size < sizeof(*header) + (size_t)header->capacity * sizeof(uint32_t))
+    {
+        munmap(header, index_size);
+        return -1;
+    }
+
+    // Probing until the slot of the key or an empty slot, a slot past the written records means the index is ahead of the segment
+    const uint32_t *slots = (const uint32_t *)(header + 1);
+    uint32_t mask = header->capacity - 1;
+    uint32_t slot = log_key_hash(query->a_from, query->b_from) & mask;
+    for (uint32_t probes = 0; probes < header->capacity && slots[slot] != 0; probes++)
+    {
+        if (slots[slot] > count)
+        {
+            munmap(header, index_size);
+            return -1;
+        }
+        if (records[slots[slot] - 1].a == query->a_from && records[slots[slot] - 1].b == query->b_from)
+        {
+            head = slots[slot];
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    // The chain goes from the newest record to the oldest, it is collected first to print it the other way around
+    for (uint32_t position = head; position != 0; position = records[position - 1].previous)
+    {
+        if (position > count || (chain_length > 0 && position >= chain[chain_length - 1]))
+        {
+            goto done; // A broken link, the segment is scanned instead
+        }
+
+        uint32_t *new_chain = realloc(chain, (chain_length + 1) * sizeof(uint32_t));
+        if (new_chain == NULL)
+        {
+            goto done;
+        }
+        chain = new_chain;
+        chain[chain_length++] = position;
+    }
+
+    while (chain_length > 0)
+    {
+        print_record(&records[chain[--chain_length] - 1]);
+    }
+    result = 0;
+
+done:
+    free(chain);
+    munmap(header, index_size);
+    return result;
+}
+
+// Parses a 32 bit integer argument, exits with an error if it isn't one
+static int32_t parse_argument(const char *text)
+{
+    char *end;
+
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || value < INT32_MIN || value > INT32_MAX)
+    {
+        fprintf(stderr, "[ERROR] %s is not a 32 bit integer\n", text);
+        exit(-1);
+    }
+    return (int32_t)value;
+}
+
+int main(int argc, char **argv)
+{
+    char segment_file[PATH_MAX], index_file[PATH_MAX];
+    struct query query;
+    size_t segment_size;
+
+    // Checking the arguments
+    if (argc == 5 && strcmp(argv[2], "point") == 0)
+    {
+        query.point = 1;
+        query.a_from = query.a_to = parse_argument(argv[3]);
+        query.b_from = query.b_to = parse_argument(argv[4]);
+    }
+    else if ((argc == 5 || argc == 7) && strcmp(argv[2], "range") == 0)
+    {
+        query.point = 0;
+        query.a_from = parse_argument(argv[3]);
+        query.a_to = parse_argument(argv[4]);
+        query.b_from = argc == 7 ? parse_argument(argv[5]) : INT32_MIN;
+        query.b_to = argc == 7 ? parse_argument(argv[6]) : INT32_MAX;
+    }
+    else
+    {
+        fprintf(stderr, "[ERROR] Correct usage: %s log_prefix point a b\n", argv[0]);
+        fprintf(stderr, "                       %s log_prefix range a_from a_to [b_from b_to]\n", argv[0]);
+        return -1;
+    }
+
+    load_executables(argv[1]);
+
+    // Segments are numbered from 0 without gaps, older segments first
+    for (unsigned number = 0;; number++)
+    {
+        snprintf(segment_file, sizeof(segment_file), "%s.%06u.seg", argv[1], number);
+        snprintf(index_file, sizeof(index_file), "%s.%06u.idx", argv[1], number);
+
+        if (access(segment_file, F_OK) == -1)
+        {
+            if (number == 0)
+            {
+                fprintf(stderr, "[ERROR] No binary log was found with prefix %s\n", argv[1]);
+                return -1;
+            }
+            break;
+        }
+
+        struct log_segment_header *header = map_file(segment_file, sizeof(struct log_segment_header), &segment_size);
+        if (header == NULL)
+        {
+            continue; // A segment whose header isn't written yet has no records
+        }
+        if (memcmp(header->magic, LOG_SEGMENT_MAGIC, sizeof(header->magic)) != 0 || header->version != LOG_FORMAT_VERSION ||
+            header->record_size != sizeof(struct log_record))
+        {
+            fprintf(stderr, "[WARNING] %s is not a segment of this log format, skipping it\n", segment_file);
+            munmap(header, segment_size);
+            continue;
+        }
+
+        // A record that is only partly written is left out
+        const struct log_record *records = (const struct log_record *)(header + 1);
+        uint32_t count = (segment_size - sizeof(*header)) / sizeof(struct log_record);
+
+        if (!query.point || lookup_segment(index_file, records, count, &query) == -1)
+        {
+            scan_segment(records, count, &query);
+        }
+        munmap(header, segment_size);
+    }
+
+    return 0;
+}
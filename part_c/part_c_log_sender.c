@@ -0,0 +1,336 @@
+/**
+ * @file    part_c_log_sender.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Sends the log lines of the part_c server to the logger over one long lived TCP connection.
+ *
+ *  Lines are kept in a ring of fixed size slots. The sender thread reserves every queued line, writes them from their slots without
+ *  copying, and only then frees the slots, so producers never overwrite a line that is being written. A line that was cut by a
+ *  broken connection is sent again from its start on the next connection; the logger discards the incomplete line of a closed
+ *  connection, so the log doesn't get half lines. The lines written completely before the break aren't sent again, so the log
+ *  doesn't get them twice either.
+ *
+ *  When the server is upgraded (part_c_upgrade.h), the old sender stops once its queue is empty and gives its connection away, and
+ *  the sender of the new server waits for that connection before it writes anything, so the lines of the two servers don't mix.
+ *
+ *  Socket codes are learned and referenced from https://www.binarytides.com/socket-programming-c-linux-tutorial/
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_log_sender.h"
+#include "options.h"
+#include "part_c_timing.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INITIAL_BACKOFF_MS 100
+
+struct log_line
+{
+    char text[LOG_LINE_SIZE];
+    size_t length;
+};
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t handoff_done = PTHREAD_COND_INITIALIZER;
+
+static struct log_line *lines;
+static size_t capacity, head, count; // Queued lines are the count slots starting from head
+static int drop_when_full;
+static unsigned long dropped, dropped_reported;
+
+static struct sockaddr_in logger_address;
+static long max_backoff_ms;
+
+// Connection handed over between an upgraded server and its successor, protected by queue_lock
+static int adopting, adopted_socket = -1;
+static int detach_requested, detached, detached_socket = -1;
+
+// Sleeps for the given milliseconds
+static void sleep_ms(long milliseconds)
+{
+    struct timespec duration = {milliseconds / 1000, (milliseconds % 1000) * 1000000};
+    while (nanosleep(&duration, &duration) == -1 && errno == EINTR)
+        ;
+}
+
+// Connects to the logger, retrying with exponential backoff until it succeeds
+static int connect_logger(void)
+{
+    long backoff_ms = INITIAL_BACKOFF_MS;
+    int logger_socket;
+    long long started_ns = timing_now();
+
+    while (1)
+    {
+        logger_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (logger_socket != -1 && connect(logger_socket, (struct sockaddr *)&logger_address, sizeof(logger_address)) == 0)
+        {
+            // Time of the connection including the failed attempts before it
+            timing_record(PHASE_LOGGER_CONNECT, started_ns);
+            return logger_socket;
+        }
+
+        perror("[WARNING] Logger connection failed, retrying");
+        if (logger_socket != -1)
+        {
+            close(logger_socket);
+        }
+
+        sleep_ms(backoff_ms);
+        backoff_ms = backoff_ms * 2 > max_backoff_ms ? max_backoff_ms : backoff_ms * 2;
+    }
+}
+
+// Writes every vector completely, returns -1 if the connection broke. completed is the number of vectors that were written completely,
+// also when it broke. sendmsg is used as writev with MSG_NOSIGNAL, so a closed logger connection doesn't kill the server with SIGPIPE
+static int write_lines(int logger_socket, struct iovec *vectors, int vector_count, int *completed)
+{
+    struct msghdr message;
+
+    *completed = 0;
+
+    while (vector_count > 0)
+    {
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = vector_count;
+
+        ssize_t written = sendmsg(logger_socket, &message, MSG_NOSIGNAL);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // Skipping the vectors that are written completely, and moving into the one that is written partially
+        while (vector_count > 0 && (size_t)written >= vectors->iov_len)
+        {
+            written -= vectors->iov_len;
+            vectors++;
+            vector_count--;
+            (*completed)++;
+        }
+        if (vector_count > 0)
+        {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+// Takes every queued line, writes them to the logger in one call and frees their slots
+static void *sender_thread(void *unused)
+{
+    struct iovec vectors[IOV_MAX];
+    int logger_socket;
+
+    pthread_mutex_lock(&queue_lock);
+    while (adopting)
+    {
+        pthread_cond_wait(&handoff_done, &queue_lock);
+    }
+    logger_socket = adopted_socket;
+    pthread_mutex_unlock(&queue_lock);
+    if (logger_socket == -1)
+    {
+        logger_socket = connect_logger();
+    }
+
+    while (1)
+    {
+        pthread_mutex_lock(&queue_lock);
+        while (count == 0 && !detach_requested)
+        {
+            pthread_cond_wait(&queue_not_empty, &queue_lock);
+        }
+
+        // Every line is sent, the connection goes to the server that replaces this one
+        if (count == 0)
+        {
+            detached_socket = logger_socket;
+            detached = 1;
+            pthread_cond_broadcast(&handoff_done);
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        if (dropped != dropped_reported)
+        {
+            fprintf(stderr, "[WARNING] %lu log lines were dropped because the logger queue was full.\n", dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+
+        // Slots stay reserved while they are written, producers only use the slots after head + count
+        int vector_count = count < IOV_MAX ? count : IOV_MAX;
+        for (int i = 0; i < vector_count; i++)
+        {
+            struct log_line *line = &lines[(head + i) % capacity];
+            vectors[i].iov_base = line->text;
+            vectors[i].iov_len = line->length;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        // On failure the lines that weren't written completely are written again after reconnecting, the cut one from its first byte.
+        // The lines before it already reached the logger, sending them again would duplicate them
+        long long started_ns = timing_now();
+        int done = 0, completed;
+        while (write_lines(logger_socket, vectors + done, vector_count - done, &completed) == -1)
+        {
+            perror("[WARNING] Couldn't send message to the logger, reconnecting");
+            close(logger_socket);
+            logger_socket = connect_logger();
+
+            done += completed;
+            for (int i = done; i < vector_count; i++)
+            {
+                struct log_line *line = &lines[(head + i) % capacity];
+                vectors[i].iov_base = line->text;
+                vectors[i].iov_len = line->length;
+            }
+        }
+        timing_record(PHASE_LOGGER_SEND, started_ns);
+
+        pthread_mutex_lock(&queue_lock);
+        head = (head + vector_count) % capacity;
+        count -= vector_count;
+        pthread_cond_broadcast(&queue_not_full);
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    return NULL;
+}
+
+void log_sender_start_adopting(struct sockaddr_in *address)
+{
+    adopting = 1;
+    log_sender_start(address);
+}
+
+void log_sender_adopt(int logger_socket)
+{
+    pthread_mutex_lock(&queue_lock);
+    if (adopting)
+    {
+        adopting = 0;
+        adopted_socket = logger_socket;
+        pthread_cond_broadcast(&handoff_done);
+    }
+    else if (logger_socket != -1)
+    {
+        close(logger_socket);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+int log_sender_detach(long timeout_ms)
+{
+    struct timespec deadline;
+    int result = -1;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    if (lines != NULL)
+    {
+        detach_requested = 1;
+        pthread_cond_signal(&queue_not_empty);
+        while (!detached && pthread_cond_timedwait(&handoff_done, &queue_lock, &deadline) == 0)
+        {
+        }
+        if (detached)
+        {
+            result = detached_socket;
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return result;
+}
+
+void log_sender_start(struct sockaddr_in *address)
+{
+    pthread_t thread;
+
+    logger_address = *address;
+    long queue_size = option_int("PART_C_LOG_QUEUE", 4096);
+    capacity = queue_size < 1 ? 4096 : queue_size;
+    drop_when_full = strcmp(option_string("PART_C_LOG_FULL_POLICY", "block"), "drop") == 0;
+    max_backoff_ms = option_int("PART_C_LOG_MAX_BACKOFF_MS", 5000);
+    if (max_backoff_ms < INITIAL_BACKOFF_MS)
+    {
+        max_backoff_ms = INITIAL_BACKOFF_MS;
+    }
+
+    lines = calloc(capacity, sizeof(struct log_line));
+    if (lines == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        exit(-1);
+    }
+
+    if (pthread_create(&thread, NULL, sender_thread, NULL) != 0)
+    {
+        fprintf(stderr, "[ERROR] Couldn't create logger sender thread.\n");
+        exit(-1);
+    }
+}
+
+void log_sender_send(const char *line)
+{
+    pthread_mutex_lock(&queue_lock);
+    while (count == capacity)
+    {
+        if (drop_when_full)
+        {
+            dropped++;
+            pthread_mutex_unlock(&queue_lock);
+            return;
+        }
+        pthread_cond_wait(&queue_not_full, &queue_lock);
+    }
+
+    struct log_line *slot = &lines[(head + count) % capacity];
+    slot->length = strlen(line);
+    if (slot->length >= LOG_LINE_SIZE)
+    {
+        slot->length = LOG_LINE_SIZE - 1;
+    }
+    memcpy(slot->text, line, slot->length);
+    count++;
+
+    pthread_cond_signal(&queue_not_empty);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+unsigned long log_sender_dropped(void)
+{
+    pthread_mutex_lock(&queue_lock);
+    unsigned long result = dropped;
+    pthread_mutex_unlock(&queue_lock);
+
+    return result;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file    part_c_log_sender.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Sends the log lines of the part_c server to the logger over one long lived TCP connection.
+ *
+ *  Requests only put their log line into a bounded in-memory queue. A background sender thread owns the connection to the logger,
+ *  takes every queued line at once and writes them with a single gathering sendmsg() call. If the logger can't be reached, the sender reconnects
+ *  with exponential backoff while the lines wait in the queue, so a logger outage doesn't stop the server.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_LOG_QUEUE            Number of lines the queue holds (default 4096)
+ *      PART_C_LOG_FULL_POLICY      "block" waits for room when the queue is full, "drop" drops and counts the line (default block)
+ *      PART_C_LOG_MAX_BACKOFF_MS   Longest wait between reconnection attempts, starting from 100 ms and doubling (default 5000)
+ */
+
+#ifndef PART_C_LOG_SENDER_H
+#define PART_C_LOG_SENDER_H
+
+#include <netinet/in.h>
+
+#define LOG_LINE_SIZE 256
+
+// Starts the sender thread for the logger at the given address, should be called once before log_sender_send()
+void log_sender_start(struct sockaddr_in *address);
+
+// Same as log_sender_start(), but the sender waits for a connection given with log_sender_adopt() before connecting by itself. Used by
+// a server started by an upgrade, which gets the connection of the old server once its lines are sent
+void log_sender_start_adopting(struct sockaddr_in *address);
+
+// Gives the sender the connection to use, or -1 to make it connect by itself
+void log_sender_adopt(int logger_socket);
+
+// Waits up to timeout_ms until every queued line is sent, then stops the sender and returns its connection. Returns -1 when there
+// isn't a sender or it didn't finish in time
+int log_sender_detach(long timeout_ms);
+
+// Queues a line for the logger, lines longer than LOG_LINE_SIZE are cut
+void log_sender_send(const char *line);
+
+// Returns the number of lines dropped because the queue was full
+unsigned long log_sender_dropped(void);
+
+#endif /* PART_C_LOG_SENDER_H */
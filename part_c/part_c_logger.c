@@ -2,31 +2,377 @@
  * @file    part_c_logger.c
  * @author  Erim Erkin Doğan
  *
- * @brief   This code creates a socket and listens for part_c_server to send data. Then the data is outputted to given output file. Only supports 1 concurrent connection.
- * 
- *  With use of TCP sockets, this program listens sets up a socket in given port number and listens for connections. Only one connection at a time is possible. 
- *  Received data from part_c_server is then outputted to a file in given command line arguments. Supports queue of 5 requests, will run until an error or force termination.
- * 
- *  Referenced from: https://www.binarytides.com/socket-programming-c-linux-tutorial/ 
- * 
+ * @brief   This code creates a socket and listens for part_c_server to send data. Then the data is outputted to given output file. Supports many concurrent connections.
+ *
+ *  With use of TCP sockets, this program listens sets up a socket in given port number and listens for connections. The listening socket and every accepted
+ *  connection are non-blocking and watched with epoll, so many servers (or many threads of one server) can send logs at the same time without waiting for each other.
+ *  Received data of each connection is collected in its own buffer, and only complete lines are written to the file given in command line arguments, so lines
+ *  from different senders never mix. An incomplete line left in a closed connection is discarded. Will run until an error or force termination.
+ *
+ *  Complete lines are gathered in an append buffer, which is written to the file in one write() when it reaches PART_C_LOG_FLUSH_BYTES or when its oldest
+ *  line has waited PART_C_LOG_FLUSH_MS, whichever comes first. How the written data is made durable is chosen with PART_C_LOG_DURABILITY:
+ *      none        Data is left to the page cache (default)
+ *      interval    fdatasync() at most every PART_C_LOG_SYNC_INTERVAL_MS milliseconds while there is unsynced data (default 100)
+ *      batch       fdatasync() after every write of the append buffer
+ *  Every PART_C_LOG_STATS_INTERVAL seconds (default 10, 0 disables it) with traffic, bytes/sec and lines/sec are printed to STDERR.
+ *
+ *  With PART_C_LOG_FORMAT=binary the log path is used as a prefix, and every line is stored as a fixed size record in segment files with
+ *  a hash index on (a, b), as described in part_c_log_format.h. A segment holds PART_C_LOG_SEGMENT_RECORDS records (default 1048576).
+ *  The log is read with part_c_log_query.
+ *
+ *  Referenced from: https://www.binarytides.com/socket-programming-c-linux-tutorial/
+ *
  *  How to run:
  *  > make
  *  > ./part_c_logger.out   output_path.log     port_number
+ *  > PART_C_LOG_FORMAT=binary ./part_c_logger.out   output_prefix     port_number
  */
 
+#define _GNU_SOURCE
+
+#include "options.h"
+#include "part_c_log_binary.h"
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <time.h>
+
+#define MAX_EVENTS 64
+#define RECEIVE_BUFFER_SIZE 65536
+#define MAX_LINE_LENGTH 4096 // A connection sending a longer line without a newline is closed
+
+// Line reassembly buffer of an accepted connection
+struct client
+{
+    int fd;
+    char *pending; // Received bytes after the last complete line
+    size_t length;
+};
+
+enum durability
+{
+    DURABILITY_NONE,
+    DURABILITY_INTERVAL,
+    DURABILITY_BATCH
+};
+
+// Append buffer of complete lines waiting to be written to the log file
+struct log_writer
+{
+    int fd;
+    char *buffer;
+    size_t length, capacity;
+    size_t flush_bytes;
+    long flush_ms, sync_interval_ms;
+    enum durability durability;
+    struct binary_log *binary;  // NULL when lines are written as text
+
+    long long oldest_line_at;   // When the first line in the buffer was added
+    long long last_sync_at;
+    int unsynced;               // Set when data was written after the last fdatasync
+
+    // Statistics since the last report
+    unsigned long long bytes, lines, flushes, syncs;
+    long long stats_started_at;
+};
+
+static int listening_socket;
+
+// Returns the current monotonic time in milliseconds
+static long long now_ms(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000LL + time.tv_nsec / 1000000;
+}
+
+// Writes the whole append buffer to the file in one batch, then syncs it if the durability mode asks for it
+static void flush_log(struct log_writer *writer)
+{
+    size_t written = 0;
+
+    while (written < writer->length)
+    {
+        ssize_t result = write(writer->fd, writer->buffer + written, writer->length - written);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("[ERROR] Log file couldn't be written");
+            exit(-1);
+        }
+        written += result;
+    }
+
+    if (writer->length > 0)
+    {
+        writer->flushes++;
+        writer->unsynced = 1;
+    }
+    writer->length = 0;
+
+    if (writer->unsynced && (writer->durability == DURABILITY_BATCH ||
+                             (writer->durability == DURABILITY_INTERVAL && now_ms() - writer->last_sync_at >= writer->sync_interval_ms)))
+    {
+        fdatasync(writer->fd);
+        writer->syncs++;
+        writer->unsynced = 0;
+        writer->last_sync_at = now_ms();
+    }
+}
+
+// Adds complete lines to the append buffer, flushing it when it is full
+static void append_lines(struct log_writer *writer, const char *data, size_t length, unsigned long long lines)
+{
+    if (writer->length + length > writer->capacity)
+    {
+        flush_log(writer);
+    }
+    if (writer->length == 0)
+    {
+        writer->oldest_line_at = now_ms();
+    }
+
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+    writer->bytes += length;
+    writer->lines += lines;
+
+    if (writer->length >= writer->flush_bytes)
+    {
+        flush_log(writer);
+    }
+}
+
+// Writes out the records of the full segment, makes them durable if asked, and continues in a new segment
+static void roll_segment(struct log_writer *writer)
+{
+    flush_log(writer);
+    if (writer->unsynced && writer->durability != DURABILITY_NONE)
+    {
+        fdatasync(writer->fd);
+        writer->syncs++;
+        writer->unsynced = 0;
+    }
+
+    if (binary_log_roll(writer->binary) == -1)
+    {
+        perror("[ERROR] Next log segment couldn't be created");
+        exit(-1);
+    }
+    writer->fd = binary_log_fd(writer->binary);
+}
+
+// Flushes and syncs the data whose time has come, and returns how long epoll can wait until the next deadline
+static int run_timers(struct log_writer *writer, long stats_interval_ms)
+{
+    long long now = now_ms();
+    long long next = -1;
+
+    if (writer->length > 0 && now - writer->oldest_line_at >= writer->flush_ms)
+    {
+        flush_log(writer);
+    }
+    else if (writer->unsynced && writer->durability == DURABILITY_INTERVAL && now - writer->last_sync_at >= writer->sync_interval_ms)
+    {
+        flush_log(writer); // Nothing to write, only syncs the data of earlier batches
+    }
+
+    if (stats_interval_ms > 0 && now - writer->stats_started_at >= stats_interval_ms)
+    {
+        double seconds = (now - writer->stats_started_at) / 1000.0;
+        if (writer->lines > 0)
+        {
+            fprintf(stderr, "[STATS] %.0f bytes/sec, %.0f lines/sec, %llu writes, %llu syncs\n", writer->bytes / seconds, writer->lines / seconds,
+                    writer->flushes, writer->syncs);
+        }
+        writer->bytes = writer->lines = writer->flushes = writer->syncs = 0;
+        writer->stats_started_at = now;
+    }
+
+    // Earliest of the flush, sync and stats deadlines
+    if (writer->length > 0)
+    {
+        next = writer->oldest_line_at + writer->flush_ms;
+    }
+    if (writer->unsynced && writer->durability == DURABILITY_INTERVAL && (next == -1 || writer->last_sync_at + writer->sync_interval_ms < next))
+    {
+        next = writer->last_sync_at + writer->sync_interval_ms;
+    }
+    if (stats_interval_ms > 0 && (next == -1 || writer->stats_started_at + stats_interval_ms < next))
+    {
+        next = writer->stats_started_at + stats_interval_ms;
+    }
+
+    return next == -1 ? -1 : (next > now ? next - now : 0);
+}
+
+// Accepts every waiting connection and starts watching them
+static void accept_clients(int epoll_fd)
+{
+    struct epoll_event event;
+    struct sockaddr_in client_address;
+    socklen_t address_length = sizeof(client_address);
+    int client_fd;
+
+    while ((client_fd = accept4(listening_socket, (struct sockaddr *)&client_address, &address_length, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        struct client *client = calloc(1, sizeof(struct client));
+        if (client == NULL || (client->pending = malloc(MAX_LINE_LENGTH)) == NULL)
+        {
+            perror("[ERROR] Memory allocation error. Closing the connection.");
+            free(client);
+            close(client_fd);
+            continue;
+        }
+        client->fd = client_fd;
+
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1)
+        {
+            perror("[ERROR] Client connection couldn't be watched.");
+            close(client_fd);
+            free(client->pending);
+            free(client);
+        }
+        address_length = sizeof(client_address);
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        perror("[ERROR] Client connection couldn't be accepted. Trying another connection.\n");
+    }
+}
+
+// Counts the newline characters in the data
+static unsigned long long count_lines(const char *data, size_t length)
+{
+    unsigned long long lines = 0;
+    const char *end = data + length;
+
+    while ((data = memchr(data, '\n', end - data)) != NULL)
+    {
+        lines++;
+        data++;
+    }
+    return lines;
+}
+
+// Adds complete lines to the log. Text lines are added as they are, in the binary format every line becomes one record
+static void add_lines(struct log_writer *writer, const char *data, size_t length)
+{
+    const char *end = data + length, *newline;
+    struct log_record record;
+
+    if (writer->binary == NULL)
+    {
+        append_lines(writer, data, length, count_lines(data, length));
+        return;
+    }
+
+    while ((newline = memchr(data, '\n', end - data)) != NULL)
+    {
+        if (binary_log_full(writer->binary))
+        {
+            roll_segment(writer);
+        }
+
+        if (binary_log_encode(writer->binary, data, newline - data, &record) == 0)
+        {
+            append_lines(writer, (const char *)&record, sizeof(record), 1);
+        }
+        else
+        {
+            fprintf(stderr, "[WARNING] Malformed log line is skipped: %.*s\n", (int)(newline - data), data);
+        }
+        data = newline + 1;
+    }
+}
+
+// Reads everything the client has sent and adds its complete lines to the append buffer. Returns -1 when the connection should be closed
+static int read_client(struct client *client, struct log_writer *writer)
+{
+    static char buffer[RECEIVE_BUFFER_SIZE];
+
+    while (1)
+    {
+        ssize_t read_size = read(client->fd, buffer, sizeof(buffer));
+        if (read_size == 0)
+        {
+            return -1;
+        }
+        if (read_size == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            perror("[ERROR] The message couldn't be received");
+            return -1;
+        }
+
+        char *first_newline = memchr(buffer, '\n', read_size);
+        char *end = buffer + read_size, *rest = buffer;
+
+        if (first_newline != NULL)
+        {
+            // The first line completes the incomplete line of the connection, it is added right after it so they stay together
+            if (client->length > 0)
+            {
+                if (client->length + (first_newline + 1 - buffer) > MAX_LINE_LENGTH)
+                {
+                    fprintf(stderr, "[ERROR] A client sent a line longer than %d bytes. Closing the connection.\n", MAX_LINE_LENGTH);
+                    return -1;
+                }
+                memcpy(client->pending + client->length, buffer, first_newline + 1 - buffer);
+                add_lines(writer, client->pending, client->length + (first_newline + 1 - buffer));
+                client->length = 0;
+                rest = first_newline + 1;
+            }
+
+            // Every other complete line in the received data is added in one piece
+            char *last_newline = memrchr(rest, '\n', end - rest);
+            if (last_newline != NULL)
+            {
+                add_lines(writer, rest, last_newline + 1 - rest);
+                rest = last_newline + 1;
+            }
+        }
+
+        // Keeping the incomplete line at the end until the rest of it arrives
+        if (client->length + (end - rest) > MAX_LINE_LENGTH)
+        {
+            fprintf(stderr, "[ERROR] A client sent a line longer than %d bytes. Closing the connection.\n", MAX_LINE_LENGTH);
+            return -1;
+        }
+        memcpy(client->pending + client->length, rest, end - rest);
+        client->length += end - rest;
+    }
+}
 
 int main(int argc, char **argv)
 {
     char *log_path;
-    int socket_address, client_address, port, address_length;
-    struct sockaddr_in server, client;
-    char client_message[5];
+    int port, epoll_fd, reuse = 1;
+    struct sockaddr_in server;
+    struct epoll_event event, events[MAX_EVENTS];
+    struct log_writer writer;
+    long stats_interval_ms;
 
     // Checking argument count
     if (argc != 3)
@@ -40,11 +386,13 @@ int main(int argc, char **argv)
     port = atoi(argv[2]);
 
     //Create socket
-    socket_address = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_address == -1)
+    listening_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listening_socket == -1)
     {
         fprintf(stderr, "[ERROR] Socket couldn't be created.");
+        return -1;
     }
+    setsockopt(listening_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
     // Preparing the sockaddr_in structure
     server.sin_family = AF_INET;
@@ -52,44 +400,120 @@ int main(int argc, char **argv)
     server.sin_port = htons(port);
 
     // Binding socket
-    if (bind(socket_address, (struct sockaddr *)&server, sizeof(server)) == -1)
+    if (bind(listening_socket, (struct sockaddr *)&server, sizeof(server)) == -1)
     {
         perror("[ERROR] Socket couldn't bind to given port");
         return -1;
     }
     // Listening for clients
-    listen(socket_address, 5);
-
-    FILE *output_file;
-    output_file = fopen(log_path, "a");
+    listen(listening_socket, SOMAXCONN);
 
-    // Accept connections
-    address_length = sizeof(struct sockaddr_in);
-    while ((client_address = accept(socket_address, (struct sockaddr *)&client, (socklen_t *)&address_length)))
+    // Opening the log file (or the first segment of the binary log) for appending, and preparing the append buffer with the configured
+    // flush and durability options
+    memset(&writer, 0, sizeof(writer));
+    const char *format = option_string("PART_C_LOG_FORMAT", "text");
+    if (strcmp(format, "binary") == 0)
+    {
+        long segment_records = option_int("PART_C_LOG_SEGMENT_RECORDS", 1048576);
+        writer.binary = binary_log_open(log_path, segment_records < 1 ? 1048576 : segment_records);
+        if (writer.binary == NULL)
+        {
+            perror("[ERROR] Binary log couldn't be opened");
+            return -1;
+        }
+        writer.fd = binary_log_fd(writer.binary);
+    }
+    else if (strcmp(format, "text") == 0)
     {
-        // Checking if connection is valid
-        if (client_address == -1)
+        writer.fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (writer.fd == -1)
         {
-            perror("[ERROR] Client connection couldn't be accepted. Trying another connection.\n");
+            perror("[ERROR] Log file couldn't be opened");
+            return -1;
         }
+    }
+    else
+    {
+        fprintf(stderr, "[ERROR] Unknown log format %s, expected text or binary\n", format);
+        return -1;
+    }
+
+    long flush_bytes = option_int("PART_C_LOG_FLUSH_BYTES", 65536);
+    writer.flush_bytes = flush_bytes < 1 ? 65536 : flush_bytes;
+    // A chunk given to append_lines() is at most one received buffer of lines, it has to fit into the empty buffer after a flush
+    writer.capacity = (writer.flush_bytes > RECEIVE_BUFFER_SIZE ? writer.flush_bytes : RECEIVE_BUFFER_SIZE) + MAX_LINE_LENGTH;
+    writer.flush_ms = option_int("PART_C_LOG_FLUSH_MS", 10);
+    writer.sync_interval_ms = option_int("PART_C_LOG_SYNC_INTERVAL_MS", 100);
+    stats_interval_ms = option_int("PART_C_LOG_STATS_INTERVAL", 10) * 1000;
 
-        //Receive messages from client
-        ssize_t read_size;
-        while ((read_size = read(client_address, client_message, sizeof(client_message))) > 0)
+    const char *durability = option_string("PART_C_LOG_DURABILITY", "none");
+    if (strcmp(durability, "batch") == 0)
+    {
+        writer.durability = DURABILITY_BATCH;
+    }
+    else if (strcmp(durability, "interval") == 0)
+    {
+        writer.durability = DURABILITY_INTERVAL;
+    }
+    else if (strcmp(durability, "none") != 0)
+    {
+        fprintf(stderr, "[ERROR] Unknown durability mode %s, expected none, interval or batch\n", durability);
+        return -1;
+    }
+
+    writer.buffer = malloc(writer.capacity);
+    if (writer.buffer == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return -1;
+    }
+    writer.last_sync_at = writer.stats_started_at = now_ms();
+
+    // Watching the listening socket, client connections are added as they are accepted
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listening_socket, &event) == -1)
+    {
+        perror("[ERROR] Couldn't watch the socket");
+        return -1;
+    }
+
+    while (1)
+    {
+        // Waiting for data until the next flush, sync or stats deadline
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, run_timers(&writer, stats_interval_ms));
+        if (count == -1)
         {
-            client_message[read_size] = '\0';               //adding eos char
-            fprintf(output_file, "%s", client_message);     // printing the message
-            fflush(output_file);                            //flushing file so it doesn't buffer
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("[ERROR] Waiting for connections failed");
+            break;
         }
 
-        if (read_size == -1)
+        for (int i = 0; i < count; i++)
         {
-            perror("[ERROR] The message couldn't be received");
-            return -1;
+            struct client *client = events[i].data.ptr;
+
+            if (client == NULL)
+            {
+                accept_clients(epoll_fd);
+            }
+            else if (read_client(client, &writer) == -1 || (events[i].events & EPOLLERR))
+            {
+                // Closing the connection, an incomplete line it left is dropped
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+                close(client->fd);
+                free(client->pending);
+                free(client);
+            }
         }
     }
 
-    fclose(output_file); // Close output file
+    flush_log(&writer);
+    close(writer.fd); // Close output file
 
     return 0;
-}
\ No newline at end of file
+}
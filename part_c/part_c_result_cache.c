@@ -0,0 +1,352 @@
+/**
+ * @file    part_c_result_cache.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Sharded LRU cache of blackbox results.
+ *
+ *  A key is hashed once; its high bits choose the shard and its low bits the bucket in the shard's chained hash table. Each shard
+ *  has its own lock, table and recency list, so threads running different pairs rarely wait for each other. Tables double when they
+ *  hold more entries than buckets.
+ */
+
+#include "part_c_result_cache.h"
+#include "options.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INITIAL_BUCKETS 64
+
+struct cache_key
+{
+    dev_t device;
+    ino_t inode;
+    struct timespec modification_time;
+    off_t size;
+    int a, b;
+};
+
+struct cache_entry
+{
+    struct cache_key key;
+    uint64_t hash;
+    size_t memory;                      // Bytes the entry counts against the budget
+    struct cache_entry *bucket_next;
+    struct cache_entry *newer, *older;  // Recency list of the shard
+    char result[];
+};
+
+struct cache_shard
+{
+    pthread_mutex_t lock;
+    struct cache_entry **buckets;
+    size_t bucket_count, entry_count;
+    struct cache_entry *newest, *oldest;
+    size_t memory;
+    unsigned long hits, misses, evictions;
+};
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static struct cache_shard *shards;
+static unsigned shard_count;
+static size_t shard_budget;
+static long report_interval_ms;
+static long long last_report_at;
+
+// Returns the current monotonic time in milliseconds
+static long long now_ms(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000LL + time.tv_nsec / 1000000;
+}
+
+// Reads the configuration and allocates the shards
+static void cache_init(void)
+{
+    long budget = option_int("PART_C_CACHE_BYTES", 0);
+    if (budget <= 0)
+    {
+        return;
+    }
+
+    long count = option_int("PART_C_CACHE_SHARDS", 16);
+    shard_count = count < 1 ? 1 : count;
+    shard_budget = budget / shard_count;
+    report_interval_ms = option_int("PART_C_CACHE_REPORT_INTERVAL", 10) * 1000;
+    last_report_at = now_ms();
+
+    shards = calloc(shard_count, sizeof(struct cache_shard));
+    if (shards == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        exit(-1);
+    }
+    for (unsigned i = 0; i < shard_count; i++)
+    {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].bucket_count = INITIAL_BUCKETS;
+        shards[i].buckets = calloc(INITIAL_BUCKETS, sizeof(struct cache_entry *));
+        if (shards[i].buckets == NULL)
+        {
+            perror("[ERROR] Memory allocation error.");
+            exit(-1);
+        }
+    }
+}
+
+static void make_key(struct cache_key *key, const struct stat *executable, int a, int b)
+{
+    // Zeroed first, so padding doesn't change the hash
+    memset(key, 0, sizeof(struct cache_key));
+    key->device = executable->st_dev;
+    key->inode = executable->st_ino;
+    key->modification_time = executable->st_mtim;
+    key->size = executable->st_size;
+    key->a = a;
+    key->b = b;
+}
+
+// FNV-1a over the key bytes, then a final mix so both the high and the low bits are usable
+static uint64_t hash_key(const struct cache_key *key)
+{
+    const unsigned char *bytes = (const unsigned char *)key;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < sizeof(struct cache_key); i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static struct cache_shard *shard_of(uint64_t hash)
+{
+    return &shards[(hash >> 32) % shard_count];
+}
+
+// Finds the entry of the key in the shard, the shard should be locked
+static struct cache_entry **find_entry(struct cache_shard *shard, const struct cache_key *key, uint64_t hash)
+{
+    struct cache_entry **link = &shard->buckets[hash & (shard->bucket_count - 1)];
+
+    while (*link != NULL && ((*link)->hash != hash || memcmp(&(*link)->key, key, sizeof(struct cache_key)) != 0))
+    {
+        link = &(*link)->bucket_next;
+    }
+    return link;
+}
+
+static void unlink_recency(struct cache_shard *shard, struct cache_entry *entry)
+{
+    if (entry->newer != NULL)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        shard->newest = entry->older;
+    }
+    if (entry->older != NULL)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        shard->oldest = entry->newer;
+    }
+}
+
+static void push_newest(struct cache_shard *shard, struct cache_entry *entry)
+{
+    entry->newer = NULL;
+    entry->older = shard->newest;
+    if (shard->newest != NULL)
+    {
+        shard->newest->newer = entry;
+    }
+    shard->newest = entry;
+    if (shard->oldest == NULL)
+    {
+        shard->oldest = entry;
+    }
+}
+
+// Removes the entry from the shard and frees it
+static void remove_entry(struct cache_shard *shard, struct cache_entry *entry)
+{
+    struct cache_entry **link = find_entry(shard, &entry->key, entry->hash);
+
+    *link = entry->bucket_next;
+    unlink_recency(shard, entry);
+    shard->memory -= entry->memory;
+    shard->entry_count--;
+    free(entry);
+}
+
+// Doubles the bucket count of the shard, keeps the old table if there is no memory for a bigger one
+static void grow_buckets(struct cache_shard *shard)
+{
+    size_t new_count = shard->bucket_count * 2;
+    struct cache_entry **new_buckets = calloc(new_count, sizeof(struct cache_entry *));
+
+    if (new_buckets == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < shard->bucket_count; i++)
+    {
+        struct cache_entry *entry = shard->buckets[i];
+        while (entry != NULL)
+        {
+            struct cache_entry *next = entry->bucket_next;
+            entry->bucket_next = new_buckets[entry->hash & (new_count - 1)];
+            new_buckets[entry->hash & (new_count - 1)] = entry;
+            entry = next;
+        }
+    }
+
+    free(shard->buckets);
+    shard->buckets = new_buckets;
+    shard->bucket_count = new_count;
+}
+
+// Prints the statistics once every report interval, only the thread that moves the report time forward prints them
+static void maybe_report(void)
+{
+    long long last = __atomic_load_n(&last_report_at, __ATOMIC_RELAXED);
+    long long now = now_ms();
+
+    if (report_interval_ms > 0 && now - last >= report_interval_ms &&
+        __atomic_compare_exchange_n(&last_report_at, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        result_cache_report(stderr);
+    }
+}
+
+int result_cache_enabled(void)
+{
+    pthread_once(&cache_once, cache_init);
+    return shards != NULL;
+}
+
+char *result_cache_lookup(const struct stat *executable, int a, int b)
+{
+    struct cache_key key;
+    char *result = NULL;
+
+    if (!result_cache_enabled())
+    {
+        return NULL;
+    }
+
+    make_key(&key, executable, a, b);
+    uint64_t hash = hash_key(&key);
+    struct cache_shard *shard = shard_of(hash);
+
+    pthread_mutex_lock(&shard->lock);
+    struct cache_entry *entry = *find_entry(shard, &key, hash);
+    if (entry != NULL)
+    {
+        unlink_recency(shard, entry);
+        push_newest(shard, entry);
+        result = strdup(entry->result);
+        shard->hits++;
+    }
+    else
+    {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    maybe_report();
+    return result;
+}
+
+void result_cache_store(const struct stat *executable, int a, int b, const char *result)
+{
+    struct cache_key key;
+    size_t length = strlen(result);
+    size_t memory = sizeof(struct cache_entry) + length + 1;
+
+    // A result bigger than a whole shard would only evict everything else
+    if (!result_cache_enabled() || memory > shard_budget)
+    {
+        return;
+    }
+
+    make_key(&key, executable, a, b);
+    uint64_t hash = hash_key(&key);
+    struct cache_shard *shard = shard_of(hash);
+
+    struct cache_entry *entry = malloc(memory);
+    if (entry == NULL)
+    {
+        return;
+    }
+    entry->key = key;
+    entry->hash = hash;
+    entry->memory = memory;
+    memcpy(entry->result, result, length + 1);
+
+    pthread_mutex_lock(&shard->lock);
+
+    // Another thread may have run the same pair meanwhile, the newer result replaces it
+    struct cache_entry *old = *find_entry(shard, &key, hash);
+    if (old != NULL)
+    {
+        remove_entry(shard, old);
+    }
+
+    while (shard->oldest != NULL && shard->memory + memory > shard_budget)
+    {
+        remove_entry(shard, shard->oldest);
+        shard->evictions++;
+    }
+    if (shard->entry_count >= shard->bucket_count)
+    {
+        grow_buckets(shard);
+    }
+
+    struct cache_entry **bucket = &shard->buckets[hash & (shard->bucket_count - 1)];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    push_newest(shard, entry);
+    shard->memory += memory;
+    shard->entry_count++;
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void result_cache_report(FILE *stream)
+{
+    unsigned long hits = 0, misses = 0, evictions = 0;
+    size_t entry_count = 0, memory = 0;
+
+    if (!result_cache_enabled())
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < shard_count; i++)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        hits += shards[i].hits;
+        misses += shards[i].misses;
+        evictions += shards[i].evictions;
+        entry_count += shards[i].entry_count;
+        memory += shards[i].memory;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+
+    fprintf(stream, "[CACHE] %lu hits, %lu misses, %.1f%% hit ratio, %zu entries, %zu/%zu bytes, %lu evictions\n", hits, misses,
+            hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0, entry_count, memory, shard_budget * shard_count, evictions);
+    fflush(stream);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file    part_c_result_cache.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   In-memory cache of blackbox results for the part_c server.
+ *
+ *  Blackboxes give the same output for the same inputs, so a result can be reused instead of running the blackbox again. Results are
+ *  keyed by the identity of the executable file (device, inode, modification time and size) and the two inputs, so replacing the
+ *  executable makes its old results unreachable; they are evicted as the cache needs room.
+ *
+ *  The cache is configured with environment variables:
+ *      PART_C_CACHE_BYTES              Memory budget of the cache, 0 disables it (default 0)
+ *      PART_C_CACHE_SHARDS             Number of independently locked parts, each with its share of the budget (default 16)
+ *      PART_C_CACHE_REPORT_INTERVAL    Seconds between hit ratio reports on STDERR while there are lookups, 0 disables them (default 10)
+ *
+ *  Every shard evicts its least recently used results when it is over its share of the budget.
+ */
+
+#ifndef PART_C_RESULT_CACHE_H
+#define PART_C_RESULT_CACHE_H
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+// Returns 1 when the cache is enabled
+int result_cache_enabled(void);
+
+// Returns a malloc'd copy of the result of (a, b) for the executable, or NULL if it isn't cached
+char *result_cache_lookup(const struct stat *executable, int a, int b);
+
+// Adds the result of (a, b) for the executable, replacing an older one
+void result_cache_store(const struct stat *executable, int a, int b, const char *result);
+
+// Prints hit, miss and size counts of the cache to the given stream
+void result_cache_report(FILE *stream);
+
+#endif /* PART_C_RESULT_CACHE_H */
@@ -9,10 +9,38 @@
  *   process is also redirected to parent process with again use of pipes. Then the read result is returned to the client with a FAIL or SUCCESS message
  *   which will be written to an output file. This program also connects to a logger via TCP socket connection from given ip address and ports. Connection to
  *   socket is set in first run as static variables, and will continue until the program is exited. Passed log to the logger changes depending on the blackbox's output.
+ *   Log lines are queued and sent over one long lived connection by part_c_log_sender.c, which reconnects if the logger goes away.
+ *   With PART_C_LOG_EXECUTABLE=1 the path of the blackbox is added to the end of every log line, so the binary log can tell executables apart.
  *
  *   Redirecting the inputs and outputs to blackbox works by creating 2 one directional pipes: first pipe connects parent to child's STDIN, second one 
  *   connects child's STDOUT and STDERR to the parent process. 
- *   Blackbox's fail or success is checked by use of wait(status), in which if status 0 blackbox runs successfully otherwise it should be an error.
+ *   Blackbox's fail or success is checked by its exit status, collected through the pidfd of that blackbox, in which if status 0 blackbox runs successfully
+ *   otherwise it should be an error. Each request only ever collects the status of its own blackbox, so concurrent requests can't mix them up.
+ *   Blackbox processes are taken from the warm pool in common/blackbox_pool.c, which spawns them on demand when the pool is disabled or empty.
+ *   The output is read by common/capture.c while the blackbox runs, so a blackbox with an output bigger than the pipe buffer can finish.
+ *   With BLACKBOX_PLUGINS=1, a blackbox that is a shared object exporting blackbox_compute() is called in the thread of the request
+ *   instead, as described in common/plugin.h, and its result is formatted the same way.
+ *
+ *   With PART_C_CACHE_BYTES set, results are kept in part_c_result_cache.c and repeated pairs of an unchanged executable are answered
+ *   without running the blackbox. With PART_C_DISK_CACHE set, they are also kept in the file of part_c_disk_cache.c, which outlives restarts
+ *   and is shared with the other servers of the host. Cached answers are logged like the others.
+ *
+ *   A blackbox that runs longer than PART_C_TIMEOUT_MS of wall clock time or PART_C_CPU_TIMEOUT_MS of CPU time (0, the default, for no
+ *   limit) is killed with the processes it started, and a TIMEOUT result is returned and logged as "a b timeout". run_binary_limited
+ *   requests give their own limits, which replace the ones of the server. Address space and open file limits of the blackbox are set
+ *   with the BLACKBOX_LIMIT_ variables of common/launcher.h.
+ *
+ *   Batch requests give many pairs for one blackbox. The pairs are run in parallel by up to PART_C_BATCH_THREADS threads (default is the
+ *   number of processors), and their results are returned in the same order. With PART_C_BATCH_IN_FLIGHT set, the pairs run on the event
+ *   loop of common/executor.c instead, which keeps up to that many blackboxes running from the thread of the request with io_uring, or
+ *   epoll on older kernels.
+ *
+ *   Every pair is timed phase by phase with part_c_timing.c. The get_stats procedure returns the histograms of the phases with the
+ *   counts of the results, and clears them when asked, see part_c_stats.c. The phases are also kept as spans by the flight recorder of
+ *   part_c_trace.c, which are dumped as Chrome trace-event JSON on SIGUSR2 or with the get_trace procedure.
+ *
+ *   Requests are normally served one at a time by svc_run(). When PART_C_WORKERS is set, part_c_dispatch.c serves them with that many worker
+ *   threads, which call run_binary_1_worker() with their own result instead of run_binary_1_svc()'s static one.
  *
  *   To pass command line arguments to the server(this program), another wrapper program(part_c_server_wrapper.c) will be executed with wanted 
  *   command line arguments. Then this wrapper program will run this server as a child process and redirect input via pipes. To accomodate that wrapper program runs with
@@ -24,18 +52,370 @@
  *   How to run:
  *   > make
  *   > ./part_c_server.out   logger_ip_address   logger_port_number
+ *   > PART_C_WORKERS=32 ./part_c_server.out   logger_ip_address   logger_port_number
+ *   > PART_C_TIMEOUT_MS=2000 PART_C_CPU_TIMEOUT_MS=1000 ./part_c_server.out   logger_ip_address   logger_port_number
+ *   > kill -USR2 $(pidof part_c_server_wrapped.out)
  * 
  */
 
 #include "part_c.h"
+#include "part_c_dispatch.h"
+#include "blackbox_pool.h"
+#include "capture.h"
+#include "executor.h"
+#include "options.h"
+#include "plugin.h"
+#include "part_c_log_sender.h"
+#include "part_c_disk_cache.h"
+#include "part_c_result_cache.h"
+#include "part_c_timing.h"
+#include "part_c_trace.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
-static int server_socket, run;
+static pthread_once_t logger_once = PTHREAD_ONCE_INIT;
 static struct sockaddr_in server_address;
+static int log_executable; // PART_C_LOG_EXECUTABLE, adds the executable path to the log lines for the binary log of the logger
+
+/////////////////////////////////////////////////////////
+//  SOCKET SETUP for first run
+//
+//  Socket codes are learned and referenced from https://www.binarytides.com/socket-programming-c-linux-tutorial/
+////////////////////////////////////////////////////////
+// Reads the logger address from the wrapper on the first run and starts the log sender with it. Socket details are being hold in
+// static variables, which will be stored until the program exits. pthread_once makes sure only one worker reads them when requests
+// are run concurrently
+static void logger_address_init(void)
+{
+    char server_ip[256];
+    int port;
+
+    //Taking arguments from the wrapper connected via pipe
+    scanf("%s %d", server_ip, &port);
+
+    // If ip argument is given as localhost, change it to 127.0.0.1 for successful ip translation from string
+    if (strcmp(server_ip, "localhost") == 0)
+    {
+        strcpy(server_ip, "127.0.0.1");
+    }
+
+    // Setting up ipv4 address for connection
+    if (inet_pton(AF_INET, server_ip, &(server_address.sin_addr)) <= 0)
+    {
+        perror("[ERROR] Given ip address couldn't be converted from string.");
+        exit(-1);
+    }
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+
+    // The connection itself is owned by the sender thread, which keeps it open for every request
+    log_executable = option_int("PART_C_LOG_EXECUTABLE", 0);
+    log_sender_start(&server_address);
+}
+
+static struct sockaddr_in adopted_address; // Logger address handed over by an upgrade
+
+// Starts the log sender with the logger address of the old server, the connection comes from it too once its lines are sent
+static void logger_address_adopted(void)
+{
+    server_address = adopted_address;
+    log_executable = option_int("PART_C_LOG_EXECUTABLE", 0);
+    log_sender_start_adopting(&server_address);
+}
+
+void logger_address_get(struct sockaddr_in *address)
+{
+    pthread_once(&logger_once, logger_address_init);
+    *address = server_address;
+}
+
+void logger_address_adopt(const struct sockaddr_in *address)
+{
+    adopted_address = *address;
+    pthread_once(&logger_once, logger_address_adopted);
+}
+
+// Queues the log line of a result, "a b result" for a SUCCESS, "a b timeout" for a TIMEOUT and "a b _" for a FAIL
+static void log_result(arguments *argp, const char *result)
+{
+    char log_message[256];
+    long long started_ns = timing_now();
+
+    if (strncmp(result, "SUCCESS:\n", 9) == 0)
+    {
+        sprintf(log_message, "%d %d %d\n", argp->a, argp->b, atoi(result + 9));
+        timing_count(COUNTER_SUCCESSES);
+    }
+    else if (strncmp(result, "TIMEOUT:\n", 9) == 0)
+    {
+        sprintf(log_message, "%d %d timeout\n", argp->a, argp->b);
+        timing_count(COUNTER_TIMEOUTS);
+    }
+    else
+    {
+        sprintf(log_message, "%d %d _\n", argp->a, argp->b);
+        timing_count(COUNTER_FAILURES);
+    }
+
+    // The path goes after the result, where the text log keeps it as a 4th field and the binary log turns it into an executable id.
+    // A path too long for the line is left out
+    size_t log_length = strlen(log_message) - 1;
+    if (log_executable && log_length + strlen(argp->executable_path) + 3 <= sizeof(log_message))
+    {
+        sprintf(log_message + log_length, " %s\n", argp->executable_path);
+    }
+
+    // Queueing the log line, the sender thread writes it to the logger without blocking this request
+    log_sender_send(log_message);
+    timing_record(PHASE_LOG, started_ns);
+}
+
+// A pair being run, with the identity of its executable before the run for the caches
+struct pair_run
+{
+    arguments *argp;
+    const struct capture_limits *limits;
+    struct stat executable;
+    int cacheable;
+    char **result;
+    long long started_ns, submitted_ns; // When the pair and its blackbox were started, for the timings
+};
+
+// Looks the pair up in the caches. A cached result is returned and logged without running the blackbox. The memory cache is tried
+// first, a result found in the disk cache is copied to it. Returns 1 when the result was found. This is the first step of every pair,
+// so its timing starts here
+static int find_cached_result(struct pair_run *run)
+{
+    arguments *argp = run->argp;
+    int found = 0;
+
+    pthread_once(&logger_once, logger_address_init);
+
+    run->started_ns = timing_now();
+    run->cacheable = (result_cache_enabled() || disk_cache_enabled()) && stat(argp->executable_path, &run->executable) == 0;
+    if (run->cacheable && (*run->result = result_cache_lookup(&run->executable, argp->a, argp->b)) != NULL)
+    {
+        found = 1;
+    }
+    else if (run->cacheable && (*run->result = disk_cache_lookup(&run->executable, argp->a, argp->b)) != NULL)
+    {
+        result_cache_store(&run->executable, argp->a, argp->b, *run->result);
+        found = 1;
+    }
+    timing_record(PHASE_CACHE_LOOKUP, run->started_ns);
+
+    if (found)
+    {
+        timing_count(COUNTER_CACHE_HITS);
+        log_result(argp, *run->result);
+        timing_record(PHASE_TOTAL, run->started_ns);
+    }
+    return found;
+}
+
+// Takes an already running blackbox from the pool, or creates a child process with its pipes if there is none ready
+static void start_blackbox(arguments *argp, struct blackbox_process *blackbox, char *write_buffer)
+{
+    long long started_ns = timing_now();
+
+    if (blackbox_pool_acquire(argp->executable_path, blackbox) == -1)
+    {
+        perror("[ERROR] Failed to start blackbox process.");
+        exit(-1);
+    }
+    timing_record(PHASE_SPAWN, started_ns);
+
+    /* Taking 2 new arguments as input for child process */
+    sprintf(write_buffer, "%d %d\n", argp->a, argp->b);
+}
+
+// Formats the output of the blackbox as the result of the pair, then logs and caches it. Frees the output
+static void finish_pair(struct pair_run *run, struct captured_output *output)
+{
+    arguments *argp = run->argp;
+    char **result = run->result;
+    struct stat executable_after;
+    int status = output->status;
+    char *full_message = output->data;
+    long long started_ns = timing_now();
+
+    // Checking the error status of blackbox, and printing respective output. A killed blackbox gets a TIMEOUT whatever it printed
+    if (output->timed_out)
+    {
+        *result = (char *)malloc(96);
+        if (*result != NULL)
+        {
+            sprintf(*result, "TIMEOUT:\n%s limit of %ld ms was exceeded\n", output->timed_out == CAPTURE_WALL_TIMEOUT ? "Wall clock" : "CPU time",
+                    output->timed_out == CAPTURE_WALL_TIMEOUT ? run->limits->wall_ms : run->limits->cpu_ms);
+        }
+    }
+    else if (status == 0)
+    {
+        // SUCCESS title and the returned number are formatted directly into the result
+        *result = (char *)malloc(32);
+        if (*result != NULL)
+        {
+            sprintf(*result, "SUCCESS:\n%d\n", atoi(full_message));
+        }
+    }
+    else
+    {
+        // Checking if the returned error message ends with \n, then removing it since we add \n after it
+        if (output->length > 0 && full_message[output->length - 1] == '\n')
+        {
+            full_message[--output->length] = '\0';
+        }
+
+        // The message is copied once into the result after the FAIL title. Outputs can be megabytes, so there is no temporary copy on the stack
+        *result = (char *)malloc(output->length + 8);
+        if (*result != NULL)
+        {
+            memcpy(*result, "FAIL:\n", 6);
+            memcpy(*result + 6, full_message, output->length);
+            strcpy(*result + 6 + output->length, "\n");
+        }
+    }
+
+    // Without a result the request fails, there is nothing to log or cache
+    if (*result == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        free(full_message);
+        return;
+    }
+
+    free(full_message); // Free area allocated by malloc and realloc
+    timing_record(PHASE_FORMAT, started_ns);
+
+    log_result(argp, *result);
+
+    // The result is cached only if the executable wasn't replaced while it was running. A TIMEOUT depends on the limits and the load of
+    // the host, so it is never cached
+    struct stat *executable_before = &run->executable;
+    started_ns = timing_now();
+    if (run->cacheable && !output->timed_out && stat(argp->executable_path, &executable_after) == 0 && executable_after.st_ino == executable_before->st_ino &&
+        executable_after.st_dev == executable_before->st_dev && executable_after.st_size == executable_before->st_size &&
+        executable_after.st_mtim.tv_sec == executable_before->st_mtim.tv_sec && executable_after.st_mtim.tv_nsec == executable_before->st_mtim.tv_nsec)
+    {
+        result_cache_store(executable_before, argp->a, argp->b, *result);
+        disk_cache_store(executable_before, argp->a, argp->b, *result);
+    }
+    if (run->cacheable)
+    {
+        timing_record(PHASE_CACHE_STORE, started_ns);
+    }
+
+    timing_record(PHASE_TOTAL, run->started_ns);
+}
+
+// Calls the plugin of the pair, its result is given as the output of a process would be, so it is formatted the same way
+static void run_plugin(struct pair_run *run, blackbox_compute_function compute)
+{
+    struct captured_output output;
+    long long started_ns = timing_now();
+
+    if (plugin_run(compute, run->argp->a, run->argp->b, &output) == -1)
+    {
+        perror("[ERROR] Plugin couldn't be run.");
+        exit(-1);
+    }
+    timing_record(PHASE_RUN, started_ns);
+
+    finish_pair(run, &output);
+}
+
+// Runs the blackbox for one pair, killing it when it passes one of the limits
+static void run_blackbox(arguments *argp, const struct capture_limits *limits, char **result)
+{
+    struct pair_run run = {argp, limits};
+    struct blackbox_process blackbox;
+    char write_buffer[256];
+
+    run.result = result;
+    if (find_cached_result(&run))
+    {
+        return;
+    }
+
+    // A plugin is called in this thread instead of a process
+    blackbox_compute_function compute = plugin_lookup(argp->executable_path);
+    if (compute != NULL)
+    {
+        run_plugin(&run, compute);
+        return;
+    }
+
+    start_blackbox(argp, &blackbox, write_buffer);
+    // Redirecting the input to child process as standard input
+    long long started_ns = timing_now();
+    write(blackbox.input_fd, write_buffer, strlen(write_buffer));
+    started_ns = timing_record(PHASE_WRITE_INPUT, started_ns);
+
+    // Reading the output while waiting for the blackbox to finish, then saving the return status. Waiting first would block forever
+    // when the output doesn't fit in the pipe
+    struct captured_output output;
+    if (capture_blackbox_limited(&blackbox, limits, &output) == -1)
+    {
+        perror("[ERROR] Output of the blackbox couldn't be read.");
+        exit(-1);
+    }
+    timing_record(PHASE_RUN, started_ns);
+
+    finish_pair(&run, &output);
+
+    // Closing remaining pipes
+    close(blackbox.input_fd);
+    close(blackbox.output_fd);
+}
+
+// Limits of the server, 0 runs the blackbox without a limit
+static void server_limits(struct capture_limits *limits)
+{
+    limits->wall_ms = option_int("PART_C_TIMEOUT_MS", 0);
+    limits->cpu_ms = option_int("PART_C_CPU_TIMEOUT_MS", 0);
+}
+
+bool_t
+run_binary_1_worker(arguments *argp, char **result)
+{
+    struct capture_limits limits;
+
+    server_limits(&limits);
+    run_blackbox(argp, &limits, result);
+
+    return *result != NULL;
+}
+
+bool_t
+run_binary_limited_1_worker(limited_arguments *argp, char **result)
+{
+    arguments item;
+    struct capture_limits limits;
+
+    item.executable_path = argp->executable_path;
+    item.a = argp->a;
+    item.b = argp->b;
+
+    // Limits given by the client replace the ones of the server, 0 keeps the one of the server
+    server_limits(&limits);
+    if (argp->wall_timeout_ms > 0)
+    {
+        limits.wall_ms = argp->wall_timeout_ms;
+    }
+    if (argp->cpu_timeout_ms > 0)
+    {
+        limits.cpu_ms = argp->cpu_timeout_ms;
+    }
+
+    run_blackbox(&item, &limits, result);
+
+    return *result != NULL;
+}
 
 char **
 run_binary_1_svc(arguments *argp, struct svc_req *rqstp)
@@ -43,195 +423,277 @@ run_binary_1_svc(arguments *argp, struct svc_req *rqstp)
 
     static char *result;
 
-    int message2child[2], message2parent[2];
-    char write_buffer[256], read_buffer[256];
+    // Cleaning results from previous call to the function
+    xdr_free((xdrproc_t)xdr_wrapstring, (char *)&result);
 
-    //Creating pipes
-    if ((pipe(message2child) == -1) || (pipe(message2parent) == -1))
+    if (!run_binary_1_worker(argp, &result))
     {
-        perror("[ERROR] Couldn't create pipe.");
-        exit(-1);
+        return NULL;
     }
 
+    return &result;
+}
+
+char **
+run_binary_limited_1_svc(limited_arguments *argp, struct svc_req *rqstp)
+{
+
+    static char *result;
+
     // Cleaning results from previous call to the function
     xdr_free((xdrproc_t)xdr_wrapstring, (char *)&result);
 
-    // Creates a child process
-    switch (fork())
+    if (!run_binary_limited_1_worker(argp, &result))
     {
-    // If return value of fork() is -1, then there was an error creating child process
-    case -1:
-        perror("[ERROR] Failed fork process.");
-        exit(-1);
+        return NULL;
+    }
 
-    // If return of fork() is 0, then this is the child process
-    case 0:
+    return &result;
+}
 
-        // Redirecting STDIN, STDOUT and STDERR to pipes
-        if (dup2(message2child[0], STDIN_FILENO) == -1 || dup2(message2parent[1], STDOUT_FILENO) == -1 || dup2(message2parent[1], STDERR_FILENO) == -1)
+// Pairs of a batch shared by the threads running them, every thread takes the next pair until all of them are taken
+struct batch_work
+{
+    batch_arguments *argp;
+    batch_results *result;
+    u_int next;
+};
+
+static void *batch_thread(void *data)
+{
+    struct batch_work *work = data;
+    u_int index;
+
+    while ((index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->argp->pairs.pairs_len)
+    {
+        arguments item;
+        item.executable_path = work->argp->executable_path;
+        item.a = work->argp->pairs.pairs_val[index].a;
+        item.b = work->argp->pairs.pairs_val[index].b;
+
+        // Every pair writes to its own slot, so results stay in the order of the pairs
+        run_binary_1_worker(&item, &work->result->results.results_val[index]);
+    }
+
+    return NULL;
+}
+
+// Called by the executor when the blackbox of a pair finished
+static void batch_pair_done(struct captured_output *output, void *run)
+{
+    timing_record(PHASE_RUN, ((struct pair_run *)run)->submitted_ns);
+    finish_pair((struct pair_run *)run, output);
+}
+
+// Runs the pairs of a batch on the event loop of common/executor.c from this thread, with up to in_flight blackboxes running at once
+static bool_t run_batch_event_loop(batch_arguments *argp, batch_results *result, long in_flight)
+{
+    u_int count = argp->pairs.pairs_len, next = 0;
+    struct capture_limits limits;
+    char write_buffer[256];
+
+    server_limits(&limits);
+    blackbox_compute_function compute = plugin_lookup(argp->executable_path);
+    arguments *items = (arguments *)calloc(count + 1, sizeof(arguments));
+    struct pair_run *runs = (struct pair_run *)calloc(count + 1, sizeof(struct pair_run));
+    struct executor *executor = executor_create(in_flight);
+    if (items == NULL || runs == NULL || executor == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        free(items);
+        free(runs);
+        if (executor != NULL)
         {
-            perror("[ERROR] There was an error binding pipes for standard file descriptors.");
-            exit(-1);
+            executor_destroy(executor);
         }
+        return FALSE;
+    }
 
-        // Closing pipes since they are duplicated for standard file descriptors, we don't need them open
-        close(message2parent[0]);
-        close(message2parent[1]);
-        close(message2child[0]);
-        close(message2child[1]);
-
-        execl(argp->executable_path, argp->executable_path, NULL);
-        break;
-
-    // If the return value is not 0 or -1, then it should be the parent process
-    default:
-
-        close(message2child[0]);  // Parent won't read from parent to child pipe
-        close(message2parent[1]); // Parent won't write to message channel from child to parent
-
-        /////////////////////////////////////////////////////////
-        //  SOCKET SETUP for first run
-        //
-        //  Socket codes are learned and referenced from https://www.binarytides.com/socket-programming-c-linux-tutorial/
-        ////////////////////////////////////////////////////////
-        // If this is the first run, initializes and connect to the socket
-        // Socket details are being hold in static variables, which will be stored until the program exits
-        if (run == 0)
+    while (next < count || executor_running(executor) > 0)
+    {
+        // Cached pairs are answered right away, the others are started while there is room for them
+        while (next < count && executor_running(executor) < in_flight)
         {
-            char server_ip[256];
-            int port;
-
-            //Taking arguments from the wrapper connected via pipe
-            scanf("%s %d", server_ip, &port);
-
-            // If ip argument is given as localhost, change it to 127.0.0.1 for successful ip translation from string
-            if (strcmp(server_ip, "localhost") == 0)
+            items[next].executable_path = argp->executable_path;
+            items[next].a = argp->pairs.pairs_val[next].a;
+            items[next].b = argp->pairs.pairs_val[next].b;
+            runs[next].argp = &items[next];
+            runs[next].limits = &limits;
+            runs[next].result = &result->results.results_val[next];
+
+            if (find_cached_result(&runs[next]))
             {
-                strcpy(server_ip, "127.0.0.1");
+                next++;
+                continue;
             }
 
-            // Setting up ipv4 address for connection
-            if (inet_pton(AF_INET, server_ip, &(server_address.sin_addr)) <= 0)
+            if (compute != NULL)
             {
-                perror("[ERROR] Given ip address couldn't be converted from string.");
-                exit(-1);
+                // Plugins are called right away, there is nothing to wait for
+                run_plugin(&runs[next], compute);
             }
-            server_address.sin_family = AF_INET;
-            server_address.sin_port = htons(port);
-
-            run = 1; //Setting run=1 to block the initialization in other calls
+            else
+            {
+                struct blackbox_process blackbox;
+                start_blackbox(&items[next], &blackbox, write_buffer);
+                runs[next].submitted_ns = timing_now();
+                if (executor_submit(executor, &blackbox, write_buffer, &limits, batch_pair_done, &runs[next]) == -1)
+                {
+                    perror("[ERROR] Blackbox couldn't be started.");
+                    exit(-1);
+                }
+            }
+            next++;
         }
 
-        // initializing socket
-        server_socket = socket(AF_INET, SOCK_STREAM, 0);
-        //Creates socket
-        if (server_socket == -1)
+        if (executor_wait(executor) == -1)
         {
-            printf("[ERROR] Could not create socket");
+            perror("[ERROR] Blackboxes couldn't be watched.");
             exit(-1);
         }
+    }
+
+    executor_destroy(executor);
+    free(items);
+    free(runs);
+    return TRUE;
+}
 
-        // Connecting to the socket
-        if (connect(server_socket, (struct sockaddr *)&server_address, sizeof(server_address)) == -1)
+// A pair whose result couldn't be allocated fails the whole batch
+static bool_t batch_complete(batch_results *result)
+{
+    for (u_int i = 0; i < result->results.results_len; i++)
+    {
+        if (result->results.results_val[i] == NULL)
         {
-            perror("[ERROR] Socket connection failed.");
-            exit(-1);
+            return FALSE;
         }
+    }
+    return TRUE;
+}
 
-        /* Taking 2 new arguments as input for child process */
-        sprintf(write_buffer, "%d %d\n", argp->a, argp->b);
-        // Redirecting the input to child process as standard input
-        write(message2child[1], write_buffer, strlen(write_buffer));
+bool_t
+run_binary_batch_1_worker(batch_arguments *argp, batch_results *result)
+{
+    struct batch_work work = {argp, result, 0};
+    u_int count = argp->pairs.pairs_len;
+    long thread_count;
+
+    result->results.results_len = count;
+    // One extra slot so an empty batch doesn't get a NULL allocation
+    result->results.results_val = (result_message *)calloc(count + 1, sizeof(result_message));
+    if (result->results.results_val == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return FALSE;
+    }
 
-        // Waiting for child process to finish, then saving the return status
-        int status;
-        wait(&status);
+    // With PART_C_BATCH_IN_FLIGHT set, the pairs run on an event loop in this thread instead of on batch threads
+    long in_flight = option_int("PART_C_BATCH_IN_FLIGHT", 0);
+    if (in_flight > 0)
+    {
+        if (!run_batch_event_loop(argp, result, in_flight > count && count > 0 ? count : in_flight))
+        {
+            return FALSE;
+        }
+        return batch_complete(result);
+    }
 
-        // Initializing char pointer for reading from pipe
-        char *full_message;
-        full_message = (char *)malloc(sizeof(char));
-        strcpy(full_message, "");
+    // Pairs are run in parallel by up to PART_C_BATCH_THREADS threads, this thread being one of them
+    thread_count = option_int("PART_C_BATCH_THREADS", sysconf(_SC_NPROCESSORS_ONLN));
+    if (thread_count > count)
+    {
+        thread_count = count;
+    }
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
 
-        // Buffer size is set as 256, so parent process will read till there is nothing to read.
-        // Since outputs bigger than 255 size needs to be read more than once.
-        ssize_t read_size;
-        while ((read_size = read(message2parent[0], read_buffer, sizeof(read_buffer) - 1)) > 0)
-        {
-            // Creates a new local char array to hold temporary string with bigger size than full_message array
-            char read_message[read_size + strlen(full_message) + 1];
+    pthread_t threads[thread_count > 1 ? thread_count - 1 : 1];
+    long started = 0;
+    while (started < thread_count - 1 && pthread_create(&threads[started], NULL, batch_thread, &work) == 0)
+    {
+        started++;
+    }
+    batch_thread(&work);
 
-            // Copies full message to the newly created temp string
-            strcpy(read_message, full_message);
-            read_buffer[read_size] = '\0';     // Adding EOS null char to end the string
-            strcat(read_message, read_buffer); //Concanterates newly read message to message that is read earlier
+    for (long i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
 
-            // Reallocating memory and checking result
-            full_message = realloc(full_message, sizeof(read_message));
-            if (full_message == NULL)
-            {
-                perror("[ERROR] Memory allocation error.\n");
-                exit(-1);
-            }
+    return batch_complete(result);
+}
 
-            // Copies the read message to full message again
-            strcpy(full_message, read_message);
-        }
+batch_results *
+run_binary_batch_1_svc(batch_arguments *argp, struct svc_req *rqstp)
+{
 
-        char log_message[256];
+    static batch_results result;
 
-        // Checking the error status of blackbox, and printing respective output
-        if (status == 0)
-        {
-            // Creating a temp string with enough space for full message and SUCCESS title
-            char temp_string[strlen(full_message) + 10];
+    // Cleaning results from previous call to the function
+    xdr_free((xdrproc_t)xdr_batch_results, (char *)&result);
 
-            // SUCCESS and full message are formatted and concentrated, log message is also created
-            int returned_result = atoi(full_message);
-            sprintf(temp_string, "SUCCESS:\n%d\n", returned_result);
-            sprintf(log_message, "%d %d %d\n", argp->a, argp->b, returned_result);
+    if (!run_binary_batch_1_worker(argp, &result))
+    {
+        return NULL;
+    }
 
-            // Reserves heap memory space for the result to be copied
-            result = (char *)malloc(sizeof(temp_string));
-            strcpy(result, temp_string);
-        }
-        else
-        {
-            // Checking if the returned error message ends with \n, then removing it since we add \n in fprintf()
-            if (full_message[strlen(full_message) - 1] == '\n'){
-                full_message[strlen(full_message) - 1] = '\0';
-            }
+    return &result;
+}
 
-            // Creating a temp string with enough space for full message and FAIL title. log message is also created
-            char temp_string[strlen(full_message) + 7];
-            sprintf(temp_string, "FAIL:\n%s\n", full_message);
-            sprintf(log_message, "%d %d _\n", argp->a, argp->b);
+bool_t
+get_stats_1_worker(int *argp, server_stats *result)
+{
+    // Dropped log lines are counted by the sender since the start, they aren't cleared
+    if (!timing_snapshot(result, *argp != 0))
+    {
+        return FALSE;
+    }
+    result->log_dropped = log_sender_dropped();
 
-            // Reserves heap memory space for the result to be copied
-            result = (char *)malloc(sizeof(temp_string));
-            strcpy(result, temp_string);
-        }
+    return TRUE;
+}
 
-        free(full_message); // Free area allocated by malloc and realloc
+server_stats *
+get_stats_1_svc(int *argp, struct svc_req *rqstp)
+{
 
-        if (send(server_socket, log_message, strlen(log_message), 0) == -1)
-        {
-            perror("[ERROR] Couldn't send message to the logger server_address.");
-            exit(-1);
-        }
+    static server_stats result;
 
-        // Closing remaining pipes
-        close(message2child[1]);
-        close(message2parent[0]);
+    // Cleaning results from previous call to the function
+    xdr_free((xdrproc_t)xdr_server_stats, (char *)&result);
 
-        // Shutting down socket, by doing this before closeing we ensure all data has been sent
-        if (shutdown(server_socket, 2) == -1)
-        {
-            perror("[ERROR] Socket couldn't disconnect");
-            exit(-1);
-        }
-        // Closing socket connection
-        close(server_socket);
+    if (!get_stats_1_worker(argp, &result))
+    {
+        return NULL;
     }
 
     return &result;
 }
+
+bool_t
+get_trace_1_worker(int *argp, trace_document *result)
+{
+    *result = trace_dump(*argp);
+
+    return *result != NULL;
+}
+
+trace_document *
+get_trace_1_svc(int *argp, struct svc_req *rqstp)
+{
+
+    static trace_document result;
+
+    // Cleaning results from previous call to the function
+    xdr_free((xdrproc_t)xdr_trace_document, (char *)&result);
+
+    if (!get_trace_1_worker(argp, &result))
+    {
+        return NULL;
+    }
+
+    return &result;
+}
\ No newline at end of file
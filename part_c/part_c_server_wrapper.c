@@ -10,6 +10,11 @@
  *  server from RPC serverThen parent/main process waits until child process(RPC server) quits.
  * 
  *  This code will be compiled with a name part_c_server.out while the main server code from part_c_server.c will be compiled to part_c_server_wrapped.out
+ *
+ *  A server upgraded with SIGHUP (part_c_upgrade.h) starts its successor and exits. The wrapper is a child subreaper, so the successor
+ *  becomes its child when the old server exits, and the wrapper waits until the last server quits. The servers report the pids of
+ *  their successors through a pipe, since the wrapper also adopts the orphaned blackboxes and pool processes of the servers; those
+ *  are only reaped, they don't keep the wrapper waiting and their statuses aren't taken as the status of the server.
  * 
  *  How to run:
  *  > make
@@ -17,18 +22,58 @@
  * 
  */
 
+#define _GNU_SOURCE
+
+#include "part_c_upgrade.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/prctl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#define MAX_SERVERS 16
+
+// Adds the pids of the servers started by upgrades that are reported in the pipe to the running servers
+static void read_reported_servers(int report_fd, pid_t *servers, int *server_count)
+{
+    pid_t pid;
+
+    while (read(report_fd, &pid, sizeof(pid)) == sizeof(pid))
+    {
+        if (*server_count < MAX_SERVERS)
+        {
+            servers[(*server_count)++] = pid;
+        }
+    }
+}
+
+// Removes the pid from the running servers, returns 0 if it isn't a server
+static int remove_server(pid_t pid, pid_t *servers, int *server_count)
+{
+    for (int i = 0; i < *server_count; i++)
+    {
+        if (servers[i] == pid)
+        {
+            servers[i] = servers[--(*server_count)];
+            return 1;
+        }
+    }
+    return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
-    int port, child_return_status;
+    int port, status, child_return_status = 0;
+    pid_t server_pid, servers[MAX_SERVERS];
+    int server_count = 0;
     char *server_address;
-    int wrapper2server[2];
+    int wrapper2server[2], server2wrapper[2];
     char write_buffer[1024];
 
     // Checking the argument count
@@ -42,15 +87,21 @@ int main(int argc, char *argv[])
     server_address = argv[1];
     port = atoi(argv[2]);
 
+    // Servers started by an upgrade are adopted by the wrapper when the server that started them exits
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1)
+    {
+        perror("[WARNING] Couldn't become a subreaper, upgraded servers won't be waited for");
+    }
+
     // Creating pipe
-    if (pipe(wrapper2server) == -1)
+    if (pipe(wrapper2server) == -1 || pipe2(server2wrapper, O_NONBLOCK) == -1)
     {
         perror("[ERROR] Couldn't create pipe.");
         return -1;
     }
 
     // Forks for child process
-    switch (fork())
+    switch (server_pid = fork())
     {
 
     case -1:    // Error happened when forking
@@ -73,6 +124,17 @@ int main(int argc, char *argv[])
             return -1;
         }
 
+        // The server reports its successors to the wrapper through this pipe
+        if (dup2(server2wrapper[1], UPGRADE_WRAPPER_FD) == -1)
+        {
+            perror("[ERROR] Couldn't give the report pipe to the child process.");
+            return -1;
+        }
+        close(server2wrapper[0]);
+        close(server2wrapper[1]);
+        sprintf(write_buffer, "%d", UPGRADE_WRAPPER_FD);
+        setenv("PART_C_WRAPPER_FD", write_buffer, 1);
+
         // Running the server with pipe redirected to STDIN, so we can deliver command line args to server
         execl("./part_c_server_wrapped.out", "./part_c_server_wrapped.out", NULL);
         break;
@@ -80,6 +142,8 @@ int main(int argc, char *argv[])
     default:    //parent process
         
         close(wrapper2server[0]); // Closing read end of the pipe since we won't read anything
+        close(server2wrapper[1]);
+        servers[server_count++] = server_pid;
 
         // Redirecting starting command line arguments to the server via pipe
         sprintf(write_buffer, "%s %d\n", server_address, port);
@@ -87,7 +151,36 @@ int main(int argc, char *argv[])
 
         close(wrapper2server[1]); // Closing the write end of the pipe
 
-        wait(&child_return_status); // Waiting for child process to finish its execution
+        // Waiting for the server process and the servers that replaced it to finish their execution, the status of the last one is kept.
+        // A server reports its successor before it exits, so the pipe is read before deciding that no server is left
+        while (server_count > 0)
+        {
+            server_pid = waitpid(-1, &status, 0);
+            if (server_pid == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                perror("[ERROR] Couldn't wait for part_c_server");
+                return -1;
+            }
+
+            read_reported_servers(server2wrapper[0], servers, &server_count);
+            if (remove_server(server_pid, servers, &server_count))
+            {
+                child_return_status = status;
+
+                // A successor that exited before it was adopted was reaped by the server that started it
+                for (int i = server_count - 1; i >= 0; i--)
+                {
+                    if (kill(servers[i], 0) == -1 && errno == ESRCH)
+                    {
+                        servers[i] = servers[--server_count];
+                    }
+                }
+            }
+        }
 
         // Child process exited with error
         if (child_return_status != 0)
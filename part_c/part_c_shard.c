@@ -0,0 +1,277 @@
+/**
+ * @file    part_c_shard.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Consistent hash ring that spreads the requests of part_c_client over several part_c servers.
+ *
+ *  The points of a server only depend on its name, so adding or removing a server in the list only moves the keys of its own points,
+ *  and every client with the same list routes the same way. Keys and points are hashed with FNV-1a and a 64 bit finalizer, which
+ *  spreads the nearby pairs of a batch over the whole ring.
+ */
+
+#include "part_c_shard.h"
+#include "options.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct shard_point
+{
+    uint64_t hash;
+    int server;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Finalizer of splitmix64, so that keys differing in a few bits land far apart
+static uint64_t mix(uint64_t hash)
+{
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+static int compare_points(const void *first, const void *second)
+{
+    const struct shard_point *a = first, *b = second;
+
+    if (a->hash != b->hash)
+    {
+        return a->hash < b->hash ? -1 : 1;
+    }
+    // Equal hashes are ordered by server, so the ring doesn't depend on the sort
+    return a->server - b->server;
+}
+
+// Fills the host and port of the server from its name
+static int parse_server(struct shard_server *server, const char *name, size_t length)
+{
+    server->name = strndup(name, length);
+    server->host = strndup(name, length);
+    server->port = 0;
+    server->failed = 0;
+    if (server->name == NULL || server->host == NULL)
+    {
+        return -1;
+    }
+
+    char *separator = strchr(server->host, ':');
+    if (separator != NULL)
+    {
+        *separator = '\0';
+        server->port = atoi(separator + 1);
+    }
+    return 0;
+}
+
+// Returns the contents of the file with its lines and blanks turned into commas, NULL on error
+static char *read_server_file(const char *path)
+{
+    char *list = NULL;
+    size_t length = 0;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    FILE *buffer = open_memstream(&list, &length);
+    int c;
+    while (buffer != NULL && (c = fgetc(file)) != EOF)
+    {
+        fputc(c == '\n' || c == ' ' || c == '\t' || c == '\r' ? ',' : c, buffer);
+    }
+    fclose(file);
+    if (buffer == NULL || fclose(buffer) != 0)
+    {
+        free(list);
+        return NULL;
+    }
+    return list;
+}
+
+int shard_ring_create(struct shard_ring *ring, const char *server_list)
+{
+    int capacity = 1;
+    long points = option_int("PART_C_SHARD_POINTS", 160);
+    char *file_list = NULL;
+
+    if (points < 1)
+    {
+        points = 160;
+    }
+    memset(ring, 0, sizeof(*ring));
+    if (server_list[0] == '@')
+    {
+        file_list = read_server_file(server_list + 1);
+        if (file_list == NULL)
+        {
+            return -1;
+        }
+        server_list = file_list;
+    }
+    for (const char *c = server_list; *c != '\0'; c++)
+    {
+        capacity += *c == ',';
+    }
+
+    ring->servers = (struct shard_server *)calloc(capacity, sizeof(struct shard_server));
+    if (ring->servers == NULL)
+    {
+        free(file_list);
+        return -1;
+    }
+
+    // Empty entries of the list, like a trailing comma, are skipped
+    for (const char *start = server_list; *start != '\0';)
+    {
+        size_t length = strcspn(start, ",");
+        if (length > 0)
+        {
+            // Counted first, so the strings of a server that failed to parse are freed too
+            ring->server_count++;
+            if (parse_server(&ring->servers[ring->server_count - 1], start, length) == -1)
+            {
+                free(file_list);
+                shard_ring_free(ring);
+                return -1;
+            }
+        }
+        start += length + (start[length] == ',');
+    }
+    free(file_list);
+    if (ring->server_count == 0)
+    {
+        shard_ring_free(ring);
+        return -1;
+    }
+
+    ring->points = (struct shard_point *)malloc(ring->server_count * points * sizeof(struct shard_point));
+    if (ring->points == NULL)
+    {
+        shard_ring_free(ring);
+        return -1;
+    }
+    for (int server = 0; server < ring->server_count; server++)
+    {
+        const char *name = ring->servers[server].name;
+        uint64_t base = fnv1a(FNV_OFFSET, name, strlen(name));
+        for (long i = 0; i < points; i++)
+        {
+            struct shard_point *point = &ring->points[ring->point_count++];
+            point->hash = mix(base + i * 0x9e3779b97f4a7c15ULL);
+            point->server = server;
+        }
+    }
+    qsort(ring->points, ring->point_count, sizeof(struct shard_point), compare_points);
+
+    return 0;
+}
+
+void shard_ring_free(struct shard_ring *ring)
+{
+    for (int i = 0; i < ring->server_count; i++)
+    {
+        free(ring->servers[i].name);
+        free(ring->servers[i].host);
+    }
+    free(ring->servers);
+    free(ring->points);
+    memset(ring, 0, sizeof(*ring));
+}
+
+int shard_pick(const struct shard_ring *ring, const char *executable_path, int a, int b)
+{
+    int32_t operands[2] = {a, b};
+
+    // A single server takes every key, even after failing, so the client reports its errors like it always did
+    if (ring->server_count == 1)
+    {
+        return ring->servers[0].failed ? -1 : 0;
+    }
+
+    uint64_t key = fnv1a(FNV_OFFSET, executable_path, strlen(executable_path) + 1);
+    key = mix(fnv1a(key, operands, sizeof(operands)));
+
+    // First point at or after the key
+    int low = 0, high = ring->point_count;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (ring->points[middle].hash < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    // Points of failed servers are passed over, so their keys go to the next servers on the ring and no other key moves
+    for (int i = 0; i < ring->point_count; i++)
+    {
+        const struct shard_point *point = &ring->points[(low + i) % ring->point_count];
+        if (!ring->servers[point->server].failed)
+        {
+            return point->server;
+        }
+    }
+    return -1;
+}
+
+void shard_fail(struct shard_ring *ring, int server)
+{
+    if (!ring->servers[server].failed && ring->server_count > 1)
+    {
+        fprintf(stderr, "[WARNING] Server %s failed, its requests go to the other servers.\n", ring->servers[server].name);
+    }
+    ring->servers[server].failed = 1;
+}
+
+CLIENT *shard_client_create(const struct shard_server *server, const char *protocol)
+{
+    struct addrinfo hints, *addresses;
+    struct sockaddr_in address;
+    int sock = RPC_ANYSOCK;
+
+    if (server->port == 0)
+    {
+        return clnt_create(server->host, PART_C, PART_C_VERS, protocol);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(server->host, NULL, &hints, &addresses) != 0)
+    {
+        rpc_createerr.cf_stat = RPC_UNKNOWNHOST;
+        return NULL;
+    }
+    memcpy(&address, addresses->ai_addr, sizeof(address));
+    freeaddrinfo(addresses);
+    address.sin_port = htons(server->port);
+
+    if (strcmp(protocol, "tcp") == 0)
+    {
+        return clnttcp_create(&address, PART_C, PART_C_VERS, &sock, 0, 0);
+    }
+    struct timeval wait = {5, 0};
+    return clntudp_create(&address, PART_C, PART_C_VERS, wait, &sock);
+}
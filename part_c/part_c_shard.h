@@ -0,0 +1,58 @@
+/**
+ * @file    part_c_shard.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Consistent hash ring that spreads the requests of part_c_client over several part_c servers.
+ *
+ *  The server argument of the client can be a comma separated list of servers, each an address with an optional ":port" that skips
+ *  the portmapper lookup, or "@file" naming a file that lists them one per line. Every request is routed by the hash of its
+ *  (executable_path, a, b), so the same request always reaches the same server, and the result cache and the warm pools of each
+ *  server only hold its share of the keys. Every server has many points on the ring, and a key belongs to the first point at or
+ *  after its hash.
+ *
+ *  A server that fails is marked on the ring, and its keys go to the next points of the ring, which belong to the other servers. The
+ *  keys of the servers that didn't fail don't move. A single server behaves like the client always did.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_SHARD_POINTS     Number of ring points of every server, more spread the keys more evenly (default 160)
+ */
+
+#ifndef PART_C_SHARD_H
+#define PART_C_SHARD_H
+
+#include "part_c.h"
+
+struct shard_server
+{
+    char *name;     // As given in the list, also accepted by stream_connect()
+    char *host;
+    u_short port;   // 0 when it is asked from the portmapper
+    int failed;
+};
+
+struct shard_point;
+
+struct shard_ring
+{
+    struct shard_server *servers;
+    int server_count;
+    struct shard_point *points;
+    int point_count;
+};
+
+// Builds the ring of the comma separated server list. Returns 0 on success, -1 on an empty list or a memory error
+int shard_ring_create(struct shard_ring *ring, const char *server_list);
+
+// Frees the servers and the points of the ring
+void shard_ring_free(struct shard_ring *ring);
+
+// Returns the index of the server the request goes to, -1 when every server failed
+int shard_pick(const struct shard_ring *ring, const char *executable_path, int a, int b);
+
+// Marks the server as failed, its keys go to the other servers from now on
+void shard_fail(struct shard_ring *ring, int server);
+
+// Creates a client of the server for the given protocol, through the portmapper unless the server has a port. NULL on error
+CLIENT *shard_client_create(const struct shard_server *server, const char *protocol);
+
+#endif /* PART_C_SHARD_H */
@@ -0,0 +1,133 @@
+/**
+ * @file    part_c_stats.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Prints the per-phase timings and result counts of a running part_c server, and optionally clears them, or its trace.
+ *
+ *  Calls the get_stats procedure of the server and prints a line for every phase with its count and its mean, p50, p90, p99, p99.9 and
+ *  maximum durations in microseconds. The phases are described in part_c_timing.h. With "reset" as the last argument the server
+ *  clears its timings and counters after they are read, so the next call only shows what happened in between.
+ *
+ *  With "trace" the spans of the flight recorder of the server (part_c_trace.h) are printed instead, as Chrome trace-event JSON of
+ *  the given last seconds, or PART_C_TRACE_SECONDS of the server when they aren't given.
+ *
+ *  The server is found through the portmapper, unless PART_C_STATS_PORT gives its port.
+ *
+ *   How to run:
+ *   > make
+ *   > ./part_c_stats.out   server_ip_address
+ *   > ./part_c_stats.out   server_ip_address   reset
+ *   > ./part_c_stats.out   server_ip_address   trace   5   > trace.json
+ */
+
+#include "part_c.h"
+#include "options.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Creates the client, through the portmapper unless PART_C_STATS_PORT is set
+static CLIENT *connect_server(char *host)
+{
+    struct addrinfo hints, *addresses;
+    struct sockaddr_in address;
+    int sock = RPC_ANYSOCK;
+    int port = option_int("PART_C_STATS_PORT", 0);
+
+    if (port == 0)
+    {
+        return clnt_create(host, PART_C, PART_C_VERS, "tcp");
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host, NULL, &hints, &addresses) != 0)
+    {
+        return NULL;
+    }
+    memcpy(&address, addresses->ai_addr, sizeof(address));
+    freeaddrinfo(addresses);
+    address.sin_port = htons(port);
+
+    return clnttcp_create(&address, PART_C, PART_C_VERS, &sock, 0, 0);
+}
+
+static void print_stats(server_stats *stats)
+{
+    printf("Elapsed: %.3f s, %llu cache hits, %llu SUCCESS, %llu FAIL, %llu TIMEOUT, %llu dropped log lines\n", stats->elapsed_ns / 1e9,
+           (unsigned long long)stats->cache_hits, (unsigned long long)stats->successes, (unsigned long long)stats->failures,
+           (unsigned long long)stats->timeouts, (unsigned long long)stats->log_dropped);
+    printf("%-16s %10s %12s %12s %12s %12s %12s %12s\n", "phase", "count", "mean_us", "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us");
+
+    for (u_int i = 0; i < stats->phases.phases_len; i++)
+    {
+        phase_stats *phase = &stats->phases.phases_val[i];
+        printf("%-16s %10llu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", phase->name, (unsigned long long)phase->count,
+               phase->count > 0 ? phase->total_ns / 1e3 / phase->count : 0, phase->p50_ns / 1e3, phase->p90_ns / 1e3, phase->p99_ns / 1e3,
+               phase->p999_ns / 1e3, phase->max_ns / 1e3);
+    }
+}
+
+// Prints the trace of the server as JSON
+static int print_trace(CLIENT *clnt, int seconds)
+{
+    trace_document *result = get_trace_1(&seconds, clnt);
+    if (result == NULL)
+    {
+        clnt_perror(clnt, "call failed");
+        return -1;
+    }
+
+    fputs(*result, stdout);
+    xdr_free((xdrproc_t)xdr_trace_document, (char *)result);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    CLIENT *clnt;
+    server_stats *result;
+    int reset, trace;
+
+    trace = argc >= 3 && strcmp(argv[2], "trace") == 0;
+    if (argc < 2 || argc > (trace ? 4 : 3) || (argc == 3 && !trace && strcmp(argv[2], "reset") != 0))
+    {
+        fprintf(stderr, "[ERROR] Usage: %s server_ip_address [reset | trace [seconds]]\n", argv[0]);
+        exit(1);
+    }
+    reset = argc == 3 && !trace;
+
+    // Traces are megabytes, so the server is called over TCP
+    clnt = connect_server(argv[1]);
+    if (clnt == NULL)
+    {
+        clnt_pcreateerror(argv[1]);
+        exit(1);
+    }
+
+    if (trace)
+    {
+        int failed = print_trace(clnt, argc == 4 ? atoi(argv[3]) : 0);
+        clnt_destroy(clnt);
+        return failed ? 1 : 0;
+    }
+
+    result = get_stats_1(&reset, clnt);
+    if (result == NULL)
+    {
+        clnt_perror(clnt, "call failed");
+        clnt_destroy(clnt);
+        exit(1);
+    }
+
+    print_stats(result);
+    if (reset)
+    {
+        printf("Timings and counters of the server are cleared.\n");
+    }
+
+    xdr_free((xdrproc_t)xdr_server_stats, (char *)result);
+    clnt_destroy(clnt);
+    return 0;
+}
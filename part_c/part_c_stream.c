@@ -0,0 +1,259 @@
+/**
+ * @file    part_c_stream.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Helpers for sending RPC messages over TCP connections without the blocking clnt/svc calls.
+ */
+
+#include "part_c_stream.h"
+#include "options.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <rpc/pmap_clnt.h>
+#include <sys/socket.h>
+
+// Makes sure the buffer has room for size more bytes
+static int reserve(char **data, size_t *capacity, size_t needed)
+{
+    size_t new_capacity = *capacity == 0 ? 1024 : *capacity;
+
+    if (needed <= *capacity)
+    {
+        return 0;
+    }
+    while (new_capacity < needed)
+    {
+        new_capacity *= 2;
+    }
+
+    char *new_data = realloc(*data, new_capacity);
+    if (new_data == NULL)
+    {
+        return -1;
+    }
+    *data = new_data;
+    *capacity = new_capacity;
+
+    return 0;
+}
+
+int record_reader_feed(struct record_reader *reader, const unsigned char *data, size_t length, record_handler handle, void *context)
+{
+    while (length > 0)
+    {
+        // Reading the 4 byte record mark of the next fragment
+        if (reader->header_length < 4)
+        {
+            reader->header[reader->header_length++] = *data++;
+            length--;
+            if (reader->header_length < 4)
+            {
+                continue;
+            }
+
+            uint32_t record_mark;
+            memcpy(&record_mark, reader->header, 4);
+            record_mark = ntohl(record_mark);
+            reader->last_fragment = (record_mark & LAST_FRAGMENT) != 0;
+            reader->fragment_remaining = record_mark & ~LAST_FRAGMENT;
+
+            if (reader->record_length + reader->fragment_remaining > MAX_RECORD_SIZE ||
+                reserve(&reader->record, &reader->record_capacity, reader->record_length + reader->fragment_remaining) == -1)
+            {
+                return -1;
+            }
+        }
+
+        size_t copied = length < reader->fragment_remaining ? length : reader->fragment_remaining;
+        memcpy(reader->record + reader->record_length, data, copied);
+        reader->record_length += copied;
+        reader->fragment_remaining -= copied;
+        data += copied;
+        length -= copied;
+
+        if (reader->fragment_remaining == 0)
+        {
+            if (reader->last_fragment)
+            {
+                handle(reader->record, reader->record_length, context);
+                reader->record_length = 0;
+            }
+            reader->header_length = 0;
+        }
+    }
+
+    return 0;
+}
+
+void record_reader_free(struct record_reader *reader)
+{
+    free(reader->record);
+    memset(reader, 0, sizeof(struct record_reader));
+}
+
+int stream_append_call(struct stream_buffer *buffer, u_int32_t xid, u_long procedure, xdrproc_t xdr_argument, void *argument)
+{
+    struct rpc_msg call;
+    XDR xdrs;
+    size_t size;
+    u_int length;
+
+    memset(&call, 0, sizeof(call));
+    call.rm_xid = xid;
+    call.rm_direction = CALL;
+    call.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    call.rm_call.cb_prog = PART_C;
+    call.rm_call.cb_vers = PART_C_VERS;
+    call.rm_call.cb_proc = procedure;
+    call.rm_call.cb_cred = _null_auth;
+    call.rm_call.cb_verf = _null_auth;
+
+    // The call header and the arguments are encoded after a reserved record mark
+    size = xdr_sizeof((xdrproc_t)xdr_callmsg, &call) + xdr_sizeof(xdr_argument, argument) + 4;
+    if (reserve(&buffer->data, &buffer->capacity, buffer->length + size) == -1)
+    {
+        return -1;
+    }
+
+    xdrmem_create(&xdrs, buffer->data + buffer->length + 4, size - 4, XDR_ENCODE);
+    if (!xdr_callmsg(&xdrs, &call) || !xdr_argument(&xdrs, argument))
+    {
+        xdr_destroy(&xdrs);
+        return -1;
+    }
+    length = xdr_getpos(&xdrs);
+    xdr_destroy(&xdrs);
+
+    uint32_t record_mark = htonl(LAST_FRAGMENT | length);
+    memcpy(buffer->data + buffer->length, &record_mark, 4);
+    buffer->length += length + 4;
+
+    return 0;
+}
+
+int stream_append_record(struct stream_buffer *buffer, const char *message, size_t length)
+{
+    uint32_t record_mark = htonl(LAST_FRAGMENT | length);
+
+    if (reserve(&buffer->data, &buffer->capacity, buffer->length + length + 4) == -1)
+    {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, &record_mark, 4);
+    memcpy(buffer->data + buffer->length + 4, message, length);
+    buffer->length += length + 4;
+
+    return 0;
+}
+
+u_int32_t stream_reply_xid(const char *record, size_t length)
+{
+    uint32_t xid = 0;
+
+    if (length >= 4)
+    {
+        memcpy(&xid, record, 4);
+    }
+    return ntohl(xid);
+}
+
+enum clnt_stat stream_decode_reply(char *record, size_t length, xdrproc_t xdr_result, void *result)
+{
+    struct rpc_msg reply;
+    char verifier[MAX_AUTH_BYTES];
+    XDR xdrs;
+    bool_t decoded;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.acpted_rply.ar_verf.oa_base = verifier;
+    reply.acpted_rply.ar_results.where = result;
+    reply.acpted_rply.ar_results.proc = xdr_result;
+
+    xdrmem_create(&xdrs, record, length, XDR_DECODE);
+    decoded = xdr_replymsg(&xdrs, &reply);
+    xdr_destroy(&xdrs);
+
+    if (!decoded || reply.rm_direction != REPLY)
+    {
+        return RPC_CANTDECODERES;
+    }
+
+    // Converting the reply status to the clnt_stat values that clnt_call would return
+    if (reply.rm_reply.rp_stat == MSG_DENIED)
+    {
+        return reply.rjcted_rply.rj_stat == RPC_MISMATCH ? RPC_VERSMISMATCH : RPC_AUTHERROR;
+    }
+
+    switch (reply.acpted_rply.ar_stat)
+    {
+    case SUCCESS:
+        return RPC_SUCCESS;
+    case PROG_UNAVAIL:
+        return RPC_PROGUNAVAIL;
+    case PROG_MISMATCH:
+        return RPC_PROGVERSMISMATCH;
+    case PROC_UNAVAIL:
+        return RPC_PROCUNAVAIL;
+    case GARBAGE_ARGS:
+        return RPC_CANTDECODEARGS;
+    default:
+        return RPC_SYSTEMERROR;
+    }
+}
+
+int stream_connect(const char *host)
+{
+    struct addrinfo hints, *addresses;
+    struct sockaddr_in address;
+    char name[256];
+    u_short port;
+    int fd;
+
+    // A ":port" after the host is taken before PART_C_SERVER_PORT, so servers on one machine can be told apart
+    if (snprintf(name, sizeof(name), "%s", host) >= (int)sizeof(name))
+    {
+        return -1;
+    }
+    char *separator = strchr(name, ':');
+    port = option_int("PART_C_SERVER_PORT", 0);
+    if (separator != NULL)
+    {
+        *separator = '\0';
+        port = atoi(separator + 1);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(name, NULL, &hints, &addresses) != 0)
+    {
+        return -1;
+    }
+    memcpy(&address, addresses->ai_addr, sizeof(address));
+    freeaddrinfo(addresses);
+
+    // The port is asked from the portmapper on host, unless it is given
+    if (port == 0)
+    {
+        port = pmap_getport(&address, PART_C, PART_C_VERS, IPPROTO_TCP);
+        if (port == 0)
+        {
+            return -1;
+        }
+    }
+    address.sin_port = htons(port);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
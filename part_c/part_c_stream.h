@@ -0,0 +1,66 @@
+/**
+ * @file    part_c_stream.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Helpers for sending RPC messages over TCP connections without the blocking clnt/svc calls.
+ *
+ *  RPC over TCP sends every message as a record made of fragments, each fragment starting with a 4 byte record mark holding its
+ *  length and whether it is the last fragment of the record (RFC 5531 section 11). The worker pool server and the pipelined client
+ *  read many messages from one connection in whatever pieces they arrive, so they use the record reader below to put them back
+ *  together, and they encode their outgoing messages into buffers before writing them.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_SERVER_PORT  TCP port of the server, skips the portmapper lookup of stream_connect() when set
+ */
+
+#ifndef PART_C_STREAM_H
+#define PART_C_STREAM_H
+
+#include "part_c.h"
+
+#define LAST_FRAGMENT 0x80000000u
+#define MAX_RECORD_SIZE (16 * 1024 * 1024) // Records bigger than this are treated as a broken connection
+
+// Reassembly state of the records of one connection
+struct record_reader
+{
+    unsigned char header[4];
+    int header_length;
+    unsigned int fragment_remaining;
+    int last_fragment;
+    char *record;
+    size_t record_length, record_capacity;
+};
+
+// Called with every completed record, the record is only valid during the call
+typedef void (*record_handler)(char *record, size_t length, void *context);
+
+// Growing buffer of encoded outgoing bytes
+struct stream_buffer
+{
+    char *data;
+    size_t length, capacity;
+};
+
+// Adds received bytes to the reader and calls handle for every record they complete. Returns -1 on a protocol or memory error
+int record_reader_feed(struct record_reader *reader, const unsigned char *data, size_t length, record_handler handle, void *context);
+
+// Frees the buffer of the reader
+void record_reader_free(struct record_reader *reader);
+
+// Appends a record marked call message with AUTH_NONE credentials to the buffer. Returns -1 if it couldn't be encoded
+int stream_append_call(struct stream_buffer *buffer, u_int32_t xid, u_long procedure, xdrproc_t xdr_argument, void *argument);
+
+// Appends a record mark and the given message to the buffer. Returns -1 on a memory error
+int stream_append_record(struct stream_buffer *buffer, const char *message, size_t length);
+
+// Returns the xid of an encoded reply record, which is used to find where its result should be decoded
+u_int32_t stream_reply_xid(const char *record, size_t length);
+
+// Decodes a reply record, decoding its result with xdr_result into result when the call succeeded
+enum clnt_stat stream_decode_reply(char *record, size_t length, xdrproc_t xdr_result, void *result);
+
+// Connects to the TCP service of PART_C on host, which can end with ":port", returns the socket or -1 on error
+int stream_connect(const char *host);
+
+#endif /* PART_C_STREAM_H */
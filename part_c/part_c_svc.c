@@ -4,6 +4,10 @@
  */
 
 #include "part_c.h"
+#include "part_c_dispatch.h"
+#include "part_c_trace.h"
+#include "part_c_upgrade.h"
+#include "options.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <rpc/pmap_clnt.h>
@@ -22,6 +26,10 @@ part_c_1(struct svc_req *rqstp, register SVCXPRT *transp)
 	union
 	{
 		arguments run_binary_1_arg;
+		batch_arguments run_binary_batch_1_arg;
+		limited_arguments run_binary_limited_1_arg;
+		int get_stats_1_arg;
+		int get_trace_1_arg;
 	} argument;
 	char *result;
 	xdrproc_t _xdr_argument, _xdr_result;
@@ -39,6 +47,30 @@ part_c_1(struct svc_req *rqstp, register SVCXPRT *transp)
 		local = (char *(*)(char *, struct svc_req *))run_binary_1_svc;
 		break;
 
+	case run_binary_batch:
+		_xdr_argument = (xdrproc_t)xdr_batch_arguments;
+		_xdr_result = (xdrproc_t)xdr_batch_results;
+		local = (char *(*)(char *, struct svc_req *))run_binary_batch_1_svc;
+		break;
+
+	case run_binary_limited:
+		_xdr_argument = (xdrproc_t)xdr_limited_arguments;
+		_xdr_result = (xdrproc_t)xdr_wrapstring;
+		local = (char *(*)(char *, struct svc_req *))run_binary_limited_1_svc;
+		break;
+
+	case get_stats:
+		_xdr_argument = (xdrproc_t)xdr_int;
+		_xdr_result = (xdrproc_t)xdr_server_stats;
+		local = (char *(*)(char *, struct svc_req *))get_stats_1_svc;
+		break;
+
+	case get_trace:
+		_xdr_argument = (xdrproc_t)xdr_int;
+		_xdr_result = (xdrproc_t)xdr_trace_document;
+		local = (char *(*)(char *, struct svc_req *))get_trace_1_svc;
+		break;
+
 	default:
 		svcerr_noproc(transp);
 		return;
@@ -65,7 +97,32 @@ part_c_1(struct svc_req *rqstp, register SVCXPRT *transp)
 int main(int argc, char *argv[])
 {
 
-	register SVCXPRT *transp;
+	register SVCXPRT *transp, *udp_transp;
+	int workers, upgrade_fd = -1, handoff_socket, udp_socket, tcp_socket;
+	struct sockaddr_in logger_address;
+
+	// Only the worker pool mode can be upgraded, it watches the descriptor of the SIGHUP handler
+	workers = option_int("PART_C_WORKERS", 0);
+	if (workers > 0)
+	{
+		upgrade_fd = upgrade_init(argv[0]);
+	}
+	else if (option_int("PART_C_WRAPPER_FD", -1) == UPGRADE_WRAPPER_FD)
+	{
+		// Without upgrades the pipe to the wrapper isn't used, blackboxes shouldn't get it
+		close(UPGRADE_WRAPPER_FD);
+	}
+
+	// The flight recorder answers SIGUSR2 from the start, not only after the first request
+	trace_start();
+
+	// A server started by an upgrade serves the sockets of the old one, which stay registered with the portmapper
+	handoff_socket = upgrade_inherit(&udp_socket, &tcp_socket, &logger_address);
+	if (handoff_socket != -1)
+	{
+		logger_address_adopt(&logger_address);
+		dispatch_run(udp_socket, tcp_socket, workers, upgrade_fd, handoff_socket);
+	}
 
 	pmap_unset(PART_C, PART_C_VERS);
 
@@ -81,6 +138,8 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	udp_transp = transp;
+
 	transp = svctcp_create(RPC_ANYSOCK, 0, 0);
 	if (transp == NULL)
 	{
@@ -93,6 +152,12 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	// Serving with worker threads if they are configured, otherwise with the single threaded svc_run() loop
+	if (workers > 0)
+	{
+		dispatch_run(udp_transp->xp_sock, transp->xp_sock, workers, upgrade_fd, -1);
+	}
+
 	svc_run();
 	fprintf(stderr, "%s", "svc_run returned");
 	exit(1);
@@ -0,0 +1,117 @@
+/**
+ * @file    part_c_timing.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Per-phase timings and result counters of the part_c server, read and cleared with the get_stats procedure.
+ *
+ *  Every phase has its own histogram and lock, so requests in different phases don't wait for each other. Counters are atomic.
+ *  Histograms are from common/histogram.c, so percentiles are known to within 1%. Every recorded phase is also a span of the
+ *  flight recorder of part_c_trace.c, even when PART_C_TIMING=0.
+ */
+
+#include "part_c_timing.h"
+#include "part_c_trace.h"
+#include "histogram.h"
+#include "options.h"
+
+#include <pthread.h>
+#include <time.h>
+
+static const char *phase_names[PHASE_COUNT] = {"cache_lookup", "spawn", "write_input", "run", "format", "log",
+                                               "cache_store", "total", "logger_connect", "logger_send"};
+
+static pthread_once_t timing_once = PTHREAD_ONCE_INIT;
+static int timing_enabled;
+static pthread_mutex_t phase_locks[PHASE_COUNT];
+static struct histogram phases[PHASE_COUNT];
+static uint64_t counters[COUNTER_COUNT];
+static long long reset_at_ns; // Start of the current recording, under the lock of the first phase
+
+static void timing_init(void)
+{
+    timing_enabled = option_int("PART_C_TIMING", 1);
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        pthread_mutex_init(&phase_locks[i], NULL);
+        histogram_init(&phases[i]);
+    }
+    reset_at_ns = timing_now();
+}
+
+long long timing_now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+long long timing_record(enum timing_phase phase, long long started_ns)
+{
+    long long now = timing_now();
+
+    pthread_once(&timing_once, timing_init);
+    if (timing_enabled)
+    {
+        pthread_mutex_lock(&phase_locks[phase]);
+        histogram_record(&phases[phase], now > started_ns ? now - started_ns : 0);
+        pthread_mutex_unlock(&phase_locks[phase]);
+    }
+    trace_span(phase_names[phase], started_ns, now);
+    return now;
+}
+
+void timing_count(enum timing_counter counter)
+{
+    __atomic_add_fetch(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+bool_t timing_snapshot(server_stats *stats, int reset)
+{
+    pthread_once(&timing_once, timing_init);
+
+    stats->phases.phases_len = PHASE_COUNT;
+    stats->phases.phases_val = (phase_stats *)calloc(PHASE_COUNT, sizeof(phase_stats));
+    if (stats->phases.phases_val == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        return FALSE;
+    }
+
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        phase_stats *phase = &stats->phases.phases_val[i];
+        phase->name = strdup(phase_names[i]);
+
+        pthread_mutex_lock(&phase_locks[i]);
+        struct histogram *histogram = &phases[i];
+        phase->count = histogram->total;
+        phase->total_ns = histogram->sum;
+        phase->min_ns = histogram->total > 0 ? histogram->min : 0;
+        phase->max_ns = histogram->max;
+        phase->p50_ns = histogram_percentile(histogram, 50);
+        phase->p90_ns = histogram_percentile(histogram, 90);
+        phase->p99_ns = histogram_percentile(histogram, 99);
+        phase->p999_ns = histogram_percentile(histogram, 99.9);
+        if (i == 0)
+        {
+            stats->elapsed_ns = timing_now() - reset_at_ns;
+        }
+        if (reset)
+        {
+            histogram_init(histogram);
+            if (i == 0)
+            {
+                reset_at_ns = timing_now();
+            }
+        }
+        pthread_mutex_unlock(&phase_locks[i]);
+    }
+
+    u_quad_t *values[COUNTER_COUNT] = {&stats->cache_hits, &stats->successes, &stats->failures, &stats->timeouts};
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        *values[i] = reset ? __atomic_exchange_n(&counters[i], 0, __ATOMIC_RELAXED) : __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+    }
+
+    return TRUE;
+}
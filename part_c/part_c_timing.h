@@ -0,0 +1,63 @@
+/**
+ * @file    part_c_timing.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Per-phase timings and result counters of the part_c server, read and cleared with the get_stats procedure.
+ *
+ *  Every request is split into phases whose durations are recorded into a histogram each, with monotonic timestamps:
+ *      cache_lookup    Looking the pair up in the memory and disk caches
+ *      spawn           Taking a warm blackbox from the pool, or creating its pipes, forking and executing it
+ *      write_input     Writing the numbers to the STDIN of the blackbox
+ *      run             Running the blackbox, its output is read while it runs
+ *      format          Turning the output into the SUCCESS, FAIL or TIMEOUT result
+ *      log             Queueing the log line
+ *      cache_store     Storing the result in the caches
+ *      total           The whole pair, from the cache lookup to the cache store
+ *  Connecting to the logger and sending log lines happen on the thread of part_c_log_sender.c, outside the requests, and are recorded
+ *  as the logger_connect and logger_send phases.
+ *
+ *  Recording is on unless PART_C_TIMING=0.
+ */
+
+#ifndef PART_C_TIMING_H
+#define PART_C_TIMING_H
+
+#include "part_c.h"
+
+enum timing_phase
+{
+    PHASE_CACHE_LOOKUP,
+    PHASE_SPAWN,
+    PHASE_WRITE_INPUT,
+    PHASE_RUN,
+    PHASE_FORMAT,
+    PHASE_LOG,
+    PHASE_CACHE_STORE,
+    PHASE_TOTAL,
+    PHASE_LOGGER_CONNECT,
+    PHASE_LOGGER_SEND,
+    PHASE_COUNT
+};
+
+enum timing_counter
+{
+    COUNTER_CACHE_HITS,
+    COUNTER_SUCCESSES,
+    COUNTER_FAILURES,
+    COUNTER_TIMEOUTS,
+    COUNTER_COUNT
+};
+
+// Returns the current monotonic time in nanoseconds
+long long timing_now(void);
+
+// Records the time from started_ns until now for the phase. Returns now, which is where the next phase starts
+long long timing_record(enum timing_phase phase, long long started_ns);
+
+void timing_count(enum timing_counter counter);
+
+// Fills stats with the counters and phases recorded since the start or the last reset, then clears them if reset isn't 0. The phases
+// are allocated for the caller and freed with xdr_free()
+bool_t timing_snapshot(server_stats *stats, int reset);
+
+#endif /* PART_C_TIMING_H */
@@ -0,0 +1,280 @@
+/**
+ * @file    part_c_trace.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Flight recorder of the part_c server, keeping the latest spans of every thread for Chrome trace-event JSON dumps.
+ *
+ *  Every thread writes its spans into its own ring, so writing needs no lock: the span is stored in the slot after the last one and
+ *  the count of written spans is published with a release store. A dump reads a ring while its thread keeps writing; it copies the
+ *  slots, reads the count again, and leaves out the slots that were overwritten in between.
+ *
+ *  Rings are never freed. The ring of an exited thread, like a batch thread, is taken over by the next new thread, so the number of
+ *  rings stays at the highest number of threads that recorded at once, and the spans of the exited thread can still be dumped.
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_trace.h"
+#include "options.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct trace_event
+{
+    const char *name;
+    long long started_ns, ended_ns;
+    u_int32_t xid;
+    pid_t tid;
+};
+
+struct trace_ring
+{
+    struct trace_event *events;
+    unsigned long long head;    // Number of spans ever written, slot head % ring_size is the next one
+    int active;                 // 0 after its thread exited, when a new thread can take it
+    struct trace_ring *next;
+};
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static int trace_enabled;
+static unsigned long long ring_size;
+static long trace_seconds;
+static const char *trace_path;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *rings;    // New rings are added to the front, the next pointers never change after that
+static pthread_key_t ring_key;      // Marks the ring of a thread inactive when the thread exits
+static sem_t dump_requested;
+
+static __thread struct trace_ring *thread_ring;
+static __thread u_int32_t thread_xid;
+static __thread pid_t thread_id;
+
+static long long now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void release_ring(void *ring)
+{
+    pthread_mutex_lock(&rings_lock);
+    ((struct trace_ring *)ring)->active = 0;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+// Gives this thread the ring of an exited thread, or a new one. Returns NULL if a new ring can't be allocated
+static struct trace_ring *take_ring(void)
+{
+    struct trace_ring *ring;
+
+    pthread_mutex_lock(&rings_lock);
+    for (ring = rings; ring != NULL && ring->active; ring = ring->next)
+    {
+    }
+    if (ring == NULL)
+    {
+        ring = (struct trace_ring *)calloc(1, sizeof(struct trace_ring));
+        if (ring != NULL && (ring->events = (struct trace_event *)calloc(ring_size, sizeof(struct trace_event))) == NULL)
+        {
+            free(ring);
+            ring = NULL;
+        }
+        if (ring != NULL)
+        {
+            ring->next = rings;
+            rings = ring;
+        }
+    }
+    if (ring != NULL)
+    {
+        ring->active = 1;
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    if (ring != NULL)
+    {
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+// Waits for SIGUSR2 notifications and writes the dump to PART_C_TRACE_PATH
+static void *dump_thread(void *unused)
+{
+    while (1)
+    {
+        if (sem_wait(&dump_requested) != 0)
+        {
+            continue;
+        }
+
+        char *document = trace_dump(trace_seconds);
+        FILE *file = document != NULL ? fopen(trace_path, "w") : NULL;
+        if (file == NULL)
+        {
+            perror("[WARNING] Trace couldn't be written");
+        }
+        else
+        {
+            fputs(document, file);
+            fclose(file);
+            fprintf(stderr, "Trace of the last %ld seconds is written to %s\n", trace_seconds, trace_path);
+        }
+        free(document);
+    }
+
+    return NULL;
+}
+
+// SIGUSR2 handler, only wakes the dump thread since writing the file isn't async-signal-safe
+static void request_dump(int signal_number)
+{
+    sem_post(&dump_requested);
+}
+
+static void trace_init(void)
+{
+    pthread_t thread;
+    struct sigaction action;
+
+    trace_enabled = option_int("PART_C_TRACE", 1);
+    trace_seconds = option_int("PART_C_TRACE_SECONDS", 10);
+    trace_path = option_string("PART_C_TRACE_PATH", "part_c_trace.json");
+    long events = option_int("PART_C_TRACE_EVENTS", 8192);
+    for (ring_size = 1; ring_size < (unsigned long long)events; ring_size <<= 1)
+    {
+    }
+
+    if (!trace_enabled)
+    {
+        return;
+    }
+
+    if (pthread_key_create(&ring_key, release_ring) != 0 || sem_init(&dump_requested, 0, 0) == -1)
+    {
+        perror("[ERROR] Trace recorder couldn't be created.");
+        exit(-1);
+    }
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_dump;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, NULL);
+
+    if (pthread_create(&thread, NULL, dump_thread, NULL) != 0)
+    {
+        fprintf(stderr, "[ERROR] Couldn't create trace dump thread.\n");
+        exit(-1);
+    }
+}
+
+void trace_start(void)
+{
+    pthread_once(&trace_once, trace_init);
+}
+
+void trace_set_request(u_int32_t xid)
+{
+    thread_xid = xid;
+}
+
+void trace_span(const char *name, long long started_ns, long long ended_ns)
+{
+    struct trace_ring *ring = thread_ring;
+
+    if (ring == NULL)
+    {
+        pthread_once(&trace_once, trace_init);
+        if (!trace_enabled || (ring = thread_ring = take_ring()) == NULL)
+        {
+            return;
+        }
+        thread_id = gettid();
+    }
+
+    // Only this thread writes the ring, the release store makes the span visible to dumps with it
+    unsigned long long head = ring->head;
+    struct trace_event *event = &ring->events[head & (ring_size - 1)];
+    event->name = name;
+    event->started_ns = started_ns;
+    event->ended_ns = ended_ns;
+    event->xid = thread_xid;
+    event->tid = thread_id;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+char *trace_dump(long seconds)
+{
+    char *document = NULL;
+    size_t length;
+    struct trace_ring *ring;
+
+    pthread_once(&trace_once, trace_init);
+    if (seconds <= 0)
+    {
+        seconds = trace_seconds;
+    }
+
+    FILE *stream = open_memstream(&document, &length);
+    struct trace_event *copy = (struct trace_event *)malloc(ring_size * sizeof(struct trace_event));
+    if (stream == NULL || copy == NULL)
+    {
+        perror("[ERROR] Memory allocation error.");
+        if (stream != NULL)
+        {
+            fclose(stream);
+        }
+        free(document);
+        free(copy);
+        return NULL;
+    }
+
+    long long since_ns = now_ns() - seconds * 1000000000LL;
+    pid_t pid = getpid();
+
+    pthread_mutex_lock(&rings_lock);
+    ring = rings;
+    pthread_mutex_unlock(&rings_lock);
+
+    fprintf(stream, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(stream, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"part_c_server\"}}", pid);
+    for (; ring != NULL; ring = ring->next)
+    {
+        unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long long start = head > ring_size ? head - ring_size : 0;
+        for (unsigned long long i = start; i < head; i++)
+        {
+            copy[i - start] = ring->events[i & (ring_size - 1)];
+        }
+
+        // Slots the thread started to overwrite while they were copied are left out
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        unsigned long long head_after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long long valid = head_after + 1 > ring_size ? head_after + 1 - ring_size : 0;
+        for (unsigned long long i = start > valid ? start : valid; i < head; i++)
+        {
+            struct trace_event *event = &copy[i - start];
+            if (event->ended_ns < since_ns)
+            {
+                continue;
+            }
+            fprintf(stream,
+                    ",\n{\"name\": \"%s\", \"cat\": \"part_c\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, "
+                    "\"args\": {\"xid\": %u}}",
+                    event->name, event->started_ns / 1e3, (event->ended_ns - event->started_ns) / 1e3, pid, event->tid, event->xid);
+        }
+    }
+    fprintf(stream, "\n]}\n");
+
+    fclose(stream);
+    free(copy);
+    return document;
+}
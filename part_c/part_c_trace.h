@@ -0,0 +1,39 @@
+/**
+ * @file    part_c_trace.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Flight recorder of the part_c server, keeping the latest spans of every thread for Chrome trace-event JSON dumps.
+ *
+ *  Histograms of part_c_timing.c show how slow the requests are in general, but not what happened in one slow request. The flight
+ *  recorder keeps the last spans of each thread (the phases of part_c_timing.h, plus decode, queue and reply in worker pool mode) in a
+ *  ring owned by that thread. Recording is a few stores and one release store without locks, so it is on by default. Old spans are
+ *  overwritten as the rings wrap.
+ *
+ *  On SIGUSR2 the spans of the last PART_C_TRACE_SECONDS are written to PART_C_TRACE_PATH, and the get_trace procedure returns them
+ *  (see part_c_stats.c). The JSON opens in chrome://tracing or Perfetto, with a row for every thread and the RPC xid of each span.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_TRACE            0 disables the recorder (default 1)
+ *      PART_C_TRACE_EVENTS     Number of spans kept for each thread, rounded up to a power of 2 (default 8192)
+ *      PART_C_TRACE_SECONDS    Seconds of spans dumped on SIGUSR2, or by a get_trace call with 0 seconds (default 10)
+ *      PART_C_TRACE_PATH       File the SIGUSR2 dump is written to (default part_c_trace.json)
+ */
+
+#ifndef PART_C_TRACE_H
+#define PART_C_TRACE_H
+
+#include <sys/types.h>
+
+// Reads the options and installs the SIGUSR2 handler. Called by the server on start, and by the first span otherwise
+void trace_start(void);
+
+// Sets the RPC xid that the next spans of this thread belong to, 0 when they don't belong to a call
+void trace_set_request(u_int32_t xid);
+
+// Records a span of this thread, name should be a string constant
+void trace_span(const char *name, long long started_ns, long long ended_ns);
+
+// Returns the spans that ended in the last given seconds as a malloc'd Chrome trace-event JSON document, NULL on error
+char *trace_dump(long seconds);
+
+#endif /* PART_C_TRACE_H */
@@ -0,0 +1,297 @@
+/**
+ * @file    part_c_upgrade.c
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Graceful upgrade of a running part_c server to a new binary, handing its sockets over instead of registering again.
+ *
+ *  The SIGHUP handler only writes to a pipe watched by the dispatch loop, which does the upgrade. The handoff socket is a
+ *  SOCK_SEQPACKET pair, so every message arrives whole with its descriptors. Its end in the new server is moved to UPGRADE_HANDOFF_FD
+ *  while spawning, the other descriptors of the old server are close-on-exec and don't reach the new one.
+ */
+
+#define _GNU_SOURCE
+
+#include "part_c_upgrade.h"
+#include "options.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define READY_TIMEOUT_MS 10000
+
+extern char **environ;
+
+static int request_pipe[2] = {-1, -1};
+static int wrapper_fd = -1;
+static const char *executable;
+
+// SIGHUP handler, the upgrade itself isn't async-signal-safe
+static void request_upgrade(int signal_number)
+{
+    int saved_errno = errno;
+    write(request_pipe[1], "u", 1);
+    errno = saved_errno;
+}
+
+int upgrade_init(const char *executable_path)
+{
+    struct sigaction action;
+
+    executable = option_string("PART_C_UPGRADE_EXECUTABLE", executable_path);
+
+    // Blackboxes shouldn't hold the pipe to the wrapper, only the next server gets it
+    if (option_int("PART_C_WRAPPER_FD", -1) == UPGRADE_WRAPPER_FD && fcntl(UPGRADE_WRAPPER_FD, F_SETFD, FD_CLOEXEC) != -1)
+    {
+        wrapper_fd = UPGRADE_WRAPPER_FD;
+    }
+    if (pipe2(request_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        return -1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_upgrade;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &action, NULL);
+
+    return request_pipe[0];
+}
+
+int upgrade_requested(void)
+{
+    char data[64];
+    int requested = 0;
+
+    while (read(request_pipe[0], data, sizeof(data)) > 0)
+    {
+        requested = 1;
+    }
+    return requested;
+}
+
+int upgrade_send(int handoff_socket, int kind, int fd)
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct upgrade_message content;
+    struct iovec vector = {&content, sizeof(content)};
+    struct msghdr message;
+
+    memset(&content, 0, sizeof(content));
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    content.kind = kind;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    if (fd != -1)
+    {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int));
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    while ((sent = sendmsg(handoff_socket, &message, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    return sent == sizeof(content) ? 0 : -1;
+}
+
+// Receives a message with up to two descriptors, the missing ones are -1. Returns the kind, -1 when the socket is closed or broken
+static int receive_message(int handoff_socket, int fds[2], struct sockaddr_in *logger_address)
+{
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct upgrade_message content;
+    struct iovec vector = {&content, sizeof(content)};
+    struct msghdr message;
+    ssize_t received;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    fds[0] = fds[1] = -1;
+
+    while ((received = recvmsg(handoff_socket, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+    {
+    }
+    if (received != sizeof(content))
+    {
+        return -1;
+    }
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+    {
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(header), (count > 2 ? 2 : count) * sizeof(int));
+    }
+    if (logger_address != NULL)
+    {
+        *logger_address = content.logger_address;
+    }
+    return content.kind;
+}
+
+int upgrade_receive(int handoff_socket, int *fd, struct sockaddr_in *logger_address)
+{
+    int fds[2];
+    int kind = receive_message(handoff_socket, fds, logger_address);
+
+    if (fds[1] != -1)
+    {
+        close(fds[1]);
+    }
+    *fd = fds[0];
+    return kind;
+}
+
+int upgrade_inherit(int *udp_socket, int *tcp_socket, struct sockaddr_in *logger_address)
+{
+    int fds[2];
+
+    if (option_int("PART_C_UPGRADE_FD", -1) != UPGRADE_HANDOFF_FD)
+    {
+        return -1;
+    }
+    // Blackboxes and the next upgrade shouldn't see it
+    unsetenv("PART_C_UPGRADE_FD");
+    fcntl(UPGRADE_HANDOFF_FD, F_SETFD, FD_CLOEXEC);
+
+    if (receive_message(UPGRADE_HANDOFF_FD, fds, logger_address) != UPGRADE_LISTENERS || fds[0] == -1 || fds[1] == -1)
+    {
+        fprintf(stderr, "%s", "[ERROR] Couldn't receive the sockets of the old server.\n");
+        exit(1);
+    }
+
+    *udp_socket = fds[0];
+    *tcp_socket = fds[1];
+    return UPGRADE_HANDOFF_FD;
+}
+
+// Returns a copy of the environment with PART_C_UPGRADE_FD set for the new server, NULL on a memory error
+static char **upgrade_environment(void)
+{
+    static char variable[32];
+    size_t count = 0, next = 0;
+
+    while (environ[count] != NULL)
+    {
+        count++;
+    }
+    char **environment = (char **)calloc(count + 2, sizeof(char *));
+    if (environment == NULL)
+    {
+        return NULL;
+    }
+
+    snprintf(variable, sizeof(variable), "PART_C_UPGRADE_FD=%d", UPGRADE_HANDOFF_FD);
+    environment[next++] = variable;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strncmp(environ[i], "PART_C_UPGRADE_FD=", strlen("PART_C_UPGRADE_FD=")) != 0)
+        {
+            environment[next++] = environ[i];
+        }
+    }
+    return environment;
+}
+
+int upgrade_start(int udp_socket, int tcp_socket, const struct sockaddr_in *logger_address)
+{
+    posix_spawn_file_actions_t actions;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct upgrade_message content;
+    struct iovec vector = {&content, sizeof(content)};
+    struct msghdr message;
+    char *arguments[] = {(char *)executable, NULL};
+    int sockets[2], fds[2] = {udp_socket, tcp_socket};
+    pid_t pid;
+
+    char **environment = upgrade_environment();
+    if (environment == NULL || socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        perror("[WARNING] Couldn't prepare the upgrade");
+        free(environment);
+        return -1;
+    }
+
+    // The RPC sockets are created by svcudp_create() and svctcp_create() without close-on-exec, they only reach the new server through
+    // the handoff socket
+    fcntl(udp_socket, F_SETFD, FD_CLOEXEC);
+    fcntl(tcp_socket, F_SETFD, FD_CLOEXEC);
+
+    int error = posix_spawn_file_actions_init(&actions);
+    if (error == 0)
+    {
+        error = posix_spawn_file_actions_adddup2(&actions, sockets[1], UPGRADE_HANDOFF_FD);
+        if (error == 0 && wrapper_fd != -1)
+        {
+            error = posix_spawn_file_actions_adddup2(&actions, wrapper_fd, UPGRADE_WRAPPER_FD);
+        }
+        if (error == 0)
+        {
+            error = posix_spawn(&pid, executable, &actions, NULL, arguments, environment);
+        }
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    free(environment);
+    close(sockets[1]);
+    if (error != 0)
+    {
+        errno = error;
+        perror("[WARNING] Couldn't start the new server");
+        close(sockets[0]);
+        return -1;
+    }
+
+    memset(&content, 0, sizeof(content));
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    content.kind = UPGRADE_LISTENERS;
+    content.logger_address = *logger_address;
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    memcpy(CMSG_DATA(header), fds, 2 * sizeof(int));
+
+    // The old server keeps serving if the new one fails before it is ready, so a broken binary doesn't take the service down
+    struct pollfd ready = {sockets[0], POLLIN, 0};
+    int ready_fds[2];
+    if (sendmsg(sockets[0], &message, MSG_NOSIGNAL) != sizeof(content) || poll(&ready, 1, READY_TIMEOUT_MS) != 1 ||
+        receive_message(sockets[0], ready_fds, NULL) != UPGRADE_READY)
+    {
+        fprintf(stderr, "%s", "[WARNING] The new server didn't get ready, the upgrade is cancelled.\n");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(sockets[0]);
+        return -1;
+    }
+
+    // Written before this server exits, so the wrapper has the pid when it reaps this server
+    if (wrapper_fd != -1 && write(wrapper_fd, &pid, sizeof(pid)) != sizeof(pid))
+    {
+        perror("[WARNING] Couldn't report the new server to the wrapper");
+    }
+
+    return sockets[0];
+}
@@ -0,0 +1,70 @@
+/**
+ * @file    part_c_upgrade.h
+ * @author  Erim Erkin Doğan
+ *
+ * @brief   Graceful upgrade of a running part_c server to a new binary, handing its sockets over instead of registering again.
+ *
+ *  Restarting the server through the wrapper unregisters it from the portmapper, creates new sockets and registers them again, so
+ *  calls arriving in between fail, and the warm pools and caches are lost. In worker pool mode, SIGHUP upgrades the server instead:
+ *  it starts PART_C_UPGRADE_EXECUTABLE (by default the binary it was started from) with a UNIX socket to it, and passes its UDP and
+ *  TCP RPC sockets over it with SCM_RIGHTS. The new server serves them as soon as it reports that it is ready, with the portmapper
+ *  registration of the old one, since the ports don't change.
+ *
+ *  The old server then stops reading the RPC sockets and drains: calls it already read are run and answered, and each TCP connection
+ *  is handed over to the new server once it is between two calls and has no call running. Unread calls stay in the connection for the
+ *  new server, so clients only see a pause. Finally the old server flushes its log queue and hands over the logger connection, so the
+ *  log keeps its order, and exits. Connections that are still busy after PART_C_UPGRADE_DRAIN_MS are closed.
+ *
+ *  Options are read from environment variables:
+ *      PART_C_UPGRADE_EXECUTABLE   Binary started on SIGHUP (default the path the server was started with)
+ *      PART_C_UPGRADE_DRAIN_MS     Longest time the old server waits for its connections to get idle (default 30000)
+ */
+
+#ifndef PART_C_UPGRADE_H
+#define PART_C_UPGRADE_H
+
+#include <netinet/in.h>
+
+// Descriptor of the handoff socket in the new server, also given to it in PART_C_UPGRADE_FD
+#define UPGRADE_HANDOFF_FD 197
+
+// Descriptor of the pipe to part_c_server_wrapper in the servers it started, also given in PART_C_WRAPPER_FD. A server writes the pid
+// of its successor to it once the successor is ready, so the wrapper knows which of the processes it adopts are servers
+#define UPGRADE_WRAPPER_FD 196
+
+enum upgrade_message_kind
+{
+    UPGRADE_LISTENERS,  // From the old server with the UDP and TCP sockets, and the logger address
+    UPGRADE_READY,      // From the new server once it serves the sockets
+    UPGRADE_CONNECTION, // From the old server with an idle TCP connection
+    UPGRADE_LOGGER      // From the old server with the logger connection, or without a descriptor when it has none
+};
+
+// Messages on the handoff socket
+struct upgrade_message
+{
+    int kind;
+    struct sockaddr_in logger_address;
+};
+
+// Installs the SIGHUP handler. Returns a descriptor that becomes readable when an upgrade is requested, -1 on error
+int upgrade_init(const char *executable_path);
+
+// Returns 1 and clears the request when an upgrade was requested, after the descriptor of upgrade_init() became readable
+int upgrade_requested(void);
+
+// In a server started by an upgrade, receives the RPC sockets and the logger address. Returns the handoff socket, or -1 when the server
+// wasn't started by an upgrade
+int upgrade_inherit(int *udp_socket, int *tcp_socket, struct sockaddr_in *logger_address);
+
+// Starts the new server and hands the RPC sockets over. Returns the handoff socket once the new server is ready, -1 if it couldn't
+// be started, then the old server keeps serving
+int upgrade_start(int udp_socket, int tcp_socket, const struct sockaddr_in *logger_address);
+
+// Sends a message of the given kind with the descriptor, or without one when fd is -1. Returns 0 on success, -1 on error
+int upgrade_send(int handoff_socket, int kind, int fd);
+
+// Receives a message and the descriptor it carries, or -1 in fd when it has none. Returns the kind, -1 when the socket is closed
+int upgrade_receive(int handoff_socket, int *fd, struct sockaddr_in *logger_address);
+
+#endif /* PART_C_UPGRADE_H */
@@ -18,3 +18,169 @@ xdr_arguments (XDR *xdrs, arguments *objp)
 		 return FALSE;
 	return TRUE;
 }
+
+bool_t
+xdr_limited_arguments (XDR *xdrs, limited_arguments *objp)
+{
+	register int32_t *buf;
+
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		 if (!xdr_string (xdrs, &objp->executable_path, ~0))
+			 return FALSE;
+		buf = XDR_INLINE (xdrs, 4 * BYTES_PER_XDR_UNIT);
+		if (buf == NULL) {
+			 if (!xdr_int (xdrs, &objp->a))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->b))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->wall_timeout_ms))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->cpu_timeout_ms))
+				 return FALSE;
+		} else {
+			IXDR_PUT_LONG(buf, objp->a);
+			IXDR_PUT_LONG(buf, objp->b);
+			IXDR_PUT_LONG(buf, objp->wall_timeout_ms);
+			IXDR_PUT_LONG(buf, objp->cpu_timeout_ms);
+		}
+		return TRUE;
+	} else if (xdrs->x_op == XDR_DECODE) {
+		 if (!xdr_string (xdrs, &objp->executable_path, ~0))
+			 return FALSE;
+		buf = XDR_INLINE (xdrs, 4 * BYTES_PER_XDR_UNIT);
+		if (buf == NULL) {
+			 if (!xdr_int (xdrs, &objp->a))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->b))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->wall_timeout_ms))
+				 return FALSE;
+			 if (!xdr_int (xdrs, &objp->cpu_timeout_ms))
+				 return FALSE;
+		} else {
+			objp->a = IXDR_GET_LONG(buf);
+			objp->b = IXDR_GET_LONG(buf);
+			objp->wall_timeout_ms = IXDR_GET_LONG(buf);
+			objp->cpu_timeout_ms = IXDR_GET_LONG(buf);
+		}
+	 return TRUE;
+	}
+
+	 if (!xdr_string (xdrs, &objp->executable_path, ~0))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->a))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->b))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->wall_timeout_ms))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->cpu_timeout_ms))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_operands (XDR *xdrs, operands *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_int (xdrs, &objp->a))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->b))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_batch_arguments (XDR *xdrs, batch_arguments *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, &objp->executable_path, ~0))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->pairs.pairs_val, (u_int *) &objp->pairs.pairs_len, ~0,
+		sizeof (operands), (xdrproc_t) xdr_operands))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_result_message (XDR *xdrs, result_message *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, objp, ~0))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_batch_results (XDR *xdrs, batch_results *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_array (xdrs, (char **)&objp->results.results_val, (u_int *) &objp->results.results_len, ~0,
+		sizeof (result_message), (xdrproc_t) xdr_result_message))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_phase_stats (XDR *xdrs, phase_stats *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, &objp->name, ~0))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->count))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->total_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->min_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->max_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->p50_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->p90_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->p99_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->p999_ns))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_server_stats (XDR *xdrs, server_stats *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_quad_t (xdrs, &objp->elapsed_ns))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->cache_hits))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->successes))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->failures))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->timeouts))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->log_dropped))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->phases.phases_val, (u_int *) &objp->phases.phases_len, ~0,
+		sizeof (phase_stats), (xdrproc_t) xdr_phase_stats))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_trace_document (XDR *xdrs, trace_document *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_string (xdrs, objp, ~0))
+		 return FALSE;
+	return TRUE;
+}